@@ -33,7 +33,69 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 #include <errno.h>
 #include <string.h>
 #include <time.h>
+#ifndef __WIN32__
+#include <sys/mman.h>
+#endif
 #include "bitrev.h"
+#include "hexfile.h"
+#include "unpack.h"
+
+/* Read len bytes at the current position of fp into dst, reversing the
+ * bits of each byte. Regular files are mapped, so the data is touched
+ * only once on the way into dst. Returns the number of bytes read.
+ */
+static size_t read_reversed(FILE *fp, byte *dst, size_t len)
+{
+  size_t n;
+#ifndef __WIN32__
+  struct stat st;
+  long pos = ftell(fp);
+
+  if (len && pos >= 0 && fstat(fileno(fp), &st) == 0 &&
+      S_ISREG(st.st_mode) && (off_t)(pos + len) <= st.st_size)
+    {
+      off_t base = pos & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+      size_t maplen = pos - base + len;
+      void *m = mmap(0, maplen, PROT_READ, MAP_PRIVATE, fileno(fp), base);
+
+      if (m != MAP_FAILED)
+        {
+          madvise(m, maplen, MADV_SEQUENTIAL);
+          bitrev_copy(dst, (const byte *)m + (pos - base), len);
+          munmap(m, maplen);
+          fseek(fp, pos + len, SEEK_SET);
+          return len;
+        }
+    }
+#endif
+  n = fread(dst, 1, len, fp);
+  bitrev_copy(dst, dst, n);
+  return n;
+}
+
+#define OBUF_SIZE (1 << 18)   /* BitFileWriter output buffer */
+
+/* Insert [start, start + len) into the sorted list, joining touching
+ * ranges.
+ */
+static void add_range(std::vector<bit_range> &r, uint32_t start, uint32_t len)
+{
+  uint64_t end = (uint64_t)start + len;
+  unsigned int i = 0, j;
+
+  while (i < r.size() && (uint64_t)r[i].start + r[i].len < start)
+    i++;
+  for (j = i; j < r.size() && r[j].start <= end; j++)
+    {
+      if (r[j].start < start)
+        start = r[j].start;
+      if ((uint64_t)r[j].start + r[j].len > end)
+        end = (uint64_t)r[j].start + r[j].len;
+    }
+  bit_range n = { start, (uint32_t)(end - start) };
+  r.erase(r.begin() + i, r.begin() + j);
+  r.insert(r.begin() + i, n);
+}
 
 BitFile::BitFile()
   : length(0)
@@ -84,231 +146,159 @@ int BitFile::readBitfile(FILE *fp)
   return 0;
 }
 
+/* Same as readBitfile, for a .bit file already in memory */
+int BitFile::readBitMem(const byte *data, uint32_t size)
+{
+  uint32_t pos = 13; // Skip the header
+  std::string *field;
+  std::string  dummy;
+
+  ranges.clear();
+  while (pos + 3 <= size) {
+    byte key = data[pos++];
+    if (key == 'e') {
+      if (pos + 4 > size)
+        break;
+      length = (data[pos]<<24)+(data[pos+1]<<16)+(data[pos+2]<<8)+data[pos+3];
+      pos += 4;
+      if (length > size - pos)
+        break;
+      if(buffer) delete [] buffer;
+      buffer = new byte[length];
+      bitrev_copy(buffer, data + pos, length); // Reverse the bit order.
+      if (pos + length != size)
+        error("Ignoring extra data at end of file");
+      return 0;
+    }
+    switch(key) {
+    case 'a': field = &ncdFilename; break;
+    case 'b': field = &partName;    break;
+    case 'c': field = &date;        break;
+    case 'd': field = &dtime;        break;
+    default:
+      fprintf(stderr, "Ignoring unknown field '%c'\n", key);
+      field = &dummy;
+    }
+    unsigned short len=(data[pos]<<8)+data[pos+1];
+    pos += 2;
+    if (pos + len > size)
+      break;
+    field->append((const char *)data + pos, len);
+    pos += len;
+  }
+  length = 0;
+  fprintf(stderr, "Unexpected end of bitfile data\n");
+  return 2;
+}
+
 /* Read in whole file with or without bitflip */
 
 int  BitFile::readBIN(FILE *fp, bool do_bitrev)
 {
-    unsigned int i;
+    long size;
 
-    fseek(fp, 0, SEEK_END);
-    length = ftell(fp); /* Fix at end */
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0)
+        return readBINStream(fp, do_bitrev);
+    length = size; /* Fix at end */
     fseek(fp, 0, SEEK_SET);
     if(buffer) delete [] buffer;
     buffer= new byte[length];
     if (buffer == 0)
         return 1;
-    fread(buffer,1, length, fp);
+    if (do_bitrev)
+        read_reversed(fp, buffer, length);
+    else
+        fread(buffer,1, length, fp);
+    return 0;
+} 
 
-    if (!do_bitrev)
-	    return 0;
+/* Pipes, e.g. unpacked input, have no size to ask for */
+int BitFile::readBINStream(FILE *fp, bool do_bitrev)
+{
+    size_t n = 0, size = 1 << 20;
+    byte *data = new byte[size];
 
-    for(i=0; i<length; i++)
+    /* Read straight into the buffer, doubling it when it is full */
+    while ((n += fread(data + n, 1, size - n, fp)) == size)
     {
-        unsigned char data = buffer[i];
-        buffer[i] = bitRevTable[data];
+        byte *p = new byte[2 * size];
+
+        memcpy(p, data, size);
+        delete [] data;
+        data = p;
+        size *= 2;
     }
+    if(buffer) delete [] buffer;
+    buffer = data;
+    length = n;
+    if (do_bitrev)
+        bitrev_copy(buffer, buffer, length);
     return 0;
-} 
+}
 
 /* Read HEX values without preamble */
 int BitFile::readHEXRAW(FILE *fp)
 {
-    char buf[1024];
-    unsigned int byte_count = 0;
+    std::vector<image_segment> segs;
     int res;
-    
-    fseek(fp, 0, SEEK_END);
-    res = ftell(fp);
-    if (res == -1)
-        length = 0;
-    else
-        length = res;
-    length >>= 1; /* We read two Hex nibbles for each byte*/
-    fseek(fp, 0, SEEK_SET);
-    if(buffer) delete [] buffer;
-    buffer= new byte[length];
 
     /* FIXME: generate a dummy header*/
-    if (buffer == 0)
-        return 1;
-    while ((fgets(buf, 1024, fp)) != 0)
-    {
-        int bytes_read = 0;
-        unsigned char value;
-       while (1)
-        {
-            if (buf[bytes_read] == 0x0a || 
-                buf[bytes_read] == 0x0d ||
-                buf[bytes_read] == 0x20 ||
-                buf[bytes_read] == '/')
-                break;
-            sscanf(&buf[bytes_read], "%2hhx", &value);
-            bytes_read += 2;
-            buffer[byte_count++] = bitRevTable[value];
-        }
-    }
-    length = byte_count;
+    res = readHexFile(fp, HEX_RAW, segs);
+    if (res)
+        return res;
+    if(buffer) delete [] buffer;
+    length = (segs.size()) ? segs[0].data.size() : 0;
+    buffer = new byte[length];
+    if (length)
+        bitrev_copy(buffer, &segs[0].data[0], length);
     return 0;
 }
 
-/* Adapted from openocd : src/target/image.c : image_ihex_buffer_complete()
- *   Copyright (C) 2007 by Dominic Rath                                    *
- *   Dominic.Rath@gmx.de                                                   *
- *                                                                         *
- *   Copyright (C) 2007,2008 330yvind Harboe                                *
- *   oyvind.harboe@zylin.com                                               *
- *                                                                         *
- *   Copyright (C) 2008 by Spencer Oliver                                  *
- *   spen@spen-soft.co.uk                                                  *
- */ 
-
+/* Intel HEX as written by PROMGen. Unused bytes up to the highest
+ * address are left erased (0xff) and recorded as holes.
+ */
 int BitFile::readMCSfile(FILE *fp)
 {
-  unsigned int full_address = 0;
-  char buf[1024];
-  
-  fseek(fp, 0, SEEK_END);
-  length = (ftell(fp)  >> 1);
-  fseek(fp, 0, SEEK_SET);
+  std::vector<image_segment> segs;
+  unsigned int i;
+  int res;
 
   /* FIXME: Fill in dtime and date from the input file */
 
+  res = readHexFile(fp, HEX_INTEL, segs);
+  if (res)
+    return res;
   if(buffer) delete [] buffer;
-  buffer=new byte[length];
-  while ((fgets(buf, 1024, fp)) != 0)
+  length = (segs.size()) ? segs.back().addr + segs.back().data.size() : 0;
+  buffer = new byte[length];
+  memset(buffer, 0xff, length);
+  for (i = 0; i < segs.size(); i++)
     {
-      uint32_t count;
-      uint32_t address;
-      uint32_t record_type;
-      uint32_t checksum;
-      uint8_t  cal_checksum = 0;
-      size_t   bytes_read = 0;
-      if (sscanf(&buf[bytes_read], ":%2x%4x%2x",
-		 &count, &address, &record_type) != 3)
-	{
-	  fprintf(stderr, "Invalid signature %9s\n", buf);
-	  return 1;
-	}
-      bytes_read += 9;
-      cal_checksum += (uint8_t)count;
-      cal_checksum += (uint8_t)(address >> 8);
-      cal_checksum += (uint8_t)address;
-      cal_checksum += (uint8_t)record_type;
-            
-      switch (record_type)
-	{
-	case 0:
-	  if ((full_address & 0xffff) != address)
-	    {
-	      full_address = (full_address & 0xffff0000) | address;
-	    }
-	  
-	  while (count-- > 0)
-	    {
-	      unsigned int value;
-	      sscanf(&buf[bytes_read], "%2x", &value);
-	      buffer[full_address] = value;
-	      cal_checksum += buffer[full_address];
-	      bytes_read += 2;
-	      full_address++;
-	    }
-	  break;
-	case 1:
-	  length = full_address;
-	  return 0;
-	case 2:
-	  {
-	    uint16_t upper_address;
-	    sscanf(&buf[bytes_read], "%4hx", &upper_address);
-	    cal_checksum += (uint8_t)(upper_address >> 8);
-	    cal_checksum += (uint8_t)upper_address;
-	    bytes_read += 4;
-
-	    if ((full_address >> 4) != upper_address)
-	      {
-		full_address = (full_address & 0xffff) | (upper_address << 4);
-	      }
-   	    break;
-	  }
-	case 3:
-	  {
-	    uint32_t dummy;
-	    /* "Start Segment Address Record" will not be supported */
-	    /* but we must consume it, and do not create an error.  */
-	    while (count-- > 0)
-	      {
-		sscanf(&buf[bytes_read], "%2x", &dummy);
-		cal_checksum += (uint8_t)dummy;
-		bytes_read += 2;
-	      }
-  	    break;
-	  }
-	case 4:
-	  {
-	    uint16_t upper_address;
-
-	    sscanf(&buf[bytes_read], "%4hx", &upper_address);
-	    cal_checksum += (uint8_t)(upper_address >> 8);
-	    cal_checksum += (uint8_t)upper_address;
-	    bytes_read += 4;
-	    
-	    if ((full_address >> 16) != upper_address)
-	      {
-		full_address = (full_address & 0xffff) | (upper_address << 16);
-	      }
-	    break;
-	  }
-	case 5:
-	  {
-	    uint32_t start_address;
-
-	    sscanf(&buf[bytes_read], "%8x", &start_address);
-	    cal_checksum += (uint8_t)(start_address >> 24);
-	    cal_checksum += (uint8_t)(start_address >> 16);
-	    cal_checksum += (uint8_t)(start_address >> 8);
-	    cal_checksum += (uint8_t)start_address;
-	    bytes_read += 8;
-	    break;
-	  }
-	default:
-	  fprintf(stderr, "unhandled MCS record type: %i", record_type);
-	  return 2;
-	}
-      sscanf(&buf[bytes_read], "%2x", &checksum);
-      bytes_read += 2;
-
-      if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1))
-	{
-	  /* checksum failed */
-	  fprintf(stderr, "incorrect record checksum found in MCS file");
-	  return 3;
-	}
+      memcpy(buffer + segs[i].addr, &segs[i].data[0], segs[i].data.size());
+      if (segs.size() > 1 || segs[i].addr)
+        add_range(ranges, segs[i].addr, segs[i].data.size());
     }
-
-  fprintf(stderr, "premature end of MCS file, no end-of-file record found");
-  return 4;
+  return 0;
 }
 
 // Read in file
 int BitFile::readFile(FILE *fp, FILE_STYLE in_style)
 {
+  int res;
+
   if(!fp) 
     return 1;
+  ranges.clear();
   switch (in_style)
     {
     case STYLE_BIT:
-      return readBitfile(fp);
+      res = readBitfile(fp);
+      break;
     case STYLE_MCS:
-      {
-	int res = readMCSfile(fp);
-	if (res == 0)
-	  {
-	    unsigned int i;
-	    for (i=0; i<length; i++)
-	      buffer[i] = bitRevTable[buffer[i]];
-	  }
-	return res;
-      }
+      res = readMCSfile(fp);
+      if (res == 0)
+        bitrev_copy(buffer, buffer, length);
+      break;
     case STYLE_IHEX:
 /*
  * MCS files written by Xilinx PROMGen are bit-reversed with respect
@@ -316,17 +306,27 @@ int BitFile::readFile(FILE *fp, FILE_STYLE in_style)
  * the bits again, it has already been done by PROMGen.
  * Specify the file type as -i IHEX to activate this option.
  */
-      return readMCSfile(fp);
+      res = readMCSfile(fp);
+      break;
     case STYLE_HEX_RAW:
-        return readHEXRAW(fp);
+      res = readHEXRAW(fp);
+      break;
     case STYLE_BIN:
-        return readBIN(fp, true);
+      res = readBIN(fp, true);
+      break;
     case STYLE_BPI:
-        return readBIN(fp, false);
+      res = readBIN(fp, false);
+      break;
     default: fprintf(stderr, " Unhandled style %s\n",styleToString(in_style));
       return 1;
     }
-	
+  /* Compressed input is only known to be intact at its end */
+  if (unpackCheck(fp))
+    {
+      length = 0;
+      return 1;
+    }
+  return res;
 }
 
 void BitFile::processData(FILE *fp)
@@ -336,12 +336,8 @@ void BitFile::processData(FILE *fp)
   length=(t[0]<<24)+(t[1]<<16)+(t[2]<<8)+t[3];
   if(buffer) delete [] buffer;
   buffer=new byte[length];
-  for(unsigned int i=0; i<length&&!feof(fp); i++){
-    byte b;
-    fread(&b,1,1,fp);
-    buffer[i]=bitRevTable[b]; // Reverse the bit order.
-  }
-  if(feof(fp))  throw  io_exception("Unexpected end of file");
+  if(read_reversed(fp, buffer, length) != length)
+    throw  io_exception("Unexpected end of file");
 
   fread(t,1,1,fp);
   if(!feof(fp))  error("Ignoring extra data at end of file");
@@ -363,6 +359,8 @@ void BitFile::append(uint32_t val, unsigned cnt) {
     buffer[i+2] = bitRevTable[0xFF & (val >>  8)];
     buffer[i+3] = bitRevTable[0xFF & (val >>  0)];
   }
+  if (!ranges.empty())
+    add_range(ranges, length, nlen - length);
   length = nlen;
   
 }
@@ -384,13 +382,10 @@ void BitFile::append(char const *fname) {
     buffer = nbuf;
     
     // append new contents
-    for(size_t i = length; i < nlen; i++) {
-      if(feof(fp))  throw  io_exception("Unexpected end of file");
-      
-      byte  b;
-      fread(&b, 1, 1, fp);
-      buffer[i] = bitRevTable[b]; // Reverse the bit order.
-    }
+    if(read_reversed(fp, buffer + length, nlen - length) != nlen - length)
+      throw  io_exception("Unexpected end of file");
+    if (!ranges.empty())
+      add_range(ranges, length, nlen - length);
     length = nlen;
 
     fclose(fp);
@@ -407,6 +402,96 @@ void BitFile::setLength(unsigned int size)
   if(buffer) delete [] buffer;
   buffer=new byte[length];
   memset(buffer, 0xff, length);
+  ranges.clear();
+}
+
+void BitFile::place(const byte *data, uint32_t offset, uint32_t len)
+{
+  uint32_t end = offset + len;
+
+  if (ranges.empty() && length)
+    add_range(ranges, 0, length);
+  if (end > length)
+    {
+      byte *nbuf = new byte[end];
+
+      if (length)
+        memcpy(nbuf, buffer, length);
+      memset(nbuf + length, 0xff, end - length);
+      if(buffer) delete [] buffer;
+      buffer = nbuf;
+      length = end;
+    }
+  memcpy(buffer + offset, data, len);
+  add_range(ranges, offset, len);
+  if (ranges.size() == 1 && ranges[0].start == 0 && ranges[0].len == length)
+    ranges.clear();
+}
+
+bool BitFile::inRanges(const std::vector<bit_range> &r, uint32_t pos)
+{
+  unsigned int lo = 0, hi = r.size();
+
+  while (lo < hi)
+    {
+      unsigned int mid = (lo + hi) / 2;
+
+      if (pos < r[mid].start)
+        hi = mid;
+      else if (pos - r[mid].start >= r[mid].len)
+        lo = mid + 1;
+      else
+        return true;
+    }
+  return false;
+}
+
+void BitFile::getRanges(uint32_t start, uint32_t len, uint32_t align,
+                        std::vector<bit_range> &out)
+{
+  uint64_t end = (uint64_t)start + len;
+  unsigned int i;
+
+  out.clear();
+  if (ranges.empty())
+    {
+      bit_range r = { start, len };
+
+      if (len)
+        out.push_back(r);
+      return;
+    }
+  for (i = 0; i < ranges.size(); i++)
+    {
+      uint64_t s = ranges[i].start, e = s + ranges[i].len;
+
+      if (s < start)
+        s = start;
+      if (e > end)
+        e = end;
+      if (s >= e)
+        continue;
+      if (align > 1)
+        {
+          s -= s % align;
+          e += (align - e % align) % align;
+          if (s < start)
+            s = start;
+          if (e > end)
+            e = end;
+        }
+      if (out.size() && s <= (uint64_t)out.back().start + out.back().len)
+        {
+          if (e > (uint64_t)out.back().start + out.back().len)
+            out.back().len = e - out.back().start;
+        }
+      else
+        {
+          bit_range r = { (uint32_t)s, (uint32_t)(e - s) };
+
+          out.push_back(r);
+        }
+    }
 }
 
 void BitFile::setNCDFields(const char * partname)
@@ -464,145 +549,310 @@ unsigned char BitFile::checksum(char *buf)
   return (chksum ^ 0xff) + 1;
 }
 
+void BitFile::writeBitHeader(FILE *fp, uint32_t len)
+{
+  uint8_t buffer[256] = {0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0,
+                         0x0f, 0xf0, 0x00, 0x00, 0x01};
+  const std::string *fields[4] = {&ncdFilename, &partName, &date, &dtime};
+  int i, flen;
+
+  fwrite(buffer, 1, 13, fp);
+  for (i = 0; i < 4; i++)
+    {
+      buffer[0] = 'a' + i;
+      flen = fields[i]->size();
+      buffer[1] = flen >>8;
+      buffer[2] = flen & 0xff;
+      fwrite(buffer, 3, 1, fp);
+      fwrite(fields[i]->c_str(), flen, 1, fp);
+    }
+  buffer[0] = 'e';
+  buffer[1] = len >>24 & 0xff;
+  buffer[2] = len >>16 & 0xff;
+  buffer[3] = len >> 8 & 0xff;
+  buffer[4] = len & 0xff;
+  fwrite(buffer, 5, 1, fp);
+}
+
 uint32_t BitFile::saveAs(FILE_STYLE style, const char  *device,
 			      FILE *fp)
 {
   if(length<=0)return length;
   unsigned int clip;
-  unsigned int i;
 
-  setNCDFields(device);
   /* Don't store 0xff bytes from the end of the flash */
   for(clip=length-1; (buffer[clip] == 0xff) && clip>0; clip--){};
   clip++; /* clip is corrected length, not index */
   if (rlength) /* Don't clip is explicit length is requested */
       clip = rlength;
+
+  BitFileWriter out(fp, style, device, false);
+  if (out.begin(*this, clip))
+    return 0;
+  out.write(buffer, clip);
+  return out.finish();
+}
+
+BitFileWriter::BitFileWriter(FILE *f, FILE_STYLE s, const char *dev,
+                             bool clip)
+  : fp(f)
+  , style(s)
+  , device(dev)
+  , clip_ff(clip)
+  , pos(0)
+  , ff_run(0)
+  , hdr_len(0)
+  , len_pos(-1)
+  , nline(0)
+  , base((uint32_t)-1)
+  , obuf(OBUF_SIZE)
+  , nout(0)
+{
+}
+
+BitFileWriter::~BitFileWriter()
+{
+  flushOut();
+}
+
+/* Space for n more characters in the output buffer */
+char *BitFileWriter::room(size_t n)
+{
+  if (nout + n > obuf.size())
+    flushOut();
+  return &obuf[nout];
+}
+
+void BitFileWriter::flushOut()
+{
+  if (nout)
+    fwrite(&obuf[0], 1, nout, fp);
+  nout = 0;
+}
+
+void BitFileWriter::sink(void *ctx, const char *text, size_t len)
+{
+  BitFileWriter *w = (BitFileWriter *)ctx;
+
+  if (len > w->obuf.size() / 2)
+    {
+      w->flushOut();
+      fwrite(text, 1, len, w->fp);
+      return;
+    }
+  memcpy(w->room(len), text, len);
+  w->nout += len;
+}
+
+int BitFileWriter::begin(BitFile &hdr, uint32_t len)
+{
   switch (style)
     {
     case STYLE_BIT:
+      hdr.setNCDFields(device);
+      hdr.writeBitHeader(fp, len);
+      hdr_len = len;
+      /* The length gets fixed up if 0xff bytes are dropped at the end */
+      len_pos = ftell(fp);
+      if (len_pos < 0 || fseek(fp, 0, SEEK_CUR) != 0)
+        clip_ff = false;
+      else
+        len_pos -= 4;
+      break;
     case STYLE_BIN:
     case STYLE_BPI:
-      if(style == STYLE_BIT)
-	{
-	  uint8_t buffer[256] = {0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0,
-			      0x0f, 0xf0, 0x00, 0x00, 0x01};
-	  int len;
-	  
-	  fwrite(buffer, 1, 13, fp);
-	  
-	  buffer[0] = 'a';
-	  len = ncdFilename.size();
-	  buffer[1] = len >>8;
-	  buffer[2] = len & 0xff;
-	  fwrite(buffer, 3, 1, fp);
-	  fwrite(ncdFilename.c_str(), len, 1, fp);
-	  
-	  buffer[0] = 'b';
-	  len = partName.size();
-	  buffer[1] = len >>8;
-	  buffer[2] = len & 0xff;
-	  fwrite(buffer, 3, 1, fp);
-	  fwrite(partName.c_str(), len, 1, fp);
-	  
-	  buffer[0] = 'c';
-	  len = date.size();
-	  buffer[1] = len >>8;
-	  buffer[2] = len & 0xff;
-	  fwrite(buffer, 3, 1, fp);
-	  fwrite(date.c_str(), len, 1, fp);
-	  
-	  buffer[0] = 'd';
-	  len = dtime.size();
-	  buffer[1] = len >>8;
-	  buffer[2] = len & 0xff;
-	  fwrite(buffer, 3, 1, fp);
-	  fwrite(dtime.c_str(), len, 1, fp);
-	  
-	  buffer[0] = 'e';
-	  buffer[1] = clip >>24 & 0xff;
-	  buffer[2] = clip >>16 & 0xff;
-	  buffer[3] = clip >> 8 & 0xff;
-	  buffer[4] = clip & 0xff;
-	  fwrite(buffer, 5, 1, fp);
-	}
-      for(i=0; i<clip; i++)
-	{
-	  byte b;
-	  if (style != STYLE_BPI)
-		  b = bitRevTable[buffer[i]]; // Reverse bit order
-	  else
-		  b = buffer[i];
-	  fwrite(&b,1,1,fp);
-	}
+    case STYLE_HEX:
+    case STYLE_HEX_RAW:
+    case STYLE_MCS:
+    case STYLE_IHEX:
+      break;
+    default:
+      fprintf(stderr, "Style not yet implemted\n");
+      return 1;
+    }
+  return 0;
+}
+
+void BitFileWriter::write(const byte *data, uint32_t len)
+{
+  byte ff[256];
+  uint32_t end = len, n;
+
+  if (!clip_ff)
+    {
+      put(data, len);
+      return;
+    }
+  /* Hold back trailing 0xff bytes until other data follows */
+  while (end > 0 && data[end - 1] == 0xff)
+    end--;
+  if (end == 0)
+    {
+      ff_run += len;
+      return;
+    }
+  memset(ff, 0xff, sizeof(ff));
+  for (; ff_run; ff_run -= n)
+    {
+      n = (ff_run > sizeof(ff))? sizeof(ff) : ff_run;
+      put(ff, n);
+    }
+  put(data, end);
+  ff_run = len - end;
+}
+
+void BitFileWriter::flushLine()
+{
+  if (nline == 0)
+    return;
+  nout += formatHexRecords(room(hexRecordsSize(nline)), line, pos - nline,
+                           nline, 0, &base);
+  nline = 0;
+}
+
+/* Right aligned decimal like "%7d" */
+static char *put_dec(char *p, uint32_t v, int width)
+{
+  char d[10];
+  int n = 0;
+
+  do
+    d[n++] = '0' + v % 10;
+  while (v /= 10);
+  while (width-- > n)
+    *p++ = ' ';
+  while (n)
+    *p++ = d[--n];
+  return p;
+}
+
+static const char lowhex[] = "0123456789abcdef";
+
+void BitFileWriter::put(const byte *data, uint32_t len)
+{
+  uint32_t i, n;
+  char *p;
+
+  switch (style)
+    {
+    case STYLE_BIT:
+    case STYLE_BIN:
+    case STYLE_BPI:
+      while (len)
+        {
+          room(1);
+          n = obuf.size() - nout;
+          if (n > len)
+            n = len;
+          if (style != STYLE_BPI)
+            bitrev_copy((byte *)&obuf[nout], data, n);
+          else
+            memcpy(&obuf[nout], data, n);
+          nout += n;
+          data += n;
+          len -= n;
+          pos += n;
+        }
       break;
     case STYLE_HEX:
-      for(i=0; i<clip; i++)
+      for(i=0; i<len; i++, pos++)
 	{
-	  byte b=bitRevTable[buffer[i]]; // Reverse bit order
-	  if ( i%16 ==  0)
-	    fprintf(fp,"%7d:  ", i);
-	  fprintf(fp,"%02x ", b);
-	  if ( i%16 ==  7)
-	    fprintf(fp," ");
-	  if ( i%16 == 15)
-	    fprintf(fp,"\n");
+	  byte b=bitRevTable[data[i]]; // Reverse bit order
+	  p = room(32);
+	  if ( pos%16 ==  0)
+	    {
+	      p = put_dec(p, pos, 7);
+	      *p++ = ':';
+	      *p++ = ' ';
+	      *p++ = ' ';
+	    }
+	  *p++ = lowhex[b >> 4];
+	  *p++ = lowhex[b & 0xf];
+	  *p++ = ' ';
+	  if ( pos%16 ==  7)
+	    *p++ = ' ';
+	  if ( pos%16 == 15)
+	    *p++ = '\n';
+	  nout = p - &obuf[0];
 	}
       break;
     case STYLE_HEX_RAW:
-      for(i=0; i<clip; i++)
+      for(i=0; i<len; i++, pos++)
 	{
-	  byte b=bitRevTable[buffer[i]]; // Reverse bit order
-	  fprintf(fp,"%02x", b);
-	  if ( i%4 == 3)
-	    fprintf(fp,"\n");
+	  byte b=bitRevTable[data[i]]; // Reverse bit order
+	  p = room(3);
+	  *p++ = lowhex[b >> 4];
+	  *p++ = lowhex[b & 0xf];
+	  if ( pos%4 == 3)
+	    *p++ = '\n';
+	  nout = p - &obuf[0];
 	}
-      if ( i%4 != 3) /* Terminate semil full lines */
-          fprintf(fp,"\n");
       break;
     case STYLE_MCS:
     case STYLE_IHEX:
       {
-        unsigned int base = (unsigned int)-1;
-        char buf[1024];
-        int len = 0;
-        for(i=0; i<clip; i++)
+        const byte *xlat = (style == STYLE_MCS)? bitRevTable : 0;
+
+        /* Whole records straight from data, the rest goes through line[] */
+        n = len & ~15;
+        if (nline == 0 && pos % 16 == 0 && n)
+          {
+            if (hexRecordsSize(n) <= obuf.size())
+              nout += formatHexRecords(room(hexRecordsSize(n)), data, pos, n,
+                                       xlat, &base);
+            else
+              writeHexRecords(data, pos, n, xlat, &base, sink, this);
+            data += n;
+            len -= n;
+            pos += n;
+          }
+        for(i=0; i<len; i++)
           {
-            byte b = buffer[i];
-            if (style == STYLE_MCS)
-              b = bitRevTable[b];
-            if (base != i>>16)
-              {
-                base = i >> 16;
-                fprintf(fp,":");
-		sprintf(buf, "02000004%04X%c", base, 0);
-                fprintf(fp, "%s%02X\r\n", buf, checksum(buf));
-              }
-	    if ((i & 0xf) == 0)
-	      {
-                fprintf(fp,":");
-		sprintf(buf, "%02X", (i & 0xf) +1 );
-		if (clip -i < 0xf)
-		  len = sprintf(buf, "%02X%04X00", clip-i, i & 0xffff);
-		else
-		  len = sprintf(buf, "10%04X00", i & 0xffff);
-	      }
-	    len += sprintf(buf+len, "%02X", b);
-	    if (((i & 0xf) == 0xf) || (i == clip -1))
-	      {
-		buf[len] = 0;
-		len = fprintf(fp, "%s%02X\r\n", buf, checksum(buf));
-	      }
-	  }
-	fprintf(fp,":");
-	sprintf(buf, "00000001");
-	fprintf(fp, "%s%02X\r\n", buf, checksum(buf));
-	break;
+            line[nline++] = (xlat)? xlat[data[i]] : data[i];
+            pos++;
+            if (nline == 16)
+              flushLine();
+          }
       }
-     default:
-      fprintf(stderr, "Style not yet implemted\n");
+      break;
+    default:
+      break;
     }
-  
-  return clip;
+}
+
+uint32_t BitFileWriter::finish(void)
+{
+  switch (style)
+    {
+    case STYLE_BIT:
+      flushOut();
+      if (pos != hdr_len && len_pos >= 0)
+        {
+          byte b[4] = {(byte)(pos >> 24), (byte)(pos >> 16),
+                       (byte)(pos >> 8), (byte)pos};
+          fseek(fp, len_pos, SEEK_SET);
+          fwrite(b, 1, 4, fp);
+          fseek(fp, 0, SEEK_END);
+        }
+      break;
+    case STYLE_HEX_RAW:
+      if ( pos%4 != 3) /* Terminate semil full lines */
+        {
+          *room(1) = '\n';
+          nout++;
+        }
+      break;
+    case STYLE_MCS:
+    case STYLE_IHEX:
+      flushLine();
+      memcpy(room(13), ":00000001FF\r\n", 13);
+      nout += 13;
+      break;
+    default:
+      break;
+    }
+  flushOut();
+  return pos;
 }
 
 void BitFile::error(const std::string &str)
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include <stdio.h>
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 // ----------------------Xilinx .bit file format---------------------------
@@ -75,6 +76,13 @@ typedef unsigned char byte;
 enum FILE_STYLE { STYLE_BIT, STYLE_BIN, STYLE_BPI, STYLE_HEX, STYLE_HEX_RAW,
                   STYLE_MCS, STYLE_IHEX , STYLE_JEDEC, STYLE_AUTO};
 
+/* Populated bytes of the data, offsets in bytes */
+struct bit_range
+{
+  uint32_t start;
+  uint32_t len;
+};
+
 class BitFile
 {
  private:
@@ -90,6 +98,10 @@ class BitFile
   FILE *logfile;
   unsigned int offset;
   unsigned int rlength; /* if != 0 length of data to read/verify*/
+  /* Sorted populated ranges of a file with holes, empty if dense.
+   * Bytes in the holes are 0xff.
+   */
+  std::vector<bit_range> ranges;
 
  private:
   void error(const std::string &str);
@@ -97,6 +109,7 @@ class BitFile
   void processData(FILE *fp);
   int  readBitfile(FILE *fp);
   int  readBIN(FILE *fp, bool do_bitrev);
+  int  readBINStream(FILE *fp, bool do_bitrev);
   int  readHEXRAW(FILE *fp);
   int  readMCSfile(FILE *fp);
   unsigned char checksum(char * buf);
@@ -109,6 +122,10 @@ class BitFile
   void append(uint32_t  val, unsigned cnt);
   void append(char const *file);
   int readFile(FILE *fp, FILE_STYLE in_style);
+  int readBitMem(const byte *data, uint32_t size);
+  // Copy len bytes of data to offset, growing the buffer. Bytes not
+  // placed by any call are holes.
+  void place(const byte *data, uint32_t offset, uint32_t len);
   
  public:
   // Set offset of requested operation in bytes.
@@ -132,6 +149,16 @@ class BitFile
   // Return length of bitfile in bytes.
   inline uint32_t getLengthBytes()              { return length; }
 
+  // Does the data have holes?
+  inline bool isSparse()                        { return !ranges.empty(); }
+
+  // Populated parts of [start, start + len), widened to multiples of
+  // align and merged. A file without holes gives the whole range.
+  void getRanges(uint32_t start, uint32_t len, uint32_t align,
+                 std::vector<bit_range> &out);
+  // Is byte pos in one of the sorted ranges?
+  static bool inRanges(const std::vector<bit_range> &r, uint32_t pos);
+
   inline const char *getError(){
     if(!Error)return("");
     Error=false;
@@ -144,6 +171,7 @@ class BitFile
   void setNCDFields(const char * partname);
   void setLength(unsigned int bit_count);
   uint32_t saveAs(FILE_STYLE style, const char *device, FILE *fp);
+  void writeBitHeader(FILE *fp, uint32_t len);
   int get_bit(unsigned int idx);
   void set_bit(unsigned int idx, int blow);
 
@@ -151,4 +179,42 @@ class BitFile
   static int styleFromString(const char *stylestr, FILE_STYLE *style);
 };
 
+/* Writes data in one of the output styles as it arrives, so large
+   reads don't need to be kept in memory. Data is in BitFile order
+   (bit reversed). With clip_ff, trailing 0xff bytes are dropped like
+   saveAs does. */
+class BitFileWriter
+{
+ private:
+  FILE *fp;
+  FILE_STYLE style;
+  const char *device;
+  bool clip_ff;
+  uint32_t pos;      // bytes written
+  uint32_t ff_run;   // 0xff bytes held back
+  uint32_t hdr_len;  // length in the BIT header
+  long len_pos;      // file position of the BIT length, -1 if not seekable
+  byte line[16];     // MCS/IHEX record being collected
+  int nline;
+  uint32_t base;     // MCS/IHEX extended address
+  std::vector<char> obuf;  // output collected for fwrite
+  size_t nout;
+
+  void put(const byte *data, uint32_t len);
+  void flushLine();
+  char *room(size_t n);
+  void flushOut();
+  static void sink(void *ctx, const char *text, size_t len);
+
+ public:
+  BitFileWriter(FILE *fp, FILE_STYLE style, const char *device,
+                bool clip_ff);
+  ~BitFileWriter();
+  // Write the header for up to len bytes
+  int begin(BitFile &hdr, uint32_t len);
+  void write(const byte *data, uint32_t len);
+  // Complete the file, returns the number of bytes written
+  uint32_t finish(void);
+};
+
 #endif //BITFILE_H
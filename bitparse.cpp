@@ -29,15 +29,23 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 #include <unistd.h>
 
 #include "bitfile.h"
+#include "progalg.h"
+#include "configstream.h"
 #include "io_exception.h"
+#include "unpack.h"
 
 void usage() {
   fprintf(stderr,
-	  "\nUsage:bitparse [-i input format] [-o output format ][-O outfile] infile\n"	  "   -h\t\tprint this help\n"
-	  "   -v\t\tverbose output\n"
+	  "\nUsage:bitparse [-i input format] [-o output format ][-O outfile] [-M manifest] [-P base] [-C llfile] [-F] infile\n"	  "   -h\t\tprint this help\n"
+	  "   -v\t\tverbose output, check the configuration packets\n"
+	  "   -F\t\tlist the frames with their offset in the stream\n"
 	  "   -O\t\toutput file (parse input file only if not given\n"
 	  "   -i\t\tinput  file format (BIT|BIN|BPI|HEX|MCS|IHEX)\n"
-	  "   -o\t\toutput file format (BIT|BIN|BPI|HEX|MCS|IHEX)\n");
+	  "   -o\t\toutput file format (BIT|BIN|BPI|HEX|MCS|IHEX)\n"
+	  "   -M\t\twrite block CRCs for xc3sprog action 'm' to manifest\n"
+	  "   -P\t\tsave only the frames that differ from .bit file base\n"
+	  "   -C\t\tcompress repeated frames, with the frame addresses from\n"
+	  "     \t\tthe logic location file of bitgen -l (.ll)\n");
   exit(255);
 }
 
@@ -50,9 +58,14 @@ int main(int argc, char**args)
   unsigned int i;
 
   const char * outfile = NULL;
+  const char * manifest = NULL;
+  const char * basefile = NULL;
+  const char * llfile = NULL;
+  bool verbose = false;
+  bool frame_list = false;
   while(true)
     {
-      switch(getopt(argc, args, "?i:vo:O:"))
+      switch(getopt(argc, args, "?i:vo:O:M:P:C:F"))
 	{
 	case -1: goto args_done;
 	case 'i':
@@ -74,6 +87,21 @@ int main(int argc, char**args)
 	case 'O':
 	  outfile = optarg;
 	  break;
+	case 'M':
+	  manifest = optarg;
+	  break;
+	case 'v':
+	  verbose = true;
+	  break;
+	case 'F':
+	  frame_list = true;
+	  break;
+	case 'P':
+	  basefile = optarg;
+	  break;
+	case 'C':
+	  llfile = optarg;
+	  break;
 	case '?':
 	case 'h':
 	default:
@@ -101,7 +129,11 @@ int main(int argc, char**args)
 	  return 1;
 	  }
       }
-    file.readFile(fp, in_style);
+    fp = unpackFile(fp);
+    if (!fp)
+      return 1;
+    if (file.readFile(fp, in_style))
+      return 1;
     fprintf(stderr, "Created from NCD file: %s\n",file.getNCDFilename());
     fprintf(stderr, "Target device: %s\n",file.getPartName());
     fprintf(stderr, "Created: %s %s\n",file.getDate(),file.getTime());
@@ -116,7 +148,139 @@ int main(int argc, char**args)
         sum += (file.getData()[i]) ^0xff;
     }
     fprintf(stderr, "64-bit sum: %" PRIu64 "\n", sum);
+
+    if (verbose || frame_list)
+      {
+        int bits = ConfigStream::wordBitsForPart(file.getPartName());
+        ConfigStream cs(file.getData(), file.getLength()/8, (bits)? bits : 32);
+        int npkt = cs.parse();
+
+        if (npkt >= 0 && frame_list)
+          {
+            std::vector<cfg_frame> frames;
+            int fw = ConfigStream::frameWordsForPart(file.getPartName());
+
+            cs.getFrames(fw, frames);
+            fprintf(stdout, "# FAR        frame offset\n");
+            for (i = 0; i < frames.size(); i++)
+              fprintf(stdout, "0x%08x %6u 0x%08x\n", frames[i].far,
+                      frames[i].index, frames[i].data * (cs.getWordBits() / 8));
+          }
+        if (npkt >= 0 && verbose)
+          {
+            unsigned int nframes, ndup, nwords[32], npkts[32];
+            unsigned int nfar = 0, nfdri = 0, nmfwr = 0, nread = 0;
+            std::vector<cfg_frame> frames;
+            int fw = ConfigStream::frameWordsForPart(file.getPartName());
+            int crc = cs.checkCrc();
+            int k;
+
+            memset(nwords, 0, sizeof(nwords));
+            memset(npkts, 0, sizeof(npkts));
+            for (k = 0; k < npkt; k++)
+              {
+                const cfg_packet &p = cs.getPacket(k);
+
+                if (p.op == CFG_OP_READ)
+                  nread++;
+                if (p.op != CFG_OP_WRITE || p.reg >= 32 || p.count == 0)
+                  continue;
+                npkts[p.reg]++;
+                nwords[p.reg] += p.count;
+              }
+            fprintf(stderr, "%d configuration packets, %u reads\n",
+                    npkt, nread);
+            for (k = 0; k < 32; k++)
+              if (npkts[k])
+                fprintf(stderr, "  %-10s %6u writes %10u words\n",
+                        cs.regName(k), npkts[k], nwords[k]);
+            if (bits == 16)
+              {
+                nfar = npkts[1];
+                nfdri = npkts[3];
+                nmfwr = npkts[27];
+              }
+            else
+              {
+                nfar = npkts[CFG_REG_FAR];
+                nfdri = npkts[CFG_REG_FDRI];
+                nmfwr = npkts[CFG_REG_MFWR];
+              }
+            fprintf(stderr, "%u FAR writes, %u FDRI bursts, %d frames of "
+                    "%d words, %s\n", nfar, nfdri, cs.getFrames(fw, frames),
+                    fw, (nmfwr)? "compressed" : "not compressed");
+            if (crc > 0)
+              fprintf(stderr, "CRC ok, %d checks\n", crc);
+            else if (crc < 0)
+              fprintf(stderr, "CRC mismatch\n");
+            ndup = cs.countDupFrames(fw, &nframes);
+            if (nframes)
+              fprintf(stderr, "%u of %u frames repeat an earlier frame\n",
+                      ndup, nframes);
+          }
+      }
     
+    if (basefile)
+      {
+        BitFile base;
+        std::vector<uint32_t> words;
+        int fw = ConfigStream::frameWordsForPart(file.getPartName());
+        int nchanged = -1, res;
+
+        fp = fopen(basefile, "rb");
+        if (!fp)
+          {
+            fprintf(stderr, "Can't open datafile %s: %s\n", basefile,
+                    strerror(errno));
+            return 1;
+          }
+        if (!(fp = unpackFile(fp)))
+          return 1;
+        res = base.readFile(fp, STYLE_BIT);
+        fclose(fp);
+        if (res)
+          return 1;
+        ConfigStream cs(file.getData(), file.getLength()/8, 32);
+        ConfigStream bs(base.getData(), base.getLength()/8, 32);
+        if (cs.parse() >= 0 && bs.parse() >= 0)
+          nchanged = cs.makePartial(bs, fw, words);
+        if (nchanged < 0)
+          return 1;
+        fprintf(stderr, "%d frames differ from %s\n", nchanged, basefile);
+        ConfigStream::wordsToBitFile(words, file);
+      }
+
+    if (llfile)
+      {
+        std::vector<uint32_t> fars, words;
+        int fw = ConfigStream::frameWordsForPart(file.getPartName());
+        unsigned int len = file.getLength()/8;
+        int nknown, nreplaced = -1;
+
+        fp = fopen(llfile, "r");
+        if (!fp)
+          {
+            fprintf(stderr, "Can't open location file %s: %s\n", llfile,
+                    strerror(errno));
+            return 1;
+          }
+        nknown = ConfigStream::readFrameAddresses(fp, fw, fars);
+        fclose(fp);
+        if (nknown <= 0)
+          {
+            fprintf(stderr, "No frame addresses in %s\n", llfile);
+            return 1;
+          }
+        ConfigStream cs(file.getData(), len, 32);
+        if (cs.parse() >= 0)
+          nreplaced = cs.makeCompressed(fars, fw, words);
+        if (nreplaced < 0)
+          return 1;
+        fprintf(stderr, "%d frames written by MFWR, %u of %u bytes left\n",
+                nreplaced, (unsigned int)words.size() * 4, len);
+        ConfigStream::wordsToBitFile(words, file);
+      }
+
     if(outfile) {
       if(outfile[0] == '-')
 	fp = stdout;
@@ -131,6 +295,17 @@ int main(int argc, char**args)
       else
 	  fprintf(stderr," Can't open %s: %s  \n", outfile, strerror(errno));
       }
+    if(manifest) {
+      fp = fopen(manifest,"w");
+      if (fp)
+	{
+	  ProgAlg::writeManifest(fp, file.getData(), file.getLength()/8, 0);
+	  fclose(fp);
+	  fprintf(stderr, "Manifest saved as file: %s\n", manifest);
+	}
+      else
+	  fprintf(stderr," Can't open %s: %s  \n", manifest, strerror(errno));
+      }
     }
     catch(io_exception& e) {
       fprintf(stderr, "IOException: %s", e.getMessage().c_str());
@@ -0,0 +1,266 @@
+/* Replace the block RAM contents of a Xilinx .bit file
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "bitfile.h"
+#include "brammap.h"
+#include "configstream.h"
+#include "hexfile.h"
+#include "io_exception.h"
+#include "unpack.h"
+
+void usage() {
+  fprintf(stderr,
+	  "\nUsage:bitpatch -m bmmfile -l llfile [-a addr] [-O outfile] [-P partial] bitfile image\n"
+	  "   -h\t\tprint this help\n"
+	  "   -m\t\tBRAM placement as for data2mem (.bmm)\n"
+	  "   -l\t\tlogic location file of bitgen -l (.ll)\n"
+	  "   -a\t\tload address of a binary image (default 0)\n"
+	  "   -O\t\twrite the patched bitfile\n"
+	  "   -P\t\twrite only the changed frames as partial bitstream\n"
+	  "   image is an ELF file or a binary image. Load the result into\n"
+	  "   the running device with xc3sprog -P bitfile outfile\n");
+  exit(255);
+}
+
+static uint32_t get_word(const byte *p, int n, bool be)
+{
+  uint32_t v = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    v |= p[i] << (8 * ((be) ? n - 1 - i : i));
+  return v;
+}
+
+/* Loadable segments of a 32 bit ELF file, or the file at addr */
+static int load_image(FILE *fp, uint32_t addr,
+                      std::vector<image_segment> &segs)
+{
+  byte eh[52], ph[32];
+  image_segment seg;
+  unsigned int i, phoff, phentsize, phnum;
+  bool be;
+  int c;
+
+  if (fread(eh, 1, sizeof(eh), fp) < 4 || memcmp(eh, "\177ELF", 4))
+    {
+      rewind(fp);
+      seg.addr = addr;
+      while ((c = fgetc(fp)) != EOF)
+        seg.data.push_back(c);
+      segs.push_back(seg);
+      return 0;
+    }
+  if (eh[4] != 1)
+    {
+      fprintf(stderr, "Only 32 bit ELF files are supported\n");
+      return -1;
+    }
+  be = (eh[5] == 2);
+  phoff = get_word(eh + 28, 4, be);
+  phentsize = get_word(eh + 42, 2, be);
+  phnum = get_word(eh + 44, 2, be);
+  for (i = 0; i < phnum; i++)
+    {
+      unsigned int offset, size;
+
+      if (fseek(fp, phoff + i * phentsize, SEEK_SET) ||
+          fread(ph, 1, sizeof(ph), fp) != sizeof(ph))
+        return -1;
+      /* PT_LOAD with data in the file */
+      if (get_word(ph, 4, be) != 1 || get_word(ph + 16, 4, be) == 0)
+        continue;
+      offset = get_word(ph + 4, 4, be);
+      size = get_word(ph + 16, 4, be);
+      seg.addr = get_word(ph + 12, 4, be);
+      seg.data.resize(size);
+      if (fseek(fp, offset, SEEK_SET) ||
+          fread(&seg.data[0], 1, size, fp) != size)
+        return -1;
+      segs.push_back(seg);
+    }
+  return 0;
+}
+
+static FILE *open_file(const char *name, const char *mode)
+{
+  FILE *fp = fopen(name, mode);
+
+  if (!fp)
+    fprintf(stderr, "Can't open %s: %s\n", name, strerror(errno));
+  return fp;
+}
+
+int main(int argc, char**args)
+{
+  const char *bmmfile = NULL;
+  const char *llfile = NULL;
+  const char *outfile = NULL;
+  const char *partfile = NULL;
+  uint32_t addr = 0;
+  unsigned int i;
+
+  while(true)
+    {
+      switch(getopt(argc, args, "?hm:l:a:O:P:"))
+	{
+	case -1: goto args_done;
+	case 'm':
+	  bmmfile = optarg;
+	  break;
+	case 'l':
+	  llfile = optarg;
+	  break;
+	case 'a':
+	  addr = strtoul(optarg, NULL, 0);
+	  break;
+	case 'O':
+	  outfile = optarg;
+	  break;
+	case 'P':
+	  partfile = optarg;
+	  break;
+	case '?':
+	case 'h':
+	default:
+	  usage();
+	}
+    }
+ args_done:
+  argc -= optind;
+  args += optind;
+  if(argc < 2 || !bmmfile || !llfile)
+    usage();
+  try {
+    BitFile file, orig;
+    BramMap map;
+    std::vector<image_segment> segs;
+    std::vector<cfg_block> blocks;
+    FILE *fp;
+    int fw, crc, res, changed = 0;
+
+    if (!(fp = unpackFile(open_file(args[0], "rb"))))
+      return 1;
+    res = file.readFile(fp, STYLE_BIT);
+    fclose(fp);
+    /* Read again, an unpacked file can't be rewound */
+    if (res == 0 && partfile)
+      {
+        if (!(fp = unpackFile(open_file(args[0], "rb"))))
+          return 1;
+        res = orig.readFile(fp, STYLE_BIT);
+        fclose(fp);
+      }
+    if (res)
+      return 1;
+
+    fw = ConfigStream::frameWordsForPart(file.getPartName());
+    ConfigStream cs(file.getData(), file.getLengthBytes(), 32);
+    if (ConfigStream::wordBitsForPart(file.getPartName()) != 32 || fw == 0 ||
+        cs.parse() < 0 || cs.getFdriBlocks(blocks) <= 0)
+      {
+        fprintf(stderr, "BRAM patching needs an uncompressed Virtex-4 or "
+                "later bitstream, %s is not\n", file.getPartName());
+        return 1;
+      }
+    crc = cs.checkCrc();
+
+    if (!(fp = open_file(bmmfile, "r")))
+      return 1;
+    res = map.loadBmm(fp);
+    fclose(fp);
+    if (res <= 0)
+      return 1;
+    if (!(fp = open_file(llfile, "r")))
+      return 1;
+    res = map.loadLocations(fp);
+    fclose(fp);
+    if (res <= 0)
+      {
+        fprintf(stderr, "No RAM bits of %s in %s\n", bmmfile, llfile);
+        return 1;
+      }
+
+    if (!(fp = open_file(args[1], "rb")))
+      return 1;
+    res = load_image(fp, addr, segs);
+    fclose(fp);
+    if (res)
+      {
+        fprintf(stderr, "Reading %s failed\n", args[1]);
+        return 1;
+      }
+    for (i = 0; i < segs.size(); i++)
+      {
+        if (segs[i].data.size() == 0)
+          continue;
+        res = map.patch(file, blocks, fw, segs[i].addr, &segs[i].data[0],
+                        segs[i].data.size());
+        if (res < 0)
+          return 1;
+        changed += res;
+      }
+    if (crc > 0)
+      cs.updateCrc(file.getData());
+    else if (crc < 0)
+      {
+        /* The old CRC would make the device refuse the patched data */
+        if (cs.resetCrc(file.getData()) < 0 && outfile)
+          {
+            fprintf(stderr, "CRC of %s does not match and can't be "
+                    "removed, not writing %s\n", args[0], outfile);
+            return 1;
+          }
+        fprintf(stderr, "CRC of %s does not match, CRC checks replaced "
+                "by CRC resets\n", args[0]);
+      }
+    fprintf(stderr, "%d BRAM bits changed\n", changed);
+
+    if (outfile)
+      {
+        if (!(fp = open_file(outfile, "wb")))
+          return 1;
+        file.saveAs(STYLE_BIT, file.getPartName(), fp);
+        fclose(fp);
+        fprintf(stderr, "Patched bitstream saved as file: %s\n", outfile);
+      }
+    if (partfile)
+      {
+        ConfigStream bs(orig.getData(), orig.getLengthBytes(), 32);
+        std::vector<uint32_t> words;
+
+        if (bs.parse() < 0 || (res = cs.makePartial(bs, fw, words)) < 0)
+          return 1;
+        fprintf(stderr, "%d frames changed\n", res);
+        ConfigStream::wordsToBitFile(words, orig);
+        if (!(fp = open_file(partfile, "wb")))
+          return 1;
+        orig.saveAs(STYLE_BIT, file.getPartName(), fp);
+        fclose(fp);
+        fprintf(stderr, "Partial bitstream saved as file: %s\n", partfile);
+      }
+  }
+  catch(io_exception& e) {
+    fprintf(stderr, "IOException: %s", e.getMessage().c_str());
+    return  1;
+  }
+  return 0;
+}
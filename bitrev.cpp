@@ -35,3 +35,130 @@ const uint8_t bitRevTable[256] =
     0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef,
     0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
 };
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BITREV_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BITREV_NEON
+#endif
+
+/* Swap bits, bit pairs and nibbles of eight bytes at a time */
+static void bitrev_scalar(uint8_t *dst, const uint8_t *src, size_t len)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= len; i += 8)
+    {
+      uint64_t v;
+
+      memcpy(&v, src + i, 8);
+      v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+      v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+      v = ((v >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((v & 0x0f0f0f0f0f0f0f0fULL) << 4);
+      memcpy(dst + i, &v, 8);
+    }
+  for (; i < len; i++)
+    dst[i] = bitRevTable[src[i]];
+}
+
+#ifdef BITREV_X86
+/* The low nibble looks up the high half of the result and vice versa */
+#define REV_LO 0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, \
+               0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf
+#define REV_HI 0x00, (char)0x80, 0x40, (char)0xc0, 0x20, (char)0xa0, 0x60, \
+               (char)0xe0, 0x10, (char)0x90, 0x50, (char)0xd0, 0x30, \
+               (char)0xb0, 0x70, (char)0xf0
+
+__attribute__((target("ssse3")))
+static void bitrev_ssse3(uint8_t *dst, const uint8_t *src, size_t len)
+{
+  const __m128i lo = _mm_setr_epi8(REV_LO);
+  const __m128i hi = _mm_setr_epi8(REV_HI);
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+      __m128i l = _mm_and_si128(v, mask);
+      __m128i h = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+
+      v = _mm_or_si128(_mm_shuffle_epi8(hi, l), _mm_shuffle_epi8(lo, h));
+      _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+  bitrev_scalar(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void bitrev_avx2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+  const __m256i lo = _mm256_setr_epi8(REV_LO, REV_LO);
+  const __m256i hi = _mm256_setr_epi8(REV_HI, REV_HI);
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+      __m256i l = _mm256_and_si256(v, mask);
+      __m256i h = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+
+      v = _mm256_or_si256(_mm256_shuffle_epi8(hi, l),
+                          _mm256_shuffle_epi8(lo, h));
+      _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+  bitrev_ssse3(dst + i, src + i, len - i);
+}
+#endif
+
+void bitrev_copy(uint8_t *dst, const uint8_t *src, size_t len)
+{
+#if defined(BITREV_X86)
+  static int level = -1;
+
+  if (level < 0)
+    {
+      __builtin_cpu_init();
+      level = (__builtin_cpu_supports("avx2")) ? 2 :
+        (__builtin_cpu_supports("ssse3")) ? 1 : 0;
+    }
+  if (level == 2)
+    bitrev_avx2(dst, src, len);
+  else if (level == 1)
+    bitrev_ssse3(dst, src, len);
+  else
+    bitrev_scalar(dst, src, len);
+#elif defined(BITREV_NEON)
+  size_t i = 0;
+
+#if defined(__aarch64__)
+  for (; i + 16 <= len; i += 16)
+    vst1q_u8(dst + i, vrbitq_u8(vld1q_u8(src + i)));
+#else
+  static const uint8_t rev_lo[16] =
+    { 0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+      0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf };
+  uint8x8x2_t lo, hi;
+
+  lo.val[0] = vld1_u8(rev_lo);
+  lo.val[1] = vld1_u8(rev_lo + 8);
+  hi.val[0] = vshl_n_u8(lo.val[0], 4);
+  hi.val[1] = vshl_n_u8(lo.val[1], 4);
+  for (; i + 8 <= len; i += 8)
+    {
+      uint8x8_t v = vld1_u8(src + i);
+
+      v = vorr_u8(vtbl2_u8(hi, vand_u8(v, vdup_n_u8(0x0f))),
+                  vtbl2_u8(lo, vshr_n_u8(v, 4)));
+      vst1_u8(dst + i, v);
+    }
+#endif
+  bitrev_scalar(dst + i, src + i, len - i);
+#else
+  bitrev_scalar(dst, src, len);
+#endif
+}
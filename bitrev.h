@@ -1,3 +1,7 @@
 #include "stdint.h"
+#include <stddef.h>
 
 extern const uint8_t bitRevTable[256];
+
+/* Reverse the bit order of each of len bytes. dst may be the same as src */
+void bitrev_copy(uint8_t *dst, const uint8_t *src, size_t len);
@@ -0,0 +1,263 @@
+/* Locate the initial contents of block RAMs in a configuration stream
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <string.h>
+
+#include "brammap.h"
+
+/* Check the lanes of an address space and count bit lanes from the LSB */
+static int finish_space(bram_space &sp)
+{
+  unsigned int i, k;
+  int w;
+
+  if (sp.bus_blocks.size() == 0)
+    {
+      fprintf(stderr, "Address space %s has no BUS_BLOCK\n", sp.name.c_str());
+      return -1;
+    }
+  for (i = 0; i < sp.bus_blocks.size(); i++)
+    {
+      std::vector<bram_lane> &bb = sp.bus_blocks[i];
+
+      w = 0;
+      for (k = 0; k < bb.size(); k++)
+        w += (bb[k].msb > bb[k].lsb) ? bb[k].msb - bb[k].lsb + 1 :
+          bb[k].lsb - bb[k].msb + 1;
+      if (w == 0 || w % 8 || (i > 0 && w != (int)sp.width))
+        {
+          fprintf(stderr, "Address space %s: bus width %d not supported\n",
+                  sp.name.c_str(), w);
+          return -1;
+        }
+      sp.width = w;
+      for (k = 0; k < bb.size(); k++)
+        if (bb[k].msb < bb[k].lsb)
+          {
+            int msb = w - 1 - bb[k].msb;
+            bb[k].msb = w - 1 - bb[k].lsb;
+            bb[k].lsb = msb;
+          }
+    }
+  if ((sp.end - sp.start + 1) % (sp.width / 8 * sp.bus_blocks.size()))
+    {
+      fprintf(stderr, "Address space %s does not fill its RAMs evenly\n",
+              sp.name.c_str());
+      return -1;
+    }
+  return 0;
+}
+
+int BramMap::loadBmm(FILE *fp)
+{
+  char line[512], name[256], type[64], loc[64];
+  unsigned int a, b, lineno = 0;
+  int x, y;
+  std::string kind;
+  bram_space *sp = 0;
+  std::vector<bram_lane> *bb = 0;
+
+  while (fgets(line, sizeof(line), fp))
+    {
+      char *p, *q;
+
+      lineno++;
+      if ((p = strstr(line, "//")) != 0)
+        *p = 0;
+      p = line + strspn(line, " \t");
+      if (strncmp(p, "END_BUS_BLOCK", 13) == 0)
+        bb = 0;
+      else if (strncmp(p, "END_ADDRESS_SPACE", 17) == 0)
+        {
+          if (!sp || finish_space(*sp))
+            return -1;
+          sp = 0;
+        }
+      else if (strncmp(p, "ADDRESS_SPACE", 13) == 0)
+        {
+          if (sscanf(p, "ADDRESS_SPACE %255s %63s [%x:%x]",
+                     name, type, &a, &b) != 4 ||
+              strncmp(type, "RAMB", 4) || b < a)
+            {
+              fprintf(stderr, "BMM line %u: address space not supported\n",
+                      lineno);
+              return -1;
+            }
+          spaces.push_back(bram_space());
+          sp = &spaces.back();
+          sp->name = name;
+          sp->start = a;
+          sp->end = b;
+          sp->width = 0;
+          kind = std::string(type, 6);
+        }
+      else if (strncmp(p, "BUS_BLOCK", 9) == 0 && sp)
+        {
+          sp->bus_blocks.push_back(std::vector<bram_lane>());
+          bb = &sp->bus_blocks.back();
+        }
+      else if (bb && sscanf(p, "%255s [%d:%d]", name, &x, &y) == 3)
+        {
+          bram_lane lane;
+
+          q = strstr(p, "PLACED");
+          if (!q)
+            q = strstr(p, "LOC");
+          if (!q || !(q = strchr(q, '=')) ||
+              sscanf(q + 1, " %63[^; \t\r\n]", loc) != 1)
+            {
+              fprintf(stderr, "BMM line %u: %s is not placed\n",
+                      lineno, name);
+              return -1;
+            }
+          lane.block = (strchr(loc, '_')) ? std::string(loc) :
+            kind + "_" + loc;
+          lane.msb = x;
+          lane.lsb = y;
+          bb->push_back(lane);
+          bits[lane.block];
+        }
+    }
+  if (sp)
+    {
+      fprintf(stderr, "BMM file ends inside address space %s\n",
+              sp->name.c_str());
+      return -1;
+    }
+  return spaces.size();
+}
+
+int BramMap::loadLocations(FILE *fp)
+{
+  char line[512], block[64];
+  unsigned int off, n;
+  int count = 0;
+
+  while (fgets(line, sizeof(line), fp))
+    {
+      char *p, *q;
+      std::map< std::string, std::vector<uint32_t> >::iterator it;
+
+      if (sscanf(line, "Bit %u", &off) != 1)
+        continue;
+      p = strstr(line, "Block=");
+      q = strstr(line, "Ram=");
+      if (!p || !q || sscanf(p + 6, "%63s", block) != 1)
+        continue;
+      it = bits.find(block);
+      if (it == bits.end())
+        continue;
+      /* parity bits (PARBIT) are not part of the bus word */
+      q = strchr(q, ':');
+      if (!q || sscanf(q + 1, "BIT%u", &n) != 1)
+        continue;
+      if (n >= it->second.size())
+        it->second.resize(n + 1, 0);
+      it->second[n] = off + 1;
+      count++;
+    }
+  return count;
+}
+
+int BramMap::setBit(BitFile &file, const std::vector<cfg_block> &blocks,
+                    uint32_t offset, int val)
+{
+  unsigned int k;
+
+  for (k = 0; k < blocks.size(); k++)
+    {
+      if (offset < blocks[k].count * 32)
+        {
+          byte *p = file.getData() + blocks[k].data * 4 + offset / 8;
+          byte m = 1 << (offset % 8);   /* bytes are bit reversed */
+
+          if (((*p & m) != 0) == (val != 0))
+            return 0;
+          *p ^= m;
+          return 1;
+        }
+      offset -= blocks[k].count * 32;
+    }
+  return -1;
+}
+
+int BramMap::patch(BitFile &file, const std::vector<cfg_block> &blocks,
+                   unsigned int frame_words, uint32_t addr,
+                   const byte *data, unsigned int len)
+{
+  unsigned int i, k, l;
+  int changed = 0, res;
+
+  for (i = 0; i < len; i++)
+    {
+      uint32_t a = addr + i;
+      const bram_space *sp = 0;
+      unsigned int bytes, depth, word, bus, bsel;
+
+      for (k = 0; k < spaces.size() && !sp; k++)
+        if (a >= spaces[k].start && a <= spaces[k].end)
+          sp = &spaces[k];
+      if (!sp)
+        {
+          fprintf(stderr, "Address 0x%08x is outside the BRAM map\n", a);
+          return -1;
+        }
+      bytes = sp->width / 8;
+      depth = (sp->end - sp->start + 1) / bytes / sp->bus_blocks.size();
+      word = (a - sp->start) / bytes;
+      bsel = (a - sp->start) % bytes;
+      bus = word / depth;
+      word %= depth;
+
+      for (k = 0; k < 8; k++)
+        {
+          const std::vector<bram_lane> &bb = sp->bus_blocks[bus];
+          int wb = sp->width - 8 * (bsel + 1) + k;
+          unsigned int n;
+          uint32_t off;
+
+          for (l = 0; l < bb.size(); l++)
+            if (wb >= bb[l].lsb && wb <= bb[l].msb)
+              break;
+          if (l == bb.size())
+            {
+              fprintf(stderr, "Bit %d of %s is in no bit lane\n",
+                      wb, sp->name.c_str());
+              return -1;
+            }
+          n = word * (bb[l].msb - bb[l].lsb + 1) + wb - bb[l].lsb;
+          const std::vector<uint32_t> &loc = bits[bb[l].block];
+          if (n >= loc.size() || loc[n] == 0)
+            {
+              fprintf(stderr, "%s bit %u is not in the location file\n",
+                      bb[l].block.c_str(), n);
+              return -1;
+            }
+          off = loc[n] - 1;
+          /* readback starts with a pad frame */
+          if (off < frame_words * 32 ||
+              (res = setBit(file, blocks, off - frame_words * 32,
+                            (data[i] >> k) & 1)) < 0)
+            {
+              fprintf(stderr, "%s bit %u lies outside the frame data\n",
+                      bb[l].block.c_str(), n);
+              return -1;
+            }
+          changed += res;
+        }
+    }
+  return changed;
+}
@@ -0,0 +1,83 @@
+/* Locate the initial contents of block RAMs in a configuration stream
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+The memory map comes from a .bmm file as used by data2mem:
+  ADDRESS_SPACE name RAMB36 [0x00000000:0x00003FFF]
+    BUS_BLOCK
+      inst/ram0 [31:16] PLACED = X0Y0;
+      inst/ram1 [15:0]  PLACED = X0Y1;
+    END_BUS_BLOCK;
+  END_ADDRESS_SPACE;
+Words are stored big endian, the byte at the lowest address in the most
+significant bits. Bit lanes written [0:7] count from the MSB.
+
+The position of each RAM bit in the bitstream comes from the logic
+location file of bitgen -l (write_bitstream -logic_location_file):
+  Bit  3261955 0x00400100     67 Block=RAMB36_X0Y0 Ram=B:BIT0
+The offset counts readback data, which starts with one pad frame.
+*/
+
+#ifndef BRAMMAP_H
+#define BRAMMAP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "bitfile.h"
+#include "configstream.h"
+
+struct bram_lane
+{
+  std::string block;   /* RAMB36_X0Y0 */
+  int msb, lsb;        /* bits of the bus word, 0 is the LSB */
+};
+
+struct bram_space
+{
+  std::string name;
+  uint32_t start, end;
+  unsigned int width;  /* bus word in bits */
+  std::vector< std::vector<bram_lane> > bus_blocks;
+};
+
+class BramMap
+{
+ private:
+  std::vector<bram_space> spaces;
+  /* bitstream offset + 1 of each RAM bit, 0 if not listed */
+  std::map< std::string, std::vector<uint32_t> > bits;
+  int setBit(BitFile &file, const std::vector<cfg_block> &blocks,
+             uint32_t offset, int val);
+
+ public:
+  int loadBmm(FILE *fp);
+  /* Needs the .bmm loaded, as only its RAMs are kept */
+  int loadLocations(FILE *fp);
+  unsigned int getNumSpaces(void) const { return spaces.size(); }
+  const bram_space &getSpace(int i) const { return spaces[i]; }
+  /* Write len bytes of data at address addr into the FDRI blocks of
+   * file, whose frames are frame_words long. Returns the number of
+   * changed bits, -1 if an address or RAM bit can't be placed.
+   */
+  int patch(BitFile &file, const std::vector<cfg_block> &blocks,
+            unsigned int frame_words, uint32_t addr,
+            const byte *data, unsigned int len);
+};
+
+#endif /* BRAMMAP_H */
@@ -0,0 +1,186 @@
+/* XC3SPROG BPI bridge for 7-series FPGAs with 16-bit parallel NOR flash
+ *
+ * Op words are shifted in through USER1, LSB first, see
+ * progalgbpiflash.cpp for the protocol. Bus cycles are timed in TCK
+ * periods: a write pulse lasts 8 TCK, a read is sampled 13 TCK after the
+ * address is applied, so TCK must not be faster than about 30 MHz for
+ * 100 ns flashes.
+ *
+ * Read data is stored in a 1k x 16 RAM and shifted out at the start of
+ * the next scan.
+ */
+module top
+  #(parameter AW = 26)
+  (
+   output reg [AW-1:0] FLASH_A,
+   inout  wire [15:0]  FLASH_D,
+   output wire         FLASH_CE_N,
+   output reg          FLASH_OE_N = 1,
+   output reg          FLASH_WE_N = 1,
+   output wire         FLASH_ADV_N,
+   output wire         FLASH_RST_N,
+   output wire         LED
+   );
+
+   localparam S_OP    = 3'd0;
+   localparam S_ALO   = 3'd1;
+   localparam S_AHI   = 3'd2;
+   localparam S_WRITE = 3'd3;
+   localparam S_READ  = 3'd4;
+
+   wire        CAPTURE;
+   wire        UPDATE;
+   wire        DRCK1;
+   wire        TDI;
+   wire        TDO1;
+   wire        SEL1;
+   wire        SHIFT;
+   wire        RESET;
+
+   reg [14:0]  sr;
+   reg [3:0]   bitcnt;
+   reg [2:0]   state;
+   reg [11:0]  count;
+   reg [15:0]  addr_lo;
+   reg [15:0]  dq_out;
+   reg         dq_oe = 0;
+   reg         wr_busy = 0;
+   reg         rd_busy = 0;
+
+   reg [15:0]  rdmem [0:1023];
+   reg [9:0]   RAM_WADDR;
+   reg [13:0]  RAM_RADDR;
+   reg [15:0]  rd_word;
+   reg [3:0]   rd_bit;
+
+   wire [15:0] word = {TDI, sr};
+   wire        rst = CAPTURE || RESET || UPDATE || !SEL1;
+
+   assign FLASH_D = (dq_oe)? dq_out : 16'hzzzz;
+   assign FLASH_CE_N = !(wr_busy || rd_busy);
+   assign FLASH_ADV_N = 1'b0;
+   assign FLASH_RST_N = 1'b1;
+   assign LED = !FLASH_CE_N;
+   assign TDO1 = rd_word[rd_bit];
+
+   BSCANE2 #(.JTAG_CHAIN(1)) BSCANE2_inst
+     (
+      .CAPTURE(CAPTURE),
+      .DRCK(DRCK1),
+      .RESET(RESET),
+      .RUNTEST(),
+      .SEL(SEL1),
+      .SHIFT(SHIFT),
+      .TCK(),
+      .TDI(TDI),
+      .TMS(),
+      .UPDATE(UPDATE),
+      .TDO(TDO1)
+      );
+
+   /* Results of the previous scan */
+   always @(negedge DRCK1)
+     begin
+        rd_word <= rdmem[RAM_RADDR[13:4]];
+        rd_bit <= RAM_RADDR[3:0];
+     end
+
+   always @(posedge DRCK1 or posedge rst)
+     if (rst)
+       begin
+          bitcnt <= 0;
+          state <= S_OP;
+          FLASH_WE_N <= 1;
+          FLASH_OE_N <= 1;
+          dq_oe <= 0;
+          wr_busy <= 0;
+          rd_busy <= 0;
+          RAM_WADDR <= 0;
+          RAM_RADDR <= 0;
+       end
+     else
+       begin
+          RAM_RADDR <= RAM_RADDR + 1;
+          sr <= word[15:1];
+          bitcnt <= bitcnt + 1;
+
+          /* Write cycle, during the word following the data word */
+          if (wr_busy)
+            begin
+               if (bitcnt == 1)
+                 FLASH_WE_N <= 0;
+               if (bitcnt == 9)
+                 FLASH_WE_N <= 1;
+               if (bitcnt == 11)
+                 begin
+                    dq_oe <= 0;
+                    wr_busy <= 0;
+                    FLASH_A <= FLASH_A + 1;
+                 end
+            end
+
+          /* Read cycle, during each dummy word */
+          if (rd_busy)
+            begin
+               if (bitcnt == 13)
+                 begin
+                    rdmem[RAM_WADDR] <= FLASH_D;
+                    RAM_WADDR <= RAM_WADDR + 1;
+                 end
+               if (bitcnt == 14)
+                 FLASH_A <= FLASH_A + 1;
+            end
+
+          if (bitcnt == 15)
+            case (state)
+              S_OP:
+                case (word[15:12])
+                  4'h1: state <= S_ALO;
+                  4'h2:
+                    begin
+                       count <= word[11:0];
+                       state <= S_WRITE;
+                    end
+                  4'h3:
+                    begin
+                       count <= word[11:0];
+                       rd_busy <= 1;
+                       FLASH_OE_N <= 0;
+                       state <= S_READ;
+                    end
+                  default: ;
+                endcase
+              S_ALO:
+                begin
+                   addr_lo <= word;
+                   state <= S_AHI;
+                end
+              S_AHI:
+                begin
+                   FLASH_A <= {word, addr_lo};
+                   state <= S_OP;
+                end
+              S_WRITE:
+                begin
+                   dq_out <= word;
+                   dq_oe <= 1;
+                   wr_busy <= 1;
+                   if (count == 0)
+                     state <= S_OP;
+                   else
+                     count <= count - 1;
+                end
+              S_READ:
+                if (count == 0)
+                  begin
+                     rd_busy <= 0;
+                     FLASH_OE_N <= 1;
+                     state <= S_OP;
+                  end
+                else
+                  count <= count - 1;
+              default:
+                state <= S_OP;
+            endcase
+       end
+endmodule
@@ -3,6 +3,9 @@ module top
    input gnd
    );
    wire   CAPTURE;
+   wire   DRCK2;
+   wire   TDO2;
+   wire   CAPTURE2 = CAPTURE;
    wire   UPDATE;
    wire   DRCK1;
    wire   TDI;
@@ -49,7 +52,7 @@ module top
      (
       .CAPTURE(CAPTURE),
       .DRCK1(DRCK1),
-      .DRCK2(),
+      .DRCK2(DRCK2),
       .RESET(RESET),
       .SEL1(SEL1),
       .SEL2(),
@@ -59,7 +62,7 @@ module top
       .TMS(),
       .UPDATE(UPDATE),
       .TDO1(TDO1),
-      .TDO2(1'b0)
+      .TDO2(TDO2)
       );
    SPI_ACCESS
      #(.SIM_DEVICE("3S50AN")
@@ -72,4 +75,5 @@ module top
 	  .MOSI(MOSI)
 	  );
 `include "bscan_common.v"
+`include "bscan_signature.v"
 endmodule
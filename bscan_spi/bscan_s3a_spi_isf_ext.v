@@ -7,6 +7,9 @@ module top
    );
 
    wire   CAPTURE;
+   wire   DRCK2;
+   wire   TDO2;
+   wire   CAPTURE2 = CAPTURE;
    wire   UPDATE;
    wire   TDI;
    wire   TDO1;
@@ -50,7 +53,7 @@ module top
      (
       .CAPTURE(CAPTURE),
       .DRCK1(DRCK1),
-      .DRCK2(),
+      .DRCK2(DRCK2),
       .RESET(RESET),
       .SEL1(SEL1),
       .SEL2(),
@@ -60,8 +63,9 @@ module top
       .TMS(),
       .UPDATE(UPDATE),
       .TDO1(TDO1),
-      .TDO2(1'b0)
+      .TDO2(TDO2)
       );
 
 `include "bscan_common.v"
+`include "bscan_signature.v"
 endmodule
@@ -12,6 +12,9 @@ module top
    );
 
    wire   CAPTURE;
+   wire   DRCK2;
+   wire   TDO2;
+   wire   CAPTURE2 = CAPTURE;
    wire   UPDATE;
    wire   TDI;
    wire   TDO1;
@@ -61,7 +64,7 @@ module top
      (
       .CAPTURE(CAPTURE),
       .DRCK1(DRCK1),
-      .DRCK2(),
+      .DRCK2(DRCK2),
       .RESET(RESET),
       .SEL1(SEL1),
       .SEL2(),
@@ -69,8 +72,9 @@ module top
       .TDI(TDI),
       .UPDATE(UPDATE),
       .TDO1(TDO1),
-      .TDO2(1'b0)
+      .TDO2(TDO2)
       );
 
 `include "bscan_common.v"
+`include "bscan_signature.v"
 endmodule
@@ -61,5 +61,23 @@ module top
       .TDO(TDO1)
       );
 
+   wire        DRCK2, CAPTURE2, TDO2;
+
+   BSCAN_SPARTAN6 #(.JTAG_CHAIN(2)) BSCAN_SPARTAN6_user2
+     (
+      .CAPTURE(CAPTURE2),
+      .DRCK(DRCK2),
+      .RESET(),
+      .RUNTEST(),
+      .SEL(),
+      .SHIFT(),
+      .TCK(),
+      .TDI(),
+      .TMS(),
+      .UPDATE(),
+      .TDO(TDO2)
+      );
+
 `include "bscan_common.v"
+`include "bscan_signature.v"
 endmodule
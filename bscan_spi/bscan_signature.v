@@ -0,0 +1,12 @@
+/* USER2 signature, read by xc3sprog to find a resident core:
+ * bits 31:16 0x5350 ("SP"), 15:8 protocol version, 7:0 variant
+ * Needs DRCK2, CAPTURE2 and TDO2 of the USER2 BSCAN port.
+ */
+   reg [31:0]  sig_sr;
+
+   assign      TDO2 = sig_sr[0];
+   always @(posedge DRCK2)
+     if (CAPTURE2)
+       sig_sr <= 32'h53500100;
+     else
+       sig_sr <= {1'b0, sig_sr[31:1]};
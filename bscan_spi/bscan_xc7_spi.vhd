@@ -54,6 +54,12 @@ architecture Behavioral of top is
 	signal RAM_DO: std_logic_vector(0 downto 0);
 	signal RAM_DI: std_logic_vector(0 downto 0);
 	signal RAM_WE: std_logic := '0';
+	-- USER2 signature: "SP", protocol version, variant
+	constant SIGNATURE: std_logic_vector(31 downto 0) := x"53500100";
+	signal CAPTURE2: std_logic;
+	signal DRCK2: std_logic;
+	signal TDO2: std_logic;
+	signal SIG_SR: std_logic_vector(31 downto 0);
 begin
 
 	IO2 <= '1';
@@ -106,6 +112,37 @@ begin
       TDO     => TDO1     -- 1-bit input: Test Data Output (TDO) input for USER function.
    );
 
+   BSCANE2_user2 : BSCANE2
+   generic map (
+      JTAG_CHAIN => 2
+   )
+   port map (
+      CAPTURE => CAPTURE2,
+      DRCK    => DRCK2,
+      RESET   => open,
+      RUNTEST => open,
+      SEL     => open,
+      SHIFT   => open,
+      TCK     => open,
+      TDI     => open,
+      TMS     => open,
+      UPDATE  => open,
+      TDO     => TDO2
+   );
+
+	TDO2 <= SIG_SR(0);
+
+	process(DRCK2)
+	begin
+		if rising_edge(DRCK2) then
+			if CAPTURE2 = '1' then
+				SIG_SR <= SIGNATURE;
+			else
+				SIG_SR <= '0' & SIG_SR(31 downto 1);
+			end if;
+		end if;
+	end process;
+
    STARTUPE2_inst : STARTUPE2
    generic map (
       PROG_USR => "FALSE",  -- Activate program event security feature. Requires encrypted bitstreams.
@@ -0,0 +1,304 @@
+--
+-- XC3SPROG ISF File for 7-series boards with two QSPI flashes (SPIx8)
+-- derived from bscan_xc7_spi.vhd
+--
+-- Flash 0 sits on the configuration pins (FCS_B, D00, D01, D02, D03),
+-- flash 1 on the dual purpose pins of the second flash (FCS2_B, D04..D07).
+-- Both share CCLK, driven through STARTUPE2.
+--
+-- Protocol: same header as the single flash core (magic 0x59a659a6 and
+-- 16-bit length in TCK cycles). After the header, two TDI bits make up one
+-- SPI clock, the first for flash 0, the second for flash 1. MISO of both
+-- flashes is returned in the same order in the next scan.
+--
+-- Green user LED will be steady ON
+-- Red user LED will be ON during SPI Chip select activation
+--
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.STD_LOGIC_ARITH.ALL;
+use IEEE.STD_LOGIC_UNSIGNED.ALL;
+
+library UNISIM;
+use UNISIM.VComponents.all;
+
+entity top is port (
+		RLED	 : out std_logic;
+		GLED	 : out std_logic;
+
+		MOSI_ext : out std_logic;  -- D00
+		MISO_ext : in std_logic;   -- D01
+		IO2		 : inout std_logic; -- D02, WP
+		IO3		 : inout std_logic; -- D03, HOLD/RESET
+		CSB_ext	 : out std_logic;   -- FCS_B
+
+		MOSI2_ext : out std_logic; -- D04
+		MISO2_ext : in std_logic;  -- D05
+		IO6		 : inout std_logic; -- D06, WP
+		IO7		 : inout std_logic; -- D07, HOLD/RESET
+		CSB2_ext : out std_logic    -- FCS2_B
+	);
+end top;
+
+architecture Behavioral of top is
+	signal CAPTURE: std_logic;
+	signal UPDATE: std_logic;
+	signal DRCK1: std_logic;
+	signal TDI: std_logic;
+	signal TDO1: std_logic;
+	signal CSB: std_logic := '1';
+	signal header: std_logic_vector(47 downto 0);
+	signal len: std_logic_vector(15 downto 0);
+	signal have_header : std_logic := '0';
+	signal SEL1: std_logic;
+	signal SHIFT: std_logic;
+	signal RESET: std_logic;
+	signal CS_GO: std_logic := '0';
+	signal CS_GO_PREP: std_logic := '0';
+	signal CS_STOP: std_logic := '0';
+	signal CS_STOP_PREP: std_logic := '0';
+	signal CS_STOP_DLY: std_logic := '0';
+	signal PHASE: std_logic := '0';
+	signal PAIR_VALID: std_logic := '0';
+	signal SCK: std_logic := '0';
+	signal MOSI0_LATCH: std_logic := '0';
+	signal MOSI0: std_logic := '0';
+	signal MOSI1: std_logic := '0';
+	signal RAM_RADDR: std_logic_vector(13 downto 0);
+	signal RAM_WADDR: std_logic_vector(13 downto 0);
+	signal DRCK1_INV : std_logic;
+	signal RAM_DO: std_logic_vector(0 downto 0);
+	signal RAM_DI: std_logic_vector(0 downto 0);
+	signal RAM_WE: std_logic := '0';
+	-- USER2 signature: "SP", protocol version, variant
+	constant SIGNATURE: std_logic_vector(31 downto 0) := x"53500101";
+	signal CAPTURE2: std_logic;
+	signal DRCK2: std_logic;
+	signal TDO2: std_logic;
+	signal SIG_SR: std_logic_vector(31 downto 0);
+begin
+
+	IO2 <= '1';
+	IO3 <= '1';
+	IO6 <= '1';
+	IO7 <= '1';
+
+	RLED <= not CSB;
+	GLED <= '1';
+
+	MOSI_ext	<= MOSI0;
+	MOSI2_ext	<= MOSI1;
+	CSB_ext		<= CSB;
+	CSB2_ext	<= CSB;
+
+	DRCK1_INV <= not DRCK1;
+
+   RAMB16_S1_S1_inst : RAMB16_S1_S1
+   port map (
+	   DOA => RAM_DO,      -- Port A 1-bit Data Output
+      DOB => open,      -- Port B 1-bit Data Output
+      ADDRA => RAM_RADDR,  -- Port A 14-bit Address Input
+      ADDRB => RAM_WADDR,  -- Port B 14-bit Address Input
+      CLKA => DRCK1_inv,    -- Port A Clock
+      CLKB => DRCK1,    -- Port B Clock
+      DIA => "0",      -- Port A 1-bit Data Input
+      DIB => RAM_DI,      -- Port B 1-bit Data Input
+      ENA => '1',      -- Port A RAM Enable Input
+      ENB => '1',      -- PortB RAM Enable Input
+      SSRA => '0',    -- Port A Synchronous Set/Reset Input
+      SSRB => '0',    -- Port B Synchronous Set/Reset Input
+      WEA => '0',      -- Port A Write Enable Input
+      WEB => RAM_WE       -- Port B Write Enable Input
+   );
+
+   BSCANE2_inst : BSCANE2
+   generic map (
+      JTAG_CHAIN => 1  -- Value for USER command.
+   )
+   port map (
+      CAPTURE => CAPTURE, -- 1-bit output: CAPTURE output from TAP controller.
+      DRCK    => DRCK1,   -- 1-bit output: Gated TCK output.
+      RESET   => RESET,   -- 1-bit output: Reset output for TAP controller.
+      RUNTEST => open,    -- 1-bit output: Output asserted when TAP controller is in Run Test/Idle state.
+      SEL     => SEL1,    -- 1-bit output: USER instruction active output.
+      SHIFT   => SHIFT,   -- 1-bit output: SHIFT output from TAP controller.
+      TCK     => open,    -- 1-bit output: Test Clock output. Fabric connection to TAP Clock pin.
+      TDI     => TDI,     -- 1-bit output: Test Data Input (TDI) output from TAP controller.
+      TMS     => open,    -- 1-bit output: Test Mode Select output. Fabric connection to TAP.
+      UPDATE  => UPDATE,  -- 1-bit output: UPDATE output from TAP controller
+      TDO     => TDO1     -- 1-bit input: Test Data Output (TDO) input for USER function.
+   );
+
+   BSCANE2_user2 : BSCANE2
+   generic map (
+      JTAG_CHAIN => 2
+   )
+   port map (
+      CAPTURE => CAPTURE2,
+      DRCK    => DRCK2,
+      RESET   => open,
+      RUNTEST => open,
+      SEL     => open,
+      SHIFT   => open,
+      TCK     => open,
+      TDI     => open,
+      TMS     => open,
+      UPDATE  => open,
+      TDO     => TDO2
+   );
+
+	TDO2 <= SIG_SR(0);
+
+	process(DRCK2)
+	begin
+		if rising_edge(DRCK2) then
+			if CAPTURE2 = '1' then
+				SIG_SR <= SIGNATURE;
+			else
+				SIG_SR <= '0' & SIG_SR(31 downto 1);
+			end if;
+		end if;
+	end process;
+
+   STARTUPE2_inst : STARTUPE2
+   generic map (
+      PROG_USR => "FALSE",  -- Activate program event security feature. Requires encrypted bitstreams.
+      SIM_CCLK_FREQ => 0.0  -- Set the Configuration Clock Frequency(ns) for simulation.
+   )
+   port map (
+      CFGCLK => open,         -- 1-bit output: Configuration main clock output
+      CFGMCLK => open,        -- 1-bit output: Configuration internal oscillator clock output
+      EOS => open,            -- 1-bit output: Active high output signal indicating the End Of Startup.
+      PREQ => open,           -- 1-bit output: PROGRAM request to fabric output
+      CLK => '0',             -- 1-bit input: User start-up clock input
+      GSR => '0',             -- 1-bit input: Global Set/Reset input (GSR cannot be used for the port name)
+      GTS => '0',             -- 1-bit input: Global 3-state input (GTS cannot be used for the port name)
+      KEYCLEARB => '0' ,      -- 1-bit input: Clear AES Decrypter Key input from Battery-Backed RAM (BBRAM)
+      PACK => '1',            -- 1-bit input: PROGRAM acknowledge input
+      USRCCLKO => SCK,        -- 1-bit input: User CCLK input, shared by both flashes
+      USRCCLKTS => '0',       -- 1-bit input: User CCLK 3-state enable input
+      USRDONEO => '1',        -- 1-bit input: User DONE pin output control
+      USRDONETS => '1'       -- 1-bit input: User DONE 3-state enable output
+   );
+
+	-- the last SPI clock ends two TCK after the last data bit
+	CSB <= '0' when CS_GO = '1' and CS_STOP_DLY = '0' else '1';
+
+	-- MISO of flash 0 is stored with the rising SCK edge, MISO of flash 1
+	-- one TCK later with the falling SCK edge, so RAM bits 2n and 2n+1
+	-- hold bit n of flash 0 and flash 1
+	RAM_DI <= MISO_ext & "" when PHASE = '0' else MISO2_ext & "";
+	RAM_WE <= '1' when CSB = '0' and ((PHASE = '0' and PAIR_VALID = '1') or
+	                                  (PHASE = '1' and SCK = '1')) else '0';
+
+	TDO1 <= RAM_DO(0);
+
+	-- falling edges
+	process(DRCK1, CAPTURE, RESET, UPDATE, SEL1)
+	begin
+
+		if CAPTURE = '1' or RESET='1' or UPDATE='1' or SEL1='0' then
+
+			have_header <= '0';
+
+			-- disable CSB
+			CS_GO_PREP <= '0';
+			CS_STOP <= '0';
+
+		elsif falling_edge(DRCK1) then
+
+			-- disable CSB?
+			CS_STOP <= CS_STOP_PREP;
+
+			-- waiting for header?
+			if have_header='0' then
+
+				-- got magic + len
+				if header(46 downto 15) = x"59a659a6" then
+					len <= header(14 downto 0) & "0";
+					have_header <= '1';
+
+					-- enable CSB on rising edge (if len > 0?)
+					if (header(14 downto 0) & "0") /= x"0000" then
+						CS_GO_PREP <= '1';
+					end if;
+
+				end if;
+
+			elsif len /= x"0000" then
+				len <= len - 1;
+
+			end if;
+
+		end if;
+
+	end process;
+
+	-- rising edges
+	process(DRCK1, CAPTURE, RESET, UPDATE, SEL1)
+	begin
+
+		if CAPTURE = '1' or RESET='1' or UPDATE='1' or SEL1='0' then
+
+			-- disable CSB
+			CS_GO <= '0';
+			CS_STOP_PREP <= '0';
+			CS_STOP_DLY <= '0';
+			PHASE <= '0';
+			PAIR_VALID <= '0';
+			SCK <= '0';
+
+			RAM_WADDR <= (others => '0');
+			RAM_RADDR <= (others => '0');
+
+		elsif rising_edge(DRCK1) then
+
+			RAM_RADDR <= RAM_RADDR + 1;
+
+			if RAM_WE='1' then
+				RAM_WADDR <= RAM_WADDR + 1;
+			end if;
+
+			header <= header(46 downto 0) & TDI;
+
+			-- enable CSB?
+			CS_GO <= CS_GO_PREP;
+
+			CS_STOP_DLY <= CS_STOP;
+
+			-- two TCK per SPI clock: collect the bit for flash 0, then
+			-- present both bits with SCK low and raise SCK on the next TCK.
+			-- No more pairs are presented once len has run out, so no
+			-- clock is given after the last data bit
+			if CSB = '0' then
+				PHASE <= not PHASE;
+				if PHASE = '0' then
+					MOSI0_LATCH <= TDI;
+					SCK <= PAIR_VALID;
+				else
+					MOSI0 <= MOSI0_LATCH;
+					MOSI1 <= TDI;
+					SCK <= '0';
+					if len /= x"0000" then
+						PAIR_VALID <= '1';
+					else
+						PAIR_VALID <= '0';
+					end if;
+				end if;
+			else
+				PHASE <= '0';
+				PAIR_VALID <= '0';
+				SCK <= '0';
+			end if;
+
+			-- disable CSB on falling edge
+			if CS_GO = '1' and len = x"0000" then
+				CS_STOP_PREP <= '1';
+			end if;
+
+		end if;
+
+	end process;
+
+end Behavioral;
@@ -0,0 +1,529 @@
+/* XC3SPROG ISF core, version 2, for 7-series FPGAs
+ *
+ * USER1: the version 1 protocol (see bscan_common.v), used for
+ *        identification, erase and everything else the host drives itself
+ * USER2: 32 bit signature 0x53500200 ("SP", version 2), LSB first
+ * USER3: command channel. The host shifts in
+ *
+ *          cmd[7:0] flags[7:0] addr[31:0] len[15:0] data...
+ *
+ *        all LSB first. The command starts on UPDATE-DR and runs from the
+ *        internal configuration clock (CFGMCLK), independent of TCK:
+ *
+ *          0x01 PROGRAM  write len bytes of data from the FIFO, the core
+ *                        issues WREN, PP and RDSR for each 256 byte page
+ *          0x02 READ     read len bytes starting at addr into the read
+ *                        buffer, with 0x6B (quad output) if flags[0] is
+ *                        set, else with 0x0B
+ *          0x03 CRC      read len * 256 bytes starting at addr and put the
+ *                        CRC-32 (as zlib) of the flash bytes into the
+ *                        first 4 bytes of the read buffer, LSB first
+ *
+ *        flags[1] selects 4 byte addresses (0x12 for PP, 0x6C/0x0C for
+ *        reads).
+ *
+ *        While shifting, TDO returns a 32 bit status word followed by the
+ *        read buffer:
+ *
+ *          status[31:16] 0x5632
+ *          status[9]     error (timeout waiting for WIP)
+ *          status[8]     busy
+ *          status[7:0]   last flash status register
+ *
+ * Data bytes are shifted in and out in the order they travel on the SPI
+ * bus, like with the version 1 protocol. FIFO and read buffer hold 2 kiB.
+ */
+module top
+  (
+   output wire MOSI_ext,
+   input  wire MISO_ext,
+   inout  wire IO2,
+   inout  wire IO3,
+   output wire CSB_ext,
+   output wire RLED,
+   output wire GLED
+   );
+
+   wire   CAPTURE;
+   wire   UPDATE;
+   wire   TDI;
+   wire   TDO1;
+   reg [47:0] header;
+   reg [15:0]  len;
+   reg 	       have_header = 0;
+   wire        MOSI;
+   wire        MISO;
+   wire        CSB;
+   assign      MOSI = TDI ;
+   wire        SEL1;
+   wire        SHIFT;
+   wire        RESET;
+   wire        DRCK1;
+   reg 	       CS_GO = 0;
+   reg 	       CS_GO_PREP = 0;
+   reg 	       CS_STOP = 0;
+   reg 	       CS_STOP_PREP = 0;
+   reg [13:0] RAM_RADDR;
+   reg [13:0] RAM_WADDR;
+   wire        DRCK1_INV = !DRCK1;
+   wire        RAM_DO;
+   wire        RAM_DI;
+   reg 	       RAM_WE = 0;
+
+   RAMB16_S1_S1 RAMB16_S1_S1_inst
+     (
+      .DOA(RAM_DO),
+      .DOB(),
+      .ADDRA(RAM_RADDR),
+      .ADDRB(RAM_WADDR),
+      .CLKA(DRCK1_INV),
+      .CLKB(DRCK1),
+      .DIA(1'b0),
+      .DIB(RAM_DI),
+      .ENA(1'b1),
+      .ENB(1'b1),
+      .SSRA(1'b0),
+      .SSRB(1'b0),
+      .WEA(1'b0),
+      .WEB(RAM_WE)
+      );
+
+   BSCANE2 #(.JTAG_CHAIN(1)) BSCANE2_user1
+     (
+      .CAPTURE(CAPTURE),
+      .DRCK(DRCK1),
+      .RESET(RESET),
+      .RUNTEST(),
+      .SEL(SEL1),
+      .SHIFT(SHIFT),
+      .TCK(),
+      .TDI(TDI),
+      .TMS(),
+      .UPDATE(UPDATE),
+      .TDO(TDO1)
+      );
+
+`include "bscan_common.v"
+
+   /* USER2: signature */
+   localparam SIGNATURE = 32'h53500200;
+   wire        CAPTURE2, SHIFT2, SEL2, TCK2, TDO2;
+   reg [31:0]  sig_sr;
+
+   BSCANE2 #(.JTAG_CHAIN(2)) BSCANE2_user2
+     (
+      .CAPTURE(CAPTURE2),
+      .DRCK(),
+      .RESET(),
+      .RUNTEST(),
+      .SEL(SEL2),
+      .SHIFT(SHIFT2),
+      .TCK(TCK2),
+      .TDI(),
+      .TMS(),
+      .UPDATE(),
+      .TDO(TDO2)
+      );
+
+   assign TDO2 = sig_sr[0];
+   always @(posedge TCK2)
+     if (SEL2 && CAPTURE2)
+       sig_sr <= SIGNATURE;
+     else if (SEL2 && SHIFT2)
+       sig_sr <= {1'b0, sig_sr[31:1]};
+
+   /* USER3: command channel, TCK domain */
+   wire        CAPTURE3, SHIFT3, SEL3, TCK3, TDI3, UPDATE3, RESET3;
+   reg         TDO3;
+   reg [63:0]  cmd_sr;
+   reg [6:0]   hdr_cnt;
+   reg [14:0]  fifo_waddr;
+   reg [31:0]  status_sr;
+   reg [16:0]  out_cnt;
+   reg         req_toggle = 0;
+   reg [7:0]   cmd_cmd;
+   reg [7:0]   cmd_flags;
+   reg [31:0]  cmd_addr;
+   reg [15:0]  cmd_len;
+
+   BSCANE2 #(.JTAG_CHAIN(3)) BSCANE2_user3
+     (
+      .CAPTURE(CAPTURE3),
+      .DRCK(),
+      .RESET(RESET3),
+      .RUNTEST(),
+      .SEL(SEL3),
+      .SHIFT(SHIFT3),
+      .TCK(TCK3),
+      .TDI(TDI3),
+      .TMS(),
+      .UPDATE(UPDATE3),
+      .TDO(TDO3)
+      );
+
+   /* 2 kiB write FIFO, written from TCK, read from CFGMCLK */
+   reg         fifo [0:16383];
+   /* 2 kiB read buffer, written a nibble at a time from CFGMCLK */
+   reg [3:0]   rdbuf [0:4095];
+
+   /* synchronized from the sequencer */
+   reg [9:0]   seq_status_s1, seq_status_s2;
+   wire [9:0]  seq_status;
+
+   always @(posedge TCK3)
+     begin
+        seq_status_s1 <= seq_status;
+        seq_status_s2 <= seq_status_s1;
+        if (SEL3 && CAPTURE3)
+          begin
+             hdr_cnt <= 0;
+             fifo_waddr <= 0;
+             out_cnt <= 0;
+             status_sr <= {16'h5632, 6'b0, seq_status_s2};
+          end
+        else if (SEL3 && SHIFT3)
+          begin
+             if (hdr_cnt != 64)
+               begin
+                  cmd_sr <= {TDI3, cmd_sr[63:1]};
+                  hdr_cnt <= hdr_cnt + 1;
+               end
+             else if (fifo_waddr != 16384)
+               begin
+                  fifo[fifo_waddr[13:0]] <= TDI3;
+                  fifo_waddr <= fifo_waddr + 1;
+               end
+             status_sr <= {1'b0, status_sr[31:1]};
+             out_cnt <= out_cnt + 1;
+          end
+        else if (SEL3 && UPDATE3 && hdr_cnt == 64 && cmd_sr[7:0] != 0 &&
+                 !seq_status_s2[8])
+          begin
+             cmd_cmd <= cmd_sr[7:0];
+             cmd_flags <= cmd_sr[15:8];
+             cmd_addr <= cmd_sr[47:16];
+             cmd_len <= cmd_sr[63:48];
+             req_toggle <= !req_toggle;
+             hdr_cnt <= 0;
+          end
+     end
+
+   /* TDO: status word, then the read buffer in bus order */
+   wire [16:0] out_bit = out_cnt - 32;
+   wire [3:0]  rd_nibble = rdbuf[out_bit[13:2]];
+   always @(negedge TCK3)
+     TDO3 <= (out_cnt < 32)? status_sr[0] : rd_nibble[~out_bit[1:0]];
+
+   /* Sequencer, CFGMCLK domain */
+   wire        CFGMCLK;
+   reg [2:0]   req_sync = 0;
+   wire        req = req_sync[2] ^ req_sync[1];
+
+   localparam Q_IDLE   = 4'd0;
+   localparam Q_WREN   = 4'd1;
+   localparam Q_PP     = 4'd2;
+   localparam Q_PPDATA = 4'd3;
+   localparam Q_RDSR   = 4'd4;
+   localparam Q_READ   = 4'd5;
+   localparam Q_RDDATA = 4'd6;
+   localparam Q_GAP    = 4'd7;
+   localparam Q_CRCOUT = 4'd8;
+
+   reg [3:0]   q_state = Q_IDLE;
+   reg [3:0]   q_next;
+   reg         busy = 0;
+   reg         error = 0;
+   reg [7:0]   last_sr = 0;
+   reg         seq_csb = 1;
+   reg         seq_sck = 0;
+   reg         seq_mosi = 0;
+   reg [47:0]  sh_out;
+   reg [5:0]   sh_cnt;
+   reg [7:0]   sh_in;
+   reg [31:0]  q_addr;
+   reg [23:0]  q_left;
+   reg [8:0]   page_left;
+   reg [13:0]  fifo_raddr;
+   reg         fifo_bit;
+   reg         pp_mosi;
+   reg [13:0]  rd_waddr;
+   reg [1:0]   rd_nib_cnt;
+   reg [3:0]   rd_acc;
+   reg [23:0]  timeout;
+   reg [3:0]   dummy;
+   reg         quad;
+   reg         addr4;
+   reg         do_crc;
+   reg [31:0]  crc;
+   reg [3:0]   hi_nib;
+
+   /* CRC-32, reflected: the flash byte enters LSB first */
+   function [31:0] crc32_byte(input [31:0] c, input [7:0] b);
+      integer i;
+      begin
+         crc32_byte = c;
+         for (i = 0; i < 8; i = i + 1)
+           crc32_byte = {1'b0, crc32_byte[31:1]} ^
+                        ((crc32_byte[0] ^ b[i])? 32'hEDB88320 : 32'h0);
+      end
+   endfunction
+
+   wire [7:0]  rd_byte = (quad)? {hi_nib, rd_acc} : sh_in;
+   wire [31:0] crc_next = crc32_byte(crc, rd_byte);
+
+   assign seq_status = {error, busy, last_sr};
+
+   always @(posedge CFGMCLK)
+     fifo_bit <= fifo[fifo_raddr];
+
+   always @(posedge CFGMCLK)
+     begin
+        req_sync <= {req_sync[1:0], req_toggle};
+        if (q_state == Q_IDLE)
+          begin
+             seq_csb <= 1;
+             seq_sck <= 0;
+             if (req)
+               begin
+                  busy <= 1;
+                  error <= 0;
+                  quad <= cmd_flags[0];
+                  addr4 <= cmd_flags[1];
+                  q_addr <= cmd_addr;
+                  q_left <= (cmd_cmd == 8'h03)? {cmd_len, 8'h0} :
+                            {8'h0, cmd_len};
+                  fifo_raddr <= 0;
+                  rd_waddr <= 0;
+                  rd_nib_cnt <= 0;
+                  do_crc <= (cmd_cmd == 8'h03);
+                  crc <= 32'hffffffff;
+                  q_state <= (cmd_cmd == 8'h01)? Q_WREN :
+                             (cmd_cmd == 8'h02 || cmd_cmd == 8'h03)? Q_READ :
+                             Q_IDLE;
+               end
+             else
+               busy <= 0;
+          end
+        else if (q_state == Q_GAP)
+          begin
+             /* deselect for one clock between commands */
+             seq_csb <= 1;
+             seq_sck <= 0;
+             q_state <= q_next;
+          end
+        else if (q_state == Q_CRCOUT)
+          begin
+             /* store ~crc in TDO order, 8 nibbles */
+             seq_csb <= 1;
+             seq_sck <= 0;
+             rdbuf[rd_waddr[11:0]] <= {crc[0], crc[1], crc[2], crc[3]};
+             crc <= {4'h0, crc[31:4]};
+             rd_waddr <= rd_waddr + 1;
+             if (rd_waddr == 7)
+               q_state <= Q_IDLE;
+          end
+        else if (seq_csb)
+          begin
+             /* start of a command: load the shifter */
+             seq_csb <= 0;
+             case (q_state)
+               Q_WREN:
+                 begin
+                    sh_out <= {8'h06, 40'h0};
+                    sh_cnt <= 8;
+                 end
+               Q_PP:
+                 begin
+                    if (addr4)
+                      begin
+                         sh_out <= {8'h12, q_addr};
+                         sh_cnt <= 40;
+                      end
+                    else
+                      begin
+                         sh_out <= {8'h02, q_addr[23:0], 8'h0};
+                         sh_cnt <= 32;
+                      end
+                    page_left <= 9'd256 - q_addr[7:0];
+                 end
+               Q_RDSR:
+                 begin
+                    sh_out <= {8'h05, 40'h0};
+                    sh_cnt <= 16;
+                 end
+               Q_READ:
+                 begin
+                    if (addr4)
+                      begin
+                         sh_out <= {(quad)? 8'h6C : 8'h0C, q_addr};
+                         sh_cnt <= 40;
+                      end
+                    else
+                      begin
+                         sh_out <= {(quad)? 8'h6B : 8'h0B, q_addr[23:0], 8'h0};
+                         sh_cnt <= 32;
+                      end
+                    dummy <= 8;
+                 end
+               default: ;
+             endcase
+          end
+        else if (!seq_sck)
+          begin
+             /* rising SCK: the flash samples MOSI, we sample MISO */
+             seq_sck <= 1;
+             if (q_state == Q_RDDATA && quad)
+               rd_acc <= {IO3, IO2, MISO_ext, MOSI_ext};
+             else
+               sh_in <= {sh_in[6:0], MISO_ext};
+          end
+        else
+          begin
+             /* falling SCK: next bit */
+             seq_sck <= 0;
+             case (q_state)
+               Q_WREN:
+                 begin
+                    sh_out <= {sh_out[46:0], 1'b0};
+                    sh_cnt <= sh_cnt - 1;
+                    if (sh_cnt == 1)
+                      begin
+                         q_state <= Q_GAP;
+                         q_next <= Q_PP;
+                      end
+                 end
+               Q_PP:
+                 begin
+                    sh_out <= {sh_out[46:0], 1'b0};
+                    sh_cnt <= sh_cnt - 1;
+                    if (sh_cnt == 1)
+                      begin
+                         /* first data bit */
+                         q_state <= Q_PPDATA;
+                         pp_mosi <= fifo_bit;
+                         fifo_raddr <= fifo_raddr + 1;
+                      end
+                 end
+               Q_PPDATA:
+                 begin
+                    /* fifo_bit holds the bit at fifo_raddr by now */
+                    if (fifo_raddr[2:0] == 3'd0 &&
+                        (q_left == 1 || page_left == 1))
+                      begin
+                         /* page or data complete */
+                         q_addr <= q_addr + 1;
+                         q_left <= q_left - 1;
+                         timeout <= 0;
+                         q_state <= Q_GAP;
+                         q_next <= Q_RDSR;
+                      end
+                    else
+                      begin
+                         if (fifo_raddr[2:0] == 3'd0)
+                           begin
+                              q_addr <= q_addr + 1;
+                              q_left <= q_left - 1;
+                              page_left <= page_left - 1;
+                           end
+                         pp_mosi <= fifo_bit;
+                         fifo_raddr <= fifo_raddr + 1;
+                      end
+                 end
+               Q_RDSR:
+                 begin
+                    sh_out <= {sh_out[46:0], 1'b0};
+                    sh_cnt <= sh_cnt - 1;
+                    timeout <= timeout + 1;
+                    if (sh_cnt == 1)
+                      begin
+                         last_sr <= sh_in;
+                         q_state <= Q_GAP;
+                         if (sh_in[0])
+                           q_next <= Q_RDSR;    /* WIP still set */
+                         else
+                           q_next <= (q_left == 0)? Q_IDLE : Q_WREN;
+                         if (&timeout)
+                           begin
+                              error <= 1;
+                              q_next <= Q_IDLE;
+                           end
+                      end
+                 end
+               Q_READ:
+                 begin
+                    sh_out <= {sh_out[46:0], 1'b0};
+                    if (sh_cnt != 0)
+                      sh_cnt <= sh_cnt - 1;
+                    else if (dummy != 1)
+                      dummy <= dummy - 1;
+                    else
+                      q_state <= Q_RDDATA;
+                 end
+               Q_RDDATA:
+                 begin
+                    if (!quad)
+                      rd_acc <= {rd_acc[2:0], sh_in[0]};
+                    if (quad || rd_nib_cnt == 3)
+                      begin
+                         if (!do_crc)
+                           rdbuf[rd_waddr[11:0]] <=
+                             (quad)? rd_acc : {rd_acc[2:0], sh_in[0]};
+                         rd_waddr <= rd_waddr + 1;
+                         if (!rd_waddr[0])
+                           hi_nib <= rd_acc;
+                         else
+                           begin
+                              if (do_crc)
+                                crc <= crc_next;
+                              q_left <= q_left - 1;
+                              if (q_left == 1 && do_crc)
+                                begin
+                                   crc <= ~crc_next;
+                                   rd_waddr <= 0;
+                                   q_state <= Q_CRCOUT;
+                                end
+                              else if (q_left == 1)
+                                q_state <= Q_IDLE;
+                           end
+                      end
+                    rd_nib_cnt <= rd_nib_cnt + 1;
+                 end
+               default: ;
+             endcase
+          end
+     end
+
+   /* MOSI: shifter for commands, FIFO for page data */
+   always @(*)
+     seq_mosi = (q_state == Q_PPDATA)? pp_mosi : sh_out[47];
+
+   wire        seq_active = (q_state != Q_IDLE);
+   wire        cclk = (seq_active)? seq_sck : DRCK1;
+
+   /* IO0 turns around for quad reads */
+   assign MOSI_ext = (seq_active && q_state == Q_RDDATA && quad)? 1'bz :
+                     (seq_active)? seq_mosi : MOSI;
+   assign IO2 = (seq_active && q_state == Q_RDDATA && quad)? 1'bz : 1'b1;
+   assign IO3 = (seq_active && q_state == Q_RDDATA && quad)? 1'bz : 1'b1;
+   assign CSB_ext = (seq_active)? seq_csb : CSB;
+   assign MISO = MISO_ext;
+   assign RLED = !CSB_ext;
+   assign GLED = 1'b1;
+
+   STARTUPE2 #(.PROG_USR("FALSE"), .SIM_CCLK_FREQ(0.0)) STARTUPE2_inst
+     (
+      .CFGCLK(),
+      .CFGMCLK(CFGMCLK),
+      .EOS(),
+      .PREQ(),
+      .CLK(1'b0),
+      .GSR(1'b0),
+      .GTS(1'b0),
+      .KEYCLEARB(1'b0),
+      .PACK(1'b1),
+      .USRCCLKO(cclk),
+      .USRCCLKTS(1'b0),
+      .USRDONEO(1'b1),
+      .USRDONETS(1'b1)
+      );
+endmodule
@@ -21,6 +21,9 @@ module xc3s250e_godil
    );
 
    wire   CAPTURE;
+   wire   DRCK2;
+   wire   TDO2;
+   wire   CAPTURE2 = CAPTURE;
    wire   UPDATE;
    wire   TDI;
    wire   TDO1;
@@ -70,7 +73,7 @@ module xc3s250e_godil
      (
       .CAPTURE(CAPTURE),
       .DRCK1(DRCK1),
-      .DRCK2(),
+      .DRCK2(DRCK2),
       .RESET(RESET),
       .SEL1(SEL1),
       .SEL2(),
@@ -78,8 +81,9 @@ module xc3s250e_godil
       .TDI(TDI),
       .UPDATE(UPDATE),
       .TDO1(TDO1),
-      .TDO2(1'b0)
+      .TDO2(TDO2)
       );
 
 `include "bscan_common.v"
+`include "bscan_signature.v"
 endmodule
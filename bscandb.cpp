@@ -0,0 +1,45 @@
+/* bscan_spi cores built into xc3sprog
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bscandb.h"
+#include "bscans.h"
+#include "unpack.h"
+
+int bscan_find(uint32_t idcode, const struct bscan_t **list, int max)
+{
+  int i, n = 0;
+
+  for (i = 0; bscan_list[i].bitfile && n < max; i++)
+    if (bscan_list[i].idcode == (idcode & 0x0fffffff))
+      list[n++] = &bscan_list[i];
+  return n;
+}
+
+int bscan_load(const struct bscan_t *core, BitFile &file)
+{
+  std::vector<unsigned char> data;
+
+  if (unpackMem(core->data, core->len, data) || data.size() == 0)
+    {
+      fprintf(stderr, "Can't unpack built in core %s\n", core->bitfile);
+      return 1;
+    }
+  return file.readBitMem(&data[0], data.size());
+}
@@ -0,0 +1,40 @@
+/* bscan_spi cores built into xc3sprog
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef BSCANDB_H
+#define BSCANDB_H
+
+#include <stdint.h>
+#include "bitfile.h"
+
+/* One gzip compressed bitfile from bscan_spi/bscanlist.txt */
+struct bscan_t
+{
+  uint32_t idcode;        /* without revision */
+  const char *package;    /* "any" if no package pins are used */
+  const char *bitfile;
+  const unsigned char *data;
+  unsigned int len;
+};
+
+/* Store up to max cores for idcode in list, return the number found */
+int bscan_find(uint32_t idcode, const struct bscan_t **list, int max);
+
+/* Uncompress the core into file, 0 on success */
+int bscan_load(const struct bscan_t *core, BitFile &file);
+
+#endif /* BSCANDB_H */
@@ -0,0 +1,870 @@
+/* Walk the packets of a Xilinx configuration stream
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "configstream.h"
+#include "bitrev.h"
+
+static const char *reg_names32[32] =
+  {
+    "CRC", "FAR", "FDRI", "FDRO", "CMD", "CTL0", "MASK", "STAT",
+    "LOUT", "COR0", "MFWR", "CBC", "IDCODE", "AXSS", "COR1", "0x0f",
+    "WBSTAR", "TIMER", "0x12", "0x13", "0x14", "0x15", "BOOTSTS", "0x17",
+    "CTL1", "0x19", "0x1a", "0x1b", "0x1c", "0x1d", "0x1e", "BSPI"
+  };
+
+static const char *reg_names16[32] =
+  {
+    "CRC", "FAR_MAJ", "FAR_MIN", "FDRI", "FDRO", "CMD", "CTL", "MASK",
+    "STAT", "LOUT", "COR1", "COR2", "PWRDN_REG", "FLR", "IDCODE", "CWDT",
+    "HC_OPT_REG", "0x11", "CSBO", "GENERAL1", "GENERAL2", "GENERAL3",
+    "GENERAL4", "GENERAL5", "MODE_REG", "PU_GWE", "PU_GTS", "MFWR",
+    "CCLK_FREQ", "SEU_OPT", "EXP_SIGN", "RDBK_SIGN"
+  };
+
+ConfigStream::ConfigStream(const byte *d, unsigned int len, int bits)
+  : data(d), wordbits(bits), sync(0)
+{
+  nwords = len / (wordbits / 8);
+}
+
+uint32_t ConfigStream::getWord(unsigned int i) const
+{
+  const byte *p = data + i * (wordbits / 8);
+
+  if (wordbits == 16)
+    return (bitRevTable[p[0]] << 8) | bitRevTable[p[1]];
+  return ((uint32_t)bitRevTable[p[0]] << 24) | (bitRevTable[p[1]] << 16) |
+    (bitRevTable[p[2]] << 8) | bitRevTable[p[3]];
+}
+
+int ConfigStream::parse(void)
+{
+  unsigned int i;
+  int last_reg = -1;
+  cfg_packet pkt;
+
+  packets.clear();
+  /* Sync is 0xaa995566, one word or two for Spartan-6 */
+  for (i = 0; i < nwords; i++)
+    {
+      if (wordbits == 32 && getWord(i) == 0xaa995566)
+        break;
+      if (wordbits == 16 && i + 1 < nwords && getWord(i) == 0xaa99 &&
+          getWord(i + 1) == 0x5566)
+        {
+          i++;
+          break;
+        }
+    }
+  if (i >= nwords)
+    {
+      fprintf(stderr, "No sync word in configuration stream\n");
+      return -1;
+    }
+  sync = ++i;
+
+  while (i < nwords)
+    {
+      uint32_t hdr = getWord(i);
+
+      pkt.pos = i;
+      pkt.type = hdr >> (wordbits - 3);
+      pkt.op = (hdr >> (wordbits - 5)) & 3;
+      if (pkt.type == 1)
+        {
+          if (wordbits == 16)
+            {
+              pkt.reg = (hdr >> 5) & 0x3f;
+              pkt.count = hdr & 0x1f;
+            }
+          else
+            {
+              pkt.reg = (hdr >> 13) & 0x3fff;
+              pkt.count = hdr & 0x7ff;
+            }
+          last_reg = pkt.reg;
+          i++;
+        }
+      else if (pkt.type == 2)
+        {
+          if (last_reg < 0)
+            {
+              fprintf(stderr, "Type 2 packet without type 1 at word %u\n", i);
+              return -1;
+            }
+          pkt.reg = last_reg;
+          if (wordbits == 16)
+            {
+              if (i + 2 >= nwords)
+                break;
+              pkt.reg = (hdr >> 5) & 0x3f;
+              pkt.count = (getWord(i + 1) << 16) | getWord(i + 2);
+              i += 3;
+            }
+          else
+            {
+              pkt.count = hdr & 0x07ffffff;
+              i++;
+            }
+        }
+      else
+        {
+          /* trailing padding after DESYNC */
+          if (hdr == ((wordbits == 16)? 0xffffu : 0xffffffffu))
+            break;
+          fprintf(stderr, "Unknown packet 0x%0*x at word %u\n",
+                  wordbits / 4, hdr, i);
+          return -1;
+        }
+      pkt.data = i;
+      if (pkt.op == CFG_OP_WRITE)
+        {
+          if (pkt.data + pkt.count > nwords)
+            {
+              fprintf(stderr, "Packet at word %u exceeds the stream\n",
+                      pkt.pos);
+              return -1;
+            }
+          i += pkt.count;
+        }
+      packets.push_back(pkt);
+    }
+  return packets.size();
+}
+
+const char *ConfigStream::regName(int reg) const
+{
+  if (reg < 0 || reg >= 32)
+    return "?";
+  return (wordbits == 16)? reg_names16[reg] : reg_names32[reg];
+}
+
+/* CRC-32C steps for 5 input bits and, sliced by byte, for 32 bits */
+static uint32_t crc32cTable[4][256];
+static uint32_t crc32cTable5[32];
+static bool crc32cTableValid = false;
+
+static void crc32c_init(void)
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++)
+    {
+      c = i;
+      for (k = 0; k < 8; k++)
+        {
+          c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+          if (k == 4 && i < 32)
+            crc32cTable5[i] = c;
+        }
+      crc32cTable[0][i] = c;
+    }
+  for (i = 0; i < 256; i++)
+    for (k = 1; k < 4; k++)
+      crc32cTable[k][i] = (crc32cTable[k - 1][i] >> 8) ^
+        crc32cTable[0][crc32cTable[k - 1][i] & 0xff];
+  crc32cTableValid = true;
+}
+
+/* The 32 data bits go in LSB first, a byte at a time, followed by the
+ * 5 bits of the register address
+ */
+uint32_t ConfigStream::icapCrc(uint32_t crc, int reg, uint32_t word)
+{
+  if (!crc32cTableValid)
+    crc32c_init();
+  crc ^= word;
+  crc = crc32cTable[3][crc & 0xff] ^ crc32cTable[2][(crc >> 8) & 0xff] ^
+    crc32cTable[1][(crc >> 16) & 0xff] ^ crc32cTable[0][crc >> 24];
+  crc ^= reg & 0x1f;
+  return crc32cTable5[crc & 0x1f] ^ (crc >> 5);
+}
+
+int ConfigStream::checkCrc(void) const
+{
+  uint32_t crc = 0;
+  unsigned int k, j;
+  int nchecks = 0;
+
+  if (wordbits != 32)
+    return 0;
+  for (k = 0; k < packets.size(); k++)
+    {
+      const cfg_packet &p = packets[k];
+
+      if (p.op != CFG_OP_WRITE)
+        continue;
+      for (j = 0; j < p.count; j++)
+        {
+          uint32_t w = getWord(p.data + j);
+
+          if (p.reg == CFG_REG_CRC)
+            {
+              if (w != crc)
+                return -1;
+              nchecks++;
+              crc = 0;
+            }
+          else
+            {
+              crc = icapCrc(crc, p.reg, w);
+              if (p.reg == CFG_REG_CMD && w == CFG_CMD_RCRC)
+                crc = 0;
+            }
+        }
+    }
+  return nchecks;
+}
+
+static void put_word(byte *q, uint32_t w)
+{
+  q[0] = bitRevTable[0xff & (w >> 24)];
+  q[1] = bitRevTable[0xff & (w >> 16)];
+  q[2] = bitRevTable[0xff & (w >>  8)];
+  q[3] = bitRevTable[0xff & (w >>  0)];
+}
+
+int ConfigStream::updateCrc(byte *dest) const
+{
+  uint32_t crc = 0;
+  unsigned int k, j;
+  int nchecks = 0;
+
+  if (wordbits != 32)
+    return 0;
+  for (k = 0; k < packets.size(); k++)
+    {
+      const cfg_packet &p = packets[k];
+
+      if (p.op != CFG_OP_WRITE)
+        continue;
+      for (j = 0; j < p.count; j++)
+        {
+          if (p.reg == CFG_REG_CRC)
+            {
+              put_word(dest + (p.data + j) * 4, crc);
+              nchecks++;
+              crc = 0;
+            }
+          else
+            {
+              uint32_t w = getWord(p.data + j);
+
+              crc = icapCrc(crc, p.reg, w);
+              if (p.reg == CFG_REG_CMD && w == CFG_CMD_RCRC)
+                crc = 0;
+            }
+        }
+    }
+  return nchecks;
+}
+
+int ConfigStream::resetCrc(byte *dest) const
+{
+  unsigned int k;
+  int n = 0;
+
+  if (wordbits != 32)
+    return 0;
+  for (k = 0; k < packets.size(); k++)
+    {
+      const cfg_packet &p = packets[k];
+
+      if (p.op != CFG_OP_WRITE || p.reg != CFG_REG_CRC || p.count == 0)
+        continue;
+      if (p.type != 1 || p.count != 1)
+        return -1;
+      put_word(dest + p.pos * 4, 0x30000001 | (CFG_REG_CMD << 13));
+      put_word(dest + p.data * 4, CFG_CMD_RCRC);
+      n++;
+    }
+  return n;
+}
+
+/* Cheap hash to find candidates for equal frames, which memcmp confirms */
+static uint32_t frame_hash(const byte *f, unsigned int len)
+{
+  uint32_t h = 0;
+  unsigned int i;
+
+  for (i = 0; i + 4 <= len; i += 4)
+    h = (h ^ ((uint32_t)f[i] | (f[i + 1] << 8) | (f[i + 2] << 16) |
+              ((uint32_t)f[i + 3] << 24))) * 0x9e3779b1;
+  for (; i < len; i++)
+    h = (h ^ f[i]) * 0x9e3779b1;
+  return h ^ (h >> 16);
+}
+
+unsigned int ConfigStream::countDupFrames(unsigned int frame_words,
+                                          unsigned int *nframes) const
+{
+  std::vector< std::pair<uint32_t, const byte *> > frames;
+  unsigned int fbytes = frame_words * (wordbits / 8);
+  unsigned int k, j, l, ndistinct = 0;
+
+  *nframes = 0;
+  if (fbytes == 0)
+    return 0;
+  for (k = 0; k < packets.size(); k++)
+    {
+      const cfg_packet &p = packets[k];
+
+      if (p.op != CFG_OP_WRITE || p.reg != ((wordbits == 16)? 3 : CFG_REG_FDRI))
+        continue;
+      for (j = 0; j + frame_words <= p.count; j += frame_words)
+        {
+          const byte *f = data + (p.data + j) * (wordbits / 8);
+          frames.push_back(std::make_pair(frame_hash(f, fbytes), f));
+        }
+    }
+  *nframes = frames.size();
+
+  /* Frames with equal hash are neighbours after sorting, count the
+   * distinct contents among each run
+   */
+  std::sort(frames.begin(), frames.end());
+  for (k = 0; k < frames.size(); k = j)
+    {
+      for (j = k + 1; j < frames.size() && frames[j].first == frames[k].first;)
+        j++;
+      for (l = k; l < j; l++)
+        {
+          unsigned int m;
+
+          for (m = k; m < l; m++)
+            if (memcmp(frames[m].second, frames[l].second, fbytes) == 0)
+              break;
+          if (m == l)
+            ndistinct++;
+        }
+    }
+  return *nframes - ndistinct;
+}
+
+int ConfigStream::getFdriBlocks(std::vector<cfg_block> &blocks) const
+{
+  uint32_t far = 0;
+  unsigned int k;
+  cfg_block b;
+
+  blocks.clear();
+  if (wordbits != 32)
+    return -1;
+  for (k = 0; k < packets.size(); k++)
+    {
+      const cfg_packet &p = packets[k];
+
+      if (p.op != CFG_OP_WRITE || p.count == 0)
+        continue;
+      if (p.reg == CFG_REG_FAR)
+        far = getWord(p.data);
+      else if (p.reg == CFG_REG_MFWR)
+        return -1;
+      else if (p.reg == CFG_REG_FDRI)
+        {
+          b.far = far;
+          b.data = p.data;
+          b.count = p.count;
+          blocks.push_back(b);
+        }
+    }
+  return blocks.size();
+}
+
+int ConfigStream::getFrames(unsigned int frame_words,
+                            std::vector<cfg_frame> &frames) const
+{
+  uint32_t far = 0;
+  unsigned int k, j;
+  cfg_frame f;
+
+  frames.clear();
+  if (frame_words == 0)
+    return 0;
+  for (k = 0; k < packets.size(); k++)
+    {
+      const cfg_packet &p = packets[k];
+
+      if (p.op != CFG_OP_WRITE || p.count == 0)
+        continue;
+      if (wordbits == 16)
+        {
+          /* FAR_MAJ and FAR_MIN, usually written together */
+          if (p.reg == 1)
+            {
+              far = getWord(p.data) << 16;
+              if (p.count > 1)
+                far |= getWord(p.data + 1);
+            }
+          else if (p.reg == 2)
+            far = (far & 0xffff0000) | getWord(p.data);
+          else if (p.reg != 3)
+            continue;
+        }
+      else if (p.reg == CFG_REG_FAR)
+        far = getWord(p.data);
+      if (p.reg != ((wordbits == 16)? 3 : CFG_REG_FDRI))
+        continue;
+      f.far = far;
+      for (j = 0; j + frame_words <= p.count; j += frame_words)
+        {
+          f.index = j / frame_words;
+          f.data = p.data + j;
+          frames.push_back(f);
+        }
+    }
+  return frames.size();
+}
+
+/* Append a type 1 write, or type 1 + type 2 for long ones, keeping the CRC */
+static void put_write(std::vector<uint32_t> &out, uint32_t *crc, int reg,
+                      const uint32_t *words, unsigned int n)
+{
+  unsigned int i;
+
+  if (n < 0x800)
+    out.push_back(0x30000000 | (reg << 13) | n);
+  else
+    {
+      out.push_back(0x30000000 | (reg << 13));
+      out.push_back(0x50000000 | n);
+    }
+  for (i = 0; i < n; i++)
+    {
+      out.push_back(words[i]);
+      *crc = ConfigStream::icapCrc(*crc, reg, words[i]);
+      if (reg == CFG_REG_CMD && words[i] == CFG_CMD_RCRC)
+        *crc = 0;
+    }
+}
+
+int ConfigStream::makePartial(const ConfigStream &base,
+                              unsigned int frame_words,
+                              std::vector<uint32_t> &out) const
+{
+  std::vector<cfg_block> bb, nb;
+  std::vector<uint32_t> frames;
+  uint32_t crc = 0, w, idcode = 0;
+  unsigned int k, i, j, nframes, last, nchanged = 0;
+  bool have_idcode = false;
+
+  if (frame_words == 0 || getFdriBlocks(nb) < 0 || base.getFdriBlocks(bb) < 0)
+    {
+      fprintf(stderr, "Partial streams only for Virtex-5 and later "
+              "without compression\n");
+      return -1;
+    }
+  if (nb.size() != bb.size())
+    {
+      fprintf(stderr, "Bitstreams differ in frame layout\n");
+      return -1;
+    }
+  for (k = 0; k < packets.size(); k++)
+    if (packets[k].op == CFG_OP_WRITE && packets[k].reg == CFG_REG_IDCODE &&
+        packets[k].count == 1)
+      {
+        idcode = getWord(packets[k].data);
+        have_idcode = true;
+      }
+
+  out.clear();
+  out.push_back(0xffffffff);
+  out.push_back(0xaa995566);
+  out.push_back(0x20000000);
+  w = CFG_CMD_RCRC;
+  put_write(out, &crc, CFG_REG_CMD, &w, 1);
+  out.push_back(0x20000000);
+  out.push_back(0x20000000);
+  if (have_idcode)
+    put_write(out, &crc, CFG_REG_IDCODE, &idcode, 1);
+
+  for (k = 0; k < nb.size(); k++)
+    {
+      if (nb[k].far != bb[k].far || nb[k].count != bb[k].count)
+        {
+          fprintf(stderr, "Bitstreams differ in frame layout\n");
+          return -1;
+        }
+      nframes = nb[k].count / frame_words;
+      last = nframes;
+      for (i = 0; i < nframes; i++)
+        for (j = 0; j < frame_words; j++)
+          if (getWord(nb[k].data + i * frame_words + j) !=
+              base.getWord(bb[k].data + i * frame_words + j))
+            {
+              last = i;
+              nchanged++;
+              break;
+            }
+      if (last == nframes)
+        continue;
+
+      /* frames 0 .. last, then one pad frame to push the last one out of
+         the frame buffer */
+      frames.assign((last + 2) * frame_words, 0);
+      for (i = 0; i < (last + 1) * frame_words; i++)
+        frames[i] = getWord(nb[k].data + i);
+      put_write(out, &crc, CFG_REG_FAR, &nb[k].far, 1);
+      w = CFG_CMD_WCFG;
+      put_write(out, &crc, CFG_REG_CMD, &w, 1);
+      out.push_back(0x20000000);
+      put_write(out, &crc, CFG_REG_FDRI, &frames[0], frames.size());
+    }
+
+  /* Only write a CRC if our calculation matches the one of the input */
+  if (checkCrc() > 0)
+    {
+      out.push_back(0x30000001);
+      out.push_back(crc);
+    }
+  else
+    {
+      w = CFG_CMD_RCRC;
+      put_write(out, &crc, CFG_REG_CMD, &w, 1);
+    }
+  out.push_back(0x20000000);
+  out.push_back(0x20000000);
+  w = CFG_CMD_DESYNC;
+  put_write(out, &crc, CFG_REG_CMD, &w, 1);
+  for (i = 0; i < 16; i++)
+    out.push_back(0x20000000);
+  return nchanged;
+}
+
+/* Frames are moved out of the FDRI writes if their content occurs at
+ * least twice elsewhere, as the frame is written once more to load it.
+ * A run of moved frames must end before a frame with a known address,
+ * where the FDRI write after it starts, and must be longer than the pad
+ * frame that the write before it needs.
+ */
+int ConfigStream::makeCompressed(const std::vector<uint32_t> &fars,
+                                 unsigned int frame_words,
+                                 std::vector<uint32_t> &out) const
+{
+  static const uint32_t mfwr_data[2] = {0, 0};
+  std::vector<cfg_block> blocks;
+  std::vector< std::pair<uint32_t, unsigned int> > hashes;
+  std::vector< std::pair<unsigned int, unsigned int> > copies;
+  std::vector<uint32_t> far, frame;
+  std::vector<unsigned int> fdata, blk, first, nmoved;
+  std::vector<bool> moved;
+  unsigned int fbytes = frame_words * 4;
+  unsigned int k, i, j, l, m, p, nf, end, n = 0, nframes = 0, last = 0;
+  uint32_t crc = 0, w;
+  bool changed, crc_ok;
+  int nreplaced = 0;
+
+  if (frame_words == 0 || getFdriBlocks(blocks) <= 0)
+    {
+      fprintf(stderr, "Compression needs an uncompressed Virtex-4 or "
+              "later bitstream\n");
+      return -1;
+    }
+  for (k = 0; k < blocks.size(); k++)
+    {
+      if (blocks[k].count % frame_words)
+        {
+          fprintf(stderr, "FDRI write of %u words is not made of frames\n",
+                  blocks[k].count);
+          return -1;
+        }
+      for (i = 0; i < blocks[k].count / frame_words; i++, nframes++)
+        {
+          w = (nframes < fars.size()) ? fars[nframes] : CFG_FAR_UNKNOWN;
+          if (i == 0)
+            {
+              if (w != CFG_FAR_UNKNOWN && w != blocks[k].far)
+                {
+                  fprintf(stderr, "Frame addresses don't match the "
+                          "bitstream, frame %u is at 0x%08x, not 0x%08x\n",
+                          nframes, blocks[k].far, w);
+                  return -1;
+                }
+              w = blocks[k].far;
+            }
+          far.push_back(w);
+          fdata.push_back(blocks[k].data + i * frame_words);
+          blk.push_back(k);
+        }
+    }
+
+  /* Between two known frames of a column the minor address (bits 6:0)
+     counts up by one */
+  for (i = 1, p = 0; i < nframes; i++)
+    {
+      if (far[i] == CFG_FAR_UNKNOWN)
+        continue;
+      if (blk[i] == blk[p] && i > p + 1 && far[i] - far[p] == i - p &&
+          (far[i] >> 7) == (far[p] >> 7))
+        for (j = p + 1; j < i; j++)
+          far[j] = far[p] + j - p;
+      p = i;
+    }
+
+  /* first[i] is the earliest frame with the content of frame i */
+  for (i = 0; i < nframes; i++)
+    hashes.push_back(std::make_pair(frame_hash(data + fdata[i] * 4, fbytes),
+                                    i));
+  std::sort(hashes.begin(), hashes.end());
+  first.resize(nframes);
+  for (k = 0; k < nframes; k = j)
+    {
+      for (j = k + 1; j < nframes && hashes[j].first == hashes[k].first;)
+        j++;
+      for (l = k; l < j; l++)
+        {
+          unsigned int f = hashes[l].second;
+
+          for (m = k; m < l; m++)
+            if (first[hashes[m].second] == hashes[m].second &&
+                memcmp(data + fdata[hashes[m].second] * 4,
+                       data + fdata[f] * 4, fbytes) == 0)
+              break;
+          first[f] = hashes[m].second;
+        }
+    }
+
+  moved.resize(nframes);
+  for (i = 0; i < nframes; i++)
+    moved[i] = (first[i] != i && far[i] != CFG_FAR_UNKNOWN);
+  do
+    {
+      changed = false;
+      nmoved.assign(nframes, 0);
+      for (i = 0; i < nframes; i++)
+        if (moved[i])
+          nmoved[first[i]]++;
+      for (i = 0; i < nframes; i++)
+        if (moved[i] && nmoved[first[i]] < 2)
+          {
+            moved[i] = false;
+            changed = true;
+          }
+      for (i = 0; i < nframes; i = j)
+        {
+          for (j = i; j < nframes && moved[j] && blk[j] == blk[i]; j++)
+            ;
+          if (j == i)
+            {
+              j++;
+              continue;
+            }
+          if (j - i < 2 || j == nframes || blk[j] != blk[i] ||
+              far[j] == CFG_FAR_UNKNOWN)
+            {
+              for (l = i; l < j; l++)
+                moved[l] = false;
+              changed = true;
+            }
+        }
+    }
+  while (changed);
+  for (i = 0; i < nframes; i++)
+    if (moved[i])
+      copies.push_back(std::make_pair(first[i], i));
+  std::sort(copies.begin(), copies.end());
+
+  /* Only write a CRC if our calculation matches the one of the input */
+  crc_ok = (checkCrc() >= 0);
+  for (k = 0; k < packets.size(); k++)
+    if (packets[k].op == CFG_OP_WRITE && packets[k].reg == CFG_REG_FDRI &&
+        packets[k].count)
+      last = k;
+
+  out.clear();
+  for (i = 0; i < sync; i++)
+    out.push_back(getWord(i));
+  for (k = 0; k < packets.size(); k++)
+    {
+      const cfg_packet &pk = packets[k];
+
+      if (pk.op == CFG_OP_WRITE && pk.reg == CFG_REG_FDRI)
+        {
+          /* a type 2 packet with the data follows */
+          if (pk.count == 0)
+            continue;
+          nf = pk.count / frame_words;
+          for (i = 0; i < nf; i = j)
+            {
+              if (moved[n + i])
+                {
+                  j = i + 1;
+                  continue;
+                }
+              for (j = i; j < nf && !moved[n + j]; j++)
+                ;
+              /* a pad frame pushes the last one out of the frame buffer,
+                 at the end of the block it is already there */
+              frame.assign((j - i + ((j < nf) ? 1 : 0)) * frame_words, 0);
+              for (l = 0; l < (j - i) * frame_words; l++)
+                frame[l] = getWord(fdata[n + i] + l);
+              if (i > 0)
+                {
+                  put_write(out, &crc, CFG_REG_FAR, &far[n + i], 1);
+                  w = CFG_CMD_WCFG;
+                  put_write(out, &crc, CFG_REG_CMD, &w, 1);
+                  out.push_back(0x20000000);
+                }
+              put_write(out, &crc, CFG_REG_FDRI, &frame[0], frame.size());
+            }
+          n += nf;
+          if (k != last)
+            continue;
+
+          /* Load each repeated frame into the frame buffer, then copy it
+             to every address of its copies */
+          for (i = 0; i < copies.size(); i = j)
+            {
+              frame.resize(frame_words);
+              for (l = 0; l < frame_words; l++)
+                frame[l] = getWord(fdata[copies[i].first] + l);
+              put_write(out, &crc, CFG_REG_FAR, &far[copies[i].second], 1);
+              w = CFG_CMD_WCFG;
+              put_write(out, &crc, CFG_REG_CMD, &w, 1);
+              out.push_back(0x20000000);
+              put_write(out, &crc, CFG_REG_FDRI, &frame[0], frame_words);
+              for (j = i; j < copies.size() &&
+                     copies[j].first == copies[i].first; j++)
+                {
+                  put_write(out, &crc, CFG_REG_FAR, &far[copies[j].second], 1);
+                  put_write(out, &crc, CFG_REG_MFWR, mfwr_data, 2);
+                  nreplaced++;
+                }
+            }
+          continue;
+        }
+      if (pk.op == CFG_OP_WRITE && pk.reg == CFG_REG_CRC && !crc_ok)
+        {
+          w = CFG_CMD_RCRC;
+          put_write(out, &crc, CFG_REG_CMD, &w, 1);
+          continue;
+        }
+
+      for (i = pk.pos; i < pk.data; i++)
+        out.push_back(getWord(i));
+      if (pk.op != CFG_OP_WRITE)
+        continue;
+      for (j = 0; j < pk.count; j++)
+        {
+          w = getWord(pk.data + j);
+          if (pk.reg == CFG_REG_CRC)
+            {
+              out.push_back(crc);
+              crc = 0;
+              continue;
+            }
+          out.push_back(w);
+          crc = icapCrc(crc, pk.reg, w);
+          if (pk.reg == CFG_REG_CMD && w == CFG_CMD_RCRC)
+            crc = 0;
+        }
+    }
+  /* the padding after DESYNC */
+  end = sync;
+  if (packets.size())
+    end = packets.back().data +
+      ((packets.back().op == CFG_OP_WRITE) ? packets.back().count : 0);
+  for (i = end; i < nwords; i++)
+    out.push_back(getWord(i));
+  return nreplaced;
+}
+
+int ConfigStream::readFrameAddresses(FILE *fp, unsigned int frame_words,
+                                     std::vector<uint32_t> &fars)
+{
+  char line[512];
+  unsigned int off, n;
+  uint32_t far;
+  int count = 0;
+
+  fars.clear();
+  if (frame_words == 0)
+    return -1;
+  while (fgets(line, sizeof(line), fp))
+    {
+      if (sscanf(line, "Bit %u %x", &off, &far) != 2)
+        continue;
+      n = off / (frame_words * 32);
+      /* the pad frame in front of the readback data */
+      if (n == 0)
+        continue;
+      n--;
+      if (n >= fars.size())
+        fars.resize(n + 1, CFG_FAR_UNKNOWN);
+      if (fars[n] == CFG_FAR_UNKNOWN)
+        {
+          fars[n] = far;
+          count++;
+        }
+      else if (fars[n] != far)
+        {
+          fprintf(stderr, "Frame %u is listed at 0x%08x and 0x%08x\n",
+                  n, fars[n], far);
+          return -1;
+        }
+    }
+  return count;
+}
+
+void ConfigStream::wordsToBitFile(const std::vector<uint32_t> &words,
+                                  BitFile &file)
+{
+  unsigned int i;
+  byte *p;
+
+  file.setLength(words.size() * 32);
+  p = file.getData();
+  for (i = 0; i < words.size(); i++, p += 4)
+    {
+      p[0] = bitRevTable[0xff & (words[i] >> 24)];
+      p[1] = bitRevTable[0xff & (words[i] >> 16)];
+      p[2] = bitRevTable[0xff & (words[i] >>  8)];
+      p[3] = bitRevTable[0xff & (words[i] >>  0)];
+    }
+}
+
+int ConfigStream::wordBitsForPart(const char *part)
+{
+  if (!part)
+    return 0;
+  if (strncmp(part, "6s", 2) == 0)
+    return 16;
+  if (strncmp(part, "xc", 2) == 0)
+    return wordBitsForPart(part + 2);
+  return 32;
+}
+
+int ConfigStream::frameWordsForPart(const char *part)
+{
+  if (!part)
+    return 0;
+  if (strncmp(part, "xc", 2) == 0)
+    part += 2;
+  if (part[0] == '7')
+    return 101;
+  if (strncmp(part, "6v", 2) == 0)
+    return 81;
+  if (strncmp(part, "6s", 2) == 0)
+    return 65;
+  if (strncmp(part, "5v", 2) == 0 || strncmp(part, "4v", 2) == 0)
+    return 41;
+  return 0;
+}
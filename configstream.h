@@ -0,0 +1,184 @@
+/* Walk the packets of a Xilinx configuration stream
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+Packet format of the 32 bit families (Spartan-3, Virtex-4 and later):
+  Type 1: [31:29] 001, [28:27] opcode, [26:13] register, [10:0] words
+  Type 2: [31:29] 010, [28:27] opcode, [26:0] words, register of the
+          preceding type 1 packet
+Spartan-6 uses 16 bit words:
+  Type 1: [15:13] 001, [12:11] opcode, [10:5] register, [4:0] words
+  Type 2: same as type 1 with 0 words, followed by a 32 bit word count
+*/
+
+#ifndef CONFIGSTREAM_H
+#define CONFIGSTREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "bitfile.h"
+
+/* 32 bit family register addresses (7 series numbering) */
+#define CFG_REG_CRC      0x00
+#define CFG_REG_FAR      0x01
+#define CFG_REG_FDRI     0x02
+#define CFG_REG_FDRO     0x03
+#define CFG_REG_CMD      0x04
+#define CFG_REG_CTL0     0x05
+#define CFG_REG_MASK     0x06
+#define CFG_REG_STAT     0x07
+#define CFG_REG_LOUT     0x08
+#define CFG_REG_COR0     0x09
+#define CFG_REG_MFWR     0x0a
+#define CFG_REG_CBC      0x0b
+#define CFG_REG_IDCODE   0x0c
+#define CFG_REG_AXSS     0x0d
+#define CFG_REG_COR1     0x0e
+#define CFG_REG_WBSTAR   0x10
+#define CFG_REG_TIMER    0x11
+#define CFG_REG_BOOTSTS  0x16
+#define CFG_REG_CTL1     0x18
+
+#define CFG_CMD_WCFG     0x01
+#define CFG_CMD_RCRC     0x07
+#define CFG_CMD_DESYNC   0x0d
+
+#define CFG_FAR_UNKNOWN  0xffffffff
+
+#define CFG_OP_NOP       0
+#define CFG_OP_READ      1
+#define CFG_OP_WRITE     2
+
+struct cfg_packet
+{
+  unsigned int pos;    /* word index of the header */
+  int type;            /* 1 or 2 */
+  int op;
+  int reg;
+  unsigned int count;  /* data words */
+  unsigned int data;   /* word index of the first data word */
+};
+
+/* A run of frames written through FDRI, starting at frame address far */
+struct cfg_block
+{
+  uint32_t far;
+  unsigned int data;   /* word index of the first frame word */
+  unsigned int count;  /* words */
+};
+
+/* One frame of an FDRI write */
+struct cfg_frame
+{
+  uint32_t far;        /* FAR of the write, frame addresses within it
+                          depend on the device geometry */
+  unsigned int index;  /* frame within the write */
+  unsigned int data;   /* word index of the first frame word */
+};
+
+class ConfigStream
+{
+ private:
+  const byte *data;    /* BitFile order, i.e. bit reversed */
+  unsigned int nwords;
+  int wordbits;
+  unsigned int sync;   /* word index after the sync word */
+  std::vector<cfg_packet> packets;
+
+ public:
+  /* data and len as in BitFile, wordbits 32 or 16 (Spartan-6) */
+  ConfigStream(const byte *data, unsigned int len, int wordbits);
+  /* Split the stream after the sync word into packets.
+   * Returns the number of packets, -1 if the stream is malformed.
+   */
+  int parse(void);
+  uint32_t getWord(unsigned int i) const;
+  unsigned int getNumWords(void) const { return nwords; }
+  int getWordBits(void) const { return wordbits; }
+  int getNumPackets(void) const { return packets.size(); }
+  const cfg_packet &getPacket(int i) const { return packets[i]; }
+  const char *regName(int reg) const;
+  /* Recalculate the CRC of the stream and compare it against every CRC
+   * register write. Returns the number of matching checks, -1 on a
+   * mismatch and 0 if there is nothing to check (16 bit streams).
+   */
+  int checkCrc(void) const;
+  /* Store the recalculated CRC in every CRC register write of dest, the
+   * stream data after words in it were changed. Returns the number of
+   * CRC words written, 0 for 16 bit streams.
+   */
+  int updateCrc(byte *dest) const;
+  /* Replace every CRC register write in dest by a CMD RCRC of the same
+   * size, for a stream whose CRC we can't calculate. Returns the number
+   * of writes replaced, -1 if one is longer than a word.
+   */
+  int resetCrc(byte *dest) const;
+  /* Frames of frame_words in FDRI writes whose data already occurred in
+   * an earlier frame of the stream
+   */
+  unsigned int countDupFrames(unsigned int frame_words,
+                              unsigned int *nframes) const;
+  /* The FDRI writes of a 32 bit stream. -1 if frames are also written in
+   * other ways (MFWR), so the blocks don't describe the whole design.
+   */
+  int getFdriBlocks(std::vector<cfg_block> &blocks) const;
+  /* Index of all frames written through FDRI, for 16 bit streams too.
+   * Returns the number of frames.
+   */
+  int getFrames(unsigned int frame_words,
+                std::vector<cfg_frame> &frames) const;
+  /* Build a stream that writes only the frames that differ from base,
+   * to be loaded into a device configured with base. Each FDRI block
+   * is rewritten from its start up to the last changed frame, as the
+   * frame address of other frames depends on the device geometry.
+   * Returns the number of changed frames, -1 on error.
+   */
+  int makePartial(const ConfigStream &base, unsigned int frame_words,
+                  std::vector<uint32_t> &out) const;
+  /* Rebuild the stream with repeated frames written through MFWR: the
+   * frame goes into the frame buffer once and is copied to each of its
+   * frame addresses. fars holds the frame address of each FDRI frame in
+   * stream order, CFG_FAR_UNKNOWN where it is not known. Only frames
+   * with a known address are replaced. Returns the number of replaced
+   * frames, -1 on error.
+   */
+  int makeCompressed(const std::vector<uint32_t> &fars,
+                     unsigned int frame_words,
+                     std::vector<uint32_t> &out) const;
+  /* Frame addresses from the logic location file of bitgen -l, indexed
+   * by FDRI frame as for makeCompressed. Readback data, which the bit
+   * offsets count, starts with one pad frame. Returns the number of
+   * frames with an address, -1 if the file contradicts itself.
+   */
+  static int readFrameAddresses(FILE *fp, unsigned int frame_words,
+                                std::vector<uint32_t> &fars);
+  /* Store words as the data of file */
+  static void wordsToBitFile(const std::vector<uint32_t> &words,
+                             BitFile &file);
+
+  /* CRC-32C over a 5 bit register address and 32 bit data word, as the
+   * configuration logic of Virtex-5 and later calculates it
+   */
+  static uint32_t icapCrc(uint32_t crc, int reg, uint32_t word);
+  /* Word size and frame length in words for the part name of a .bit
+   * file, 0 if unknown
+   */
+  static int wordBitsForPart(const char *part);
+  static int frameWordsForPart(const char *part);
+};
+
+#endif /* CONFIGSTREAM_H */
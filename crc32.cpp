@@ -0,0 +1,53 @@
+/* CRC-32 as used by zlib, gzip and Ethernet (reflected, polynomial 0x04c11db7)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include "crc32.h"
+#include "bitrev.h"
+
+static uint32_t crc32Table[256];
+static bool crc32TableValid = false;
+
+static void crc32_init(void)
+{
+  for (uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+        c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+      crc32Table[i] = c;
+    }
+  crc32TableValid = true;
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+  if (!crc32TableValid)
+    crc32_init();
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++)
+    crc = crc32Table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t crc32_update_rev(uint32_t crc, const uint8_t *data, size_t len)
+{
+  if (!crc32TableValid)
+    crc32_init();
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++)
+    crc = crc32Table[(crc ^ bitRevTable[data[i]]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
@@ -0,0 +1,31 @@
+/* CRC-32 as used by zlib, gzip and Ethernet (reflected, polynomial 0x04c11db7)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Start with crc = 0, feed the result of the previous call to continue */
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len);
+
+/* Same, but for data kept in JTAG (bit reversed) order like in BitFile.
+ * The CRC is calculated over the bytes as seen by the device.
+ */
+uint32_t crc32_update_rev(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif /* CRC32_H */
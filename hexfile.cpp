@@ -0,0 +1,600 @@
+/* Decode Intel HEX (MCS), Motorola S-record and raw hex text files
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef __WIN32__
+#include <sys/mman.h>
+#endif
+#include <algorithm>
+
+#include "hexfile.h"
+
+#define MAX_THREADS 16
+#define MIN_CHUNK   (1 << 20)
+
+enum { HEX_OK, HEX_SYNTAX, HEX_TYPE, HEX_CHECKSUM, HEX_NOEND, HEX_RANGE };
+
+/* A decoded record, the address field as found in the file. The
+ * payload of Intel address records is kept in addr.
+ */
+struct hex_rec
+{
+  uint32_t addr;
+  uint32_t data;   /* offset of the payload in hex_chunk.bytes */
+  uint16_t len;
+  uint8_t type;
+};
+
+struct hex_chunk
+{
+  const char *start, *end;
+  HEX_FORMAT fmt;
+  std::vector<hex_rec> recs;
+  std::vector<byte> bytes;
+  unsigned int lines;   /* lines before the one with the error */
+  int error;
+};
+
+/* Data bytes at their final address */
+struct hex_piece
+{
+  uint32_t addr;
+  uint32_t len;
+  const byte *data;
+  bool operator<(const hex_piece &o) const { return addr < o.addr; }
+};
+
+/* Nibble value, 0x100 for anything that is not a hex digit */
+static uint16_t hexval[256];
+
+static void init_hexval(void)
+{
+  int i;
+
+  if (hexval['0'] == 0x000 && hexval['x'] == 0x100)
+    return;
+  for (i = 0; i < 256; i++)
+    hexval[i] = 0x100;
+  for (i = 0; i < 10; i++)
+    hexval['0' + i] = i;
+  for (i = 0; i < 6; i++)
+    hexval['a' + i] = hexval['A' + i] = 10 + i;
+}
+
+/* Decode n bytes from 2n hex digits, returns false on a bad digit */
+static bool get_bytes(const char *p, byte *v, unsigned int n)
+{
+  unsigned int i, bad = 0;
+
+  for (i = 0; i < n; i++, p += 2)
+    {
+      unsigned int x = (hexval[(byte)p[0]] << 4) | hexval[(byte)p[1]];
+
+      bad |= x;
+      v[i] = x;
+    }
+  return bad < 0x100;
+}
+
+static int decode_intel(hex_chunk *c, const char *p, unsigned int n)
+{
+  byte h[4], sum;
+  hex_rec r;
+  unsigned int i;
+
+  if (n < 11 || p[0] != ':' || !get_bytes(p + 1, h, 4) ||
+      n != 11 + 2u * h[0])
+    return HEX_SYNTAX;
+  if (h[3] > 5)
+    return HEX_TYPE;
+  r.addr = (h[1] << 8) | h[2];
+  r.len = h[0];
+  r.type = h[3];
+  r.data = c->bytes.size();
+  c->bytes.resize(r.data + r.len + 1);
+  byte *d = &c->bytes[r.data];
+  if (!get_bytes(p + 9, d, r.len + 1))
+    return HEX_SYNTAX;
+  sum = h[0] + h[1] + h[2] + h[3];
+  for (i = 0; i <= r.len; i++)
+    sum += d[i];
+  if (sum)
+    return HEX_CHECKSUM;
+  if (r.type == 2 || r.type == 4)
+    {
+      if (r.len < 2)
+        return HEX_SYNTAX;
+      /* keep the data contiguous for data records across the change */
+      r.addr = (d[0] << 8) | d[1];
+      r.len = 0;
+    }
+  c->bytes.resize(r.data + r.len);
+  c->recs.push_back(r);
+  return HEX_OK;
+}
+
+static int decode_srec(hex_chunk *c, const char *p, unsigned int n)
+{
+  static const byte alen[10] = { 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+  byte count, sum;
+  hex_rec r;
+  unsigned int i, a;
+
+  if (n < 4 || p[0] != 'S' || p[1] < '0' || p[1] > '9' ||
+      !get_bytes(p + 2, &count, 1) || n != 4 + 2u * count)
+    return HEX_SYNTAX;
+  r.type = p[1] - '0';
+  a = alen[r.type];
+  if (a == 0)
+    return HEX_TYPE;
+  if (count < a + 1)
+    return HEX_SYNTAX;
+  r.data = c->bytes.size();
+  c->bytes.resize(r.data + count);
+  byte *d = &c->bytes[r.data];
+  if (!get_bytes(p + 4, d, count))
+    return HEX_SYNTAX;
+  sum = count;
+  for (i = 0; i < count; i++)
+    sum += d[i];
+  if (sum != 0xff)
+    return HEX_CHECKSUM;
+  r.addr = 0;
+  for (i = 0; i < a; i++)
+    r.addr = (r.addr << 8) | d[i];
+  r.len = count - a - 1;
+  memmove(d, d + a, r.len);
+  c->bytes.resize(r.data + r.len);
+  c->recs.push_back(r);
+  return HEX_OK;
+}
+
+static int decode_raw(hex_chunk *c, const char *p, unsigned int n)
+{
+  hex_rec r;
+
+  for (r.len = 0; r.len < n / 2; r.len++)
+    if (strchr(" \t/", p[2 * r.len]))
+      break;
+  if (r.len == n / 2 && n % 2 && !strchr(" \t/", p[n - 1]))
+    return HEX_SYNTAX;
+  r.addr = 0;
+  r.type = 0;
+  r.data = c->bytes.size();
+  c->bytes.resize(r.data + r.len);
+  if (r.len && !get_bytes(p, &c->bytes[r.data], r.len))
+    return HEX_SYNTAX;
+  c->recs.push_back(r);
+  return HEX_OK;
+}
+
+static void *decode_chunk(void *arg)
+{
+  hex_chunk *c = (hex_chunk *)arg;
+  const char *p = c->start;
+
+  c->bytes.reserve((c->end - c->start) / 2);
+  while (p < c->end)
+    {
+      const char *e = (const char *)memchr(p, '\n', c->end - p);
+      const char *next = (e) ? e + 1 : c->end;
+      int res = HEX_OK;
+
+      if (!e)
+        e = c->end;
+      while (e > p && strchr(" \t\r", e[-1]))
+        e--;
+      if (e > p)
+        {
+          if (c->fmt == HEX_INTEL)
+            res = decode_intel(c, p, e - p);
+          else if (c->fmt == HEX_SREC)
+            res = decode_srec(c, p, e - p);
+          else
+            res = decode_raw(c, p, e - p);
+        }
+      if (res != HEX_OK)
+        {
+          c->error = res;
+          break;
+        }
+      c->lines++;
+      p = next;
+    }
+  return 0;
+}
+
+static unsigned int num_threads(size_t size)
+{
+  long n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (n > MAX_THREADS)
+    n = MAX_THREADS;
+  if (n > (long)(size / MIN_CHUNK))
+    n = size / MIN_CHUNK;
+  return (n < 1) ? 1 : n;
+}
+
+/* The rest of the file from the current position */
+struct hex_text
+{
+  const char *p;
+  size_t len;
+  void *map;
+  size_t maplen;
+  std::vector<char> buf;
+
+  hex_text() : p(0), len(0), map(0), maplen(0) {}
+  ~hex_text()
+    {
+#ifndef __WIN32__
+      if (map)
+        munmap(map, maplen);
+#endif
+    }
+};
+
+/* Regular files are mapped, anything else is read */
+static void read_all(FILE *fp, hex_text &t)
+{
+  size_t n;
+  long pos = ftell(fp);
+#ifndef __WIN32__
+  struct stat st;
+
+  if (pos >= 0 && fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size > pos)
+    {
+      off_t base = pos & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+      void *m;
+
+      t.maplen = st.st_size - base;
+      m = mmap(0, t.maplen, PROT_READ, MAP_PRIVATE, fileno(fp), base);
+      if (m != MAP_FAILED)
+        {
+          madvise(m, t.maplen, MADV_SEQUENTIAL);
+          t.map = m;
+          t.p = (const char *)m + (pos - base);
+          t.len = st.st_size - pos;
+          fseek(fp, 0, SEEK_END);
+          return;
+        }
+    }
+#endif
+  do
+    {
+      if (t.len == t.buf.size())
+        t.buf.resize(t.len + MIN_CHUNK);
+      n = fread(&t.buf[t.len], 1, t.buf.size() - t.len, fp);
+      t.len += n;
+    }
+  while (n);
+  t.p = &t.buf[0];
+}
+
+/* Apply the address records, returns the error code */
+static int resolve(HEX_FORMAT fmt, const hex_chunk &c, uint32_t &base,
+                   bool &done, std::vector<hex_piece> &pieces)
+{
+  unsigned int i;
+
+  for (i = 0; i < c.recs.size() && !done; i++)
+    {
+      const hex_rec &r = c.recs[i];
+      const byte *d = (r.len) ? &c.bytes[r.data] : 0;
+      hex_piece pc;
+
+      if (fmt == HEX_INTEL)
+        {
+          switch (r.type)
+            {
+            case 0:
+              pc.addr = base + r.addr;
+              break;
+            case 1:
+              done = true;
+              continue;
+            case 2:
+              base = r.addr << 4;
+              continue;
+            case 4:
+              base = r.addr << 16;
+              continue;
+            default:  /* start addresses */
+              continue;
+            }
+        }
+      else if (fmt == HEX_SREC)
+        {
+          if (r.type >= 7)
+            done = true;
+          if (r.type < 1 || r.type > 3)
+            continue;
+          pc.addr = r.addr;
+        }
+      else
+        {
+          pc.addr = base;
+          base += r.len;
+        }
+      if (r.len == 0)
+        continue;
+      if ((uint64_t)pc.addr + r.len > 0x100000000ULL)
+        return HEX_RANGE;
+      /* Join records that follow each other in memory and in the file */
+      if (pieces.size())
+        {
+          hex_piece &last = pieces.back();
+
+          if ((uint64_t)last.addr + last.len == pc.addr &&
+              last.data + last.len == d)
+            {
+              last.len += r.len;
+              continue;
+            }
+        }
+      pc.len = r.len;
+      pc.data = d;
+      pieces.push_back(pc);
+    }
+  return (done) ? HEX_OK : c.error;
+}
+
+int readHexFile(FILE *fp, HEX_FORMAT fmt, std::vector<image_segment> &segs)
+{
+  static const char *const msg[] =
+    { "", "Invalid record", "Unhandled record type",
+      "Incorrect record checksum" };
+  hex_text text;
+  std::vector<hex_chunk> chunks;
+  std::vector<pthread_t> tids;
+  std::vector<bool> started;
+  std::vector<hex_piece> pieces;
+  unsigned int i, n, line = 1;
+  uint32_t base = 0;
+  bool done = false, overlap = false;
+  int res;
+
+  init_hexval();
+  read_all(fp, text);
+  segs.clear();
+  if (text.len == 0)
+    {
+      fprintf(stderr, "Empty hex file\n");
+      return HEX_SYNTAX;
+    }
+
+  /* Cut at line ends */
+  n = num_threads(text.len);
+  chunks.resize(n);
+  const char *p = text.p, *end = p + text.len;
+  for (i = 0; i < n; i++)
+    {
+      const char *e = (i == n - 1) ? end : text.p + text.len / n * (i + 1);
+
+      if (e < p)
+        e = p;
+      if (e < end && (e = (const char *)memchr(e, '\n', end - e)) != 0)
+        e++;
+      else
+        e = end;
+      chunks[i].start = p;
+      chunks[i].end = e;
+      chunks[i].fmt = fmt;
+      chunks[i].lines = 0;
+      chunks[i].error = HEX_OK;
+      p = e;
+    }
+
+  tids.resize(n);
+  started.resize(n, false);
+  for (i = 1; i < n; i++)
+    started[i] = pthread_create(&tids[i], 0, decode_chunk, &chunks[i]) == 0;
+  decode_chunk(&chunks[0]);
+  for (i = 1; i < n; i++)
+    {
+      if (started[i])
+        pthread_join(tids[i], 0);
+      else
+        decode_chunk(&chunks[i]);
+    }
+
+  for (i = 0; i < n && !done; i++)
+    {
+      res = resolve(fmt, chunks[i], base, done, pieces);
+      if (res == HEX_RANGE)
+        {
+          fprintf(stderr, "Record beyond the 4 GiB address space\n");
+          return res;
+        }
+      line += chunks[i].lines;
+      if (res != HEX_OK)
+        {
+          fprintf(stderr, "Line %u: %s\n", line, msg[res]);
+          return res;
+        }
+    }
+  if (!done && fmt == HEX_INTEL)
+    {
+      fprintf(stderr, "Premature end of hex file, no end-of-file record found\n");
+      return HEX_NOEND;
+    }
+
+  /* Records are usually in order already */
+  for (i = 1; i < pieces.size(); i++)
+    if (pieces[i].addr < pieces[i - 1].addr)
+      {
+        std::stable_sort(pieces.begin(), pieces.end());
+        break;
+      }
+  for (i = 0; i < pieces.size(); i++)
+    {
+      const hex_piece &pc = pieces[i];
+
+      if (segs.size() &&
+          pc.addr <= (uint64_t)segs.back().addr + segs.back().data.size())
+        {
+          image_segment &s = segs.back();
+          size_t off = pc.addr - s.addr;
+
+          if (off < s.data.size() && !overlap)
+            {
+              fprintf(stderr, "Overlapping records at 0x%08x\n", pc.addr);
+              overlap = true;
+            }
+          if (off + pc.len > s.data.size())
+            s.data.resize(off + pc.len);
+          memcpy(&s.data[off], pc.data, pc.len);
+        }
+      else
+        {
+          segs.push_back(image_segment());
+          segs.back().addr = pc.addr;
+          segs.back().data.assign(pc.data, pc.data + pc.len);
+        }
+    }
+  return HEX_OK;
+}
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+static inline char *put_hex(char *p, unsigned int v, int digits)
+{
+  while (digits--)
+    *p++ = hexdigits[(v >> (4 * digits)) & 0xf];
+  return p;
+}
+
+size_t hexRecordsSize(uint32_t len)
+{
+  /* 45 characters per data record, 17 per address record */
+  return ((size_t)len / 16 + 1) * 45 + ((size_t)len / 0x10000 + 2) * 17;
+}
+
+size_t formatHexRecords(char *dst, const byte *data, uint32_t addr,
+                        uint32_t len, const byte *xlat, uint32_t *base)
+{
+  char *p = dst;
+
+  while (len)
+    {
+      unsigned int i, n = (len > 16) ? 16 : len;
+      byte sum;
+
+      if (*base != addr >> 16)
+        {
+          *base = addr >> 16;
+          sum = 0x02 + 0x04 + (*base >> 8) + (*base & 0xff);
+          memcpy(p, ":02000004", 9);
+          p = put_hex(p + 9, *base, 4);
+          p = put_hex(p, (byte)(0x100 - sum), 2);
+          *p++ = '\r';
+          *p++ = '\n';
+        }
+      *p++ = ':';
+      p = put_hex(p, n, 2);
+      p = put_hex(p, addr & 0xffff, 4);
+      *p++ = '0';
+      *p++ = '0';
+      sum = n + (addr >> 8) + addr;
+      for (i = 0; i < n; i++)
+        {
+          byte b = (xlat) ? xlat[data[i]] : data[i];
+
+          sum += b;
+          p = put_hex(p, b, 2);
+        }
+      p = put_hex(p, (byte)(0x100 - sum), 2);
+      *p++ = '\r';
+      *p++ = '\n';
+      data += n;
+      addr += n;
+      len -= n;
+    }
+  return p - dst;
+}
+
+struct hex_job
+{
+  const byte *data;
+  uint32_t addr, len;
+  const byte *xlat;
+  uint32_t base;
+  std::vector<char> text;
+};
+
+static void *format_job(void *arg)
+{
+  hex_job *j = (hex_job *)arg;
+
+  j->text.resize(hexRecordsSize(j->len));
+  j->text.resize(formatHexRecords(&j->text[0], j->data, j->addr, j->len,
+                                  j->xlat, &j->base));
+  return 0;
+}
+
+void writeHexRecords(const byte *data, uint32_t addr, uint32_t len,
+                     const byte *xlat, uint32_t *base,
+                     hex_sink out, void *ctx)
+{
+  unsigned int i, n = num_threads(len);
+  std::vector<hex_job> jobs(n);
+  std::vector<pthread_t> tids(n);
+  std::vector<bool> started(n, false);
+
+  while (len)
+    {
+      unsigned int m;
+
+      /* One MIN_CHUNK per thread and round keeps the text buffers small */
+      for (m = 0; m < n && len; m++)
+        {
+          uint32_t l = (addr & ~0xffffU) + MIN_CHUNK - addr;
+
+          if (l > len)
+            l = len;
+          jobs[m].data = data;
+          jobs[m].addr = addr;
+          jobs[m].len = l;
+          jobs[m].xlat = xlat;
+          /* Only the first part can continue the 64 KiB page before */
+          jobs[m].base = (m == 0) ? *base : (uint32_t)-1;
+          data += l;
+          addr += l;
+          len -= l;
+        }
+      for (i = 1; i < m; i++)
+        started[i] = pthread_create(&tids[i], 0, format_job, &jobs[i]) == 0;
+      format_job(&jobs[0]);
+      for (i = 1; i < m; i++)
+        {
+          if (started[i])
+            pthread_join(tids[i], 0);
+          else
+            format_job(&jobs[i]);
+        }
+      for (i = 0; i < m; i++)
+        out(ctx, &jobs[i].text[0], jobs[i].text.size());
+      *base = jobs[m - 1].base;
+    }
+}
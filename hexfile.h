@@ -0,0 +1,77 @@
+/* Decode Intel HEX (MCS), Motorola S-record and raw hex text files
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+The file is cut at line boundaries into chunks that are decoded and
+checksummed by one thread each. Address records (Intel types 02/04)
+are resolved afterwards in file order, so a chunk needs no state from
+the chunks before it. The result lists the populated address ranges
+only, so holes in the image cost no memory.
+
+Writing Intel HEX is split the same way, at 64 KiB boundaries where an
+extended address record starts anyway.
+*/
+
+#ifndef HEXFILE_H
+#define HEXFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+typedef unsigned char byte;
+
+enum HEX_FORMAT
+  {
+    HEX_INTEL,   /* :LLAAAATT..CC, also Xilinx .mcs */
+    HEX_SREC,    /* S1/S2/S3 data records */
+    HEX_RAW      /* hex pairs without addresses, '/' starts a comment */
+  };
+
+/* A populated address range */
+struct image_segment
+{
+  uint32_t addr;
+  std::vector<byte> data;
+};
+
+/* Decode all of fp into segs, sorted by address. Touching records are
+ * merged into one segment. Returns 0 on success, otherwise a message
+ * is printed and the return value is > 0.
+ */
+int readHexFile(FILE *fp, HEX_FORMAT fmt, std::vector<image_segment> &segs);
+
+/* Room needed by formatHexRecords() for len bytes */
+size_t hexRecordsSize(uint32_t len);
+
+/* Format len bytes at addr as Intel HEX data records of up to 16 bytes
+ * into dst, each preceded by an extended address record if the upper 16
+ * address bits differ from *base. Bytes go through xlat if not 0.
+ * Returns the number of characters written.
+ */
+size_t formatHexRecords(char *dst, const byte *data, uint32_t addr,
+                        uint32_t len, const byte *xlat, uint32_t *base);
+
+typedef void (*hex_sink)(void *ctx, const char *text, size_t len);
+
+/* Like formatHexRecords(), but large blocks are cut at 64 KiB address
+ * boundaries and formatted on several threads. The text is handed to
+ * out in address order. addr must be a multiple of 16.
+ */
+void writeHexRecords(const byte *data, uint32_t addr, uint32_t len,
+                     const byte *xlat, uint32_t *base,
+                     hex_sink out, void *ctx);
+
+#endif /* HEXFILE_H */
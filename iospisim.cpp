@@ -0,0 +1,608 @@
+/* Simulated 7-series FPGA with the bscan_spi v2 core and a SPI flash
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "iospisim.h"
+#include "jtag.h"
+#include "bitrev.h"
+#include "crc32.h"
+
+#define IRLEN        6
+#define IR_USER1     0x02
+#define IR_USER2     0x03
+#define IR_IDCODE    0x09
+#define IR_USER3     0x22
+#define SIM_IDCODE   0x0362d093      /* XC7A35T */
+#define SIM_SIGNATURE 0x53500200
+
+#define TCK_US       (1.0 / 30.0)    /* 30 MHz JTAG clock, FT2232H */
+#define SEQ_BIT_US   (2.0 / 65.0)    /* one SPI clock from CFGMCLK */
+#define RAM_BITS     16384
+#define FIFO_BITS    16384
+#define RDSR_LIMIT   (1 << 24)       /* polls until the core gives up */
+
+/* Flash timings, much shorter than the data sheet values */
+#define T_PP         300.0
+#define T_SE4K       40000.0
+#define T_SE32K      100000.0
+#define T_SE         150000.0
+#define T_BE         2000000.0
+
+static void sim_error(int *count, const char *fmt, ...)
+{
+  va_list ap;
+
+  fprintf(stderr, "\nsim: ");
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  fprintf(stderr, "\n");
+  (*count)++;
+}
+
+SpiSimFlash::SpiSimFlash(const unsigned char *id, unsigned int size,
+                         unsigned int sector_size)
+  : mem(size, 0xff)
+{
+  memcpy(jedec, id, 3);
+  sector = sector_size;
+  sr = 0;
+  sr2 = 0;
+  errors = 0;
+  now = 0;
+  ready = 0;
+  wel = false;
+  ignore = false;
+}
+
+/* Quad output read needs the QE bit, except on N25Q */
+bool SpiSimFlash::quadOK(void)
+{
+  switch (jedec[0])
+    {
+    case 0x20:
+      return (jedec[1] == 0xba || jedec[1] == 0xbb);
+    case 0xef:
+      return (sr2 & 0x02) != 0;
+    case 0xc2:
+      return (sr & 0x40) != 0;
+    }
+  return false;
+}
+
+/* Address bytes after op, 0 for commands without address */
+unsigned int SpiSimFlash::addrLen(unsigned char op)
+{
+  switch (op)
+    {
+    case 0x02: case 0x03: case 0x0B: case 0x6B:
+    case 0x20: case 0x52: case 0xD8:
+      return 3;
+    case 0x12: case 0x13: case 0x0C: case 0x6C:
+    case 0x21: case 0x5C: case 0xDC:
+      return 4;
+    }
+  return 0;
+}
+
+unsigned int SpiSimFlash::address(unsigned int alen)
+{
+  unsigned int i, a = 0;
+
+  for (i = 1; i <= alen; i++)
+    a = (a << 8) | cmd[i];
+  return a % mem.size();
+}
+
+void SpiSimFlash::begin(double t)
+{
+  now = t;
+  cmd.clear();
+  ignore = false;
+}
+
+unsigned char SpiSimFlash::xfer(unsigned char mosi)
+{
+  unsigned int p = cmd.size(), alen;
+  unsigned char op;
+
+  cmd.push_back(mosi);
+  if (ignore)
+    return 0xff;
+  op = cmd[0];
+  if (p == 0)
+    {
+      if (busy(now) && op != 0x05 && op != 0x35)
+        {
+          sim_error(&errors, "flash: command 0x%02x while busy", op);
+          ignore = true;
+        }
+      else if ((op == 0x6B || op == 0x6C) && !quadOK())
+        {
+          sim_error(&errors, "flash: quad output read with QE clear");
+          ignore = true;
+        }
+      return 0xff;
+    }
+  switch (op)
+    {
+    case 0x9F:
+      return (p <= 3)? jedec[p - 1] : 0;
+    case 0x05:
+      return sr | ((busy(now))? 0x01 : 0) | ((wel)? 0x02 : 0);
+    case 0x35:
+      return sr2;
+    case 0x03: case 0x13: case 0x0B: case 0x0C: case 0x6B: case 0x6C:
+      alen = addrLen(op);
+      /* fast reads have one byte of dummy clocks */
+      if (op != 0x03 && op != 0x13)
+        alen++;
+      if (p <= alen)
+        return 0xff;
+      return mem[(address(addrLen(op)) + p - alen - 1) % mem.size()];
+    }
+  return 0xff;
+}
+
+/* Page program ANDs the data into the page and wraps at its end */
+void SpiSimFlash::program(unsigned int alen)
+{
+  unsigned int a = address(alen), n = cmd.size() - 1 - alen, i;
+
+  if (n == 0)
+    return;
+  if (n > 256 || (a & 0xff) + n > 256)
+    sim_error(&errors, "flash: page program of %u bytes at 0x%06x "
+              "crosses the page end", n, a);
+  for (i = 0; i < n; i++)
+    {
+      unsigned int pa = (a & ~0xffU) | ((a + i) & 0xff);
+      unsigned char d = cmd[1 + alen + i];
+
+      if ((mem[pa] & d) != d)
+        {
+          sim_error(&errors, "flash: programming unerased byte at 0x%06x",
+                    pa);
+          return;
+        }
+      mem[pa] &= d;
+    }
+  ready = now + T_PP;
+}
+
+void SpiSimFlash::eraseBlock(unsigned int size, unsigned int alen, double t)
+{
+  unsigned int a = (address(alen) / size) * size;
+
+  memset(&mem[a], 0xff, size);
+  ready = now + t;
+}
+
+void SpiSimFlash::end(void)
+{
+  unsigned char op;
+
+  if (cmd.empty() || ignore)
+    return;
+  op = cmd[0];
+  switch (op)
+    {
+    case 0x06:
+      wel = true;
+      return;
+    case 0x04:
+      wel = false;
+      return;
+    case 0x02: case 0x12: case 0x20: case 0x21: case 0x52: case 0x5C:
+    case 0xD8: case 0xDC: case 0xC7: case 0x60:
+      break;
+    default:
+      return;
+    }
+  if (!wel)
+    {
+      sim_error(&errors, "flash: command 0x%02x without WREN", op);
+      return;
+    }
+  if (cmd.size() < 1 + addrLen(op))
+    {
+      sim_error(&errors, "flash: command 0x%02x without address", op);
+      return;
+    }
+  wel = false;
+  switch (op)
+    {
+    case 0x02: case 0x12:
+      program(addrLen(op));
+      break;
+    case 0x20: case 0x21:
+      eraseBlock(4096, addrLen(op), T_SE4K);
+      break;
+    case 0x52: case 0x5C:
+      eraseBlock(32768, addrLen(op), T_SE32K);
+      break;
+    case 0xD8: case 0xDC:
+      eraseBlock(sector, addrLen(op), T_SE);
+      break;
+    default:
+      memset(&mem[0], 0xff, mem.size());
+      ready = now + T_BE;
+    }
+}
+
+IOSpiSim::IOSpiSim(SpiSimFlash &f, bool v2core)
+  : IOBase(), flash(f), ram(RAM_BITS, 1)
+{
+  v2 = v2core;
+  errors = 0;
+  now = 0;
+  state = Jtag::TEST_LOGIC_RESET;
+  ir = IR_IDCODE;
+  ir_sr = 0;
+  status = 0;
+  memset(rdbuf, 0xff, sizeof(rdbuf));
+  rd_n = 0;
+  rd_t0 = 0;
+  rd_step = 0;
+  seq_done = 0;
+  seq_error = false;
+  last_sr = 0;
+}
+
+void IOSpiSim::Usleep(unsigned int usec)
+{
+  flush_tms(false);
+  now += usec;
+}
+
+void IOSpiSim::txrx_block(const unsigned char *tdi, unsigned char *tdo,
+                          int length, bool last)
+{
+  int i;
+
+  if (tdo)
+    memset(tdo, 0, (length + 7) / 8);
+  for (i = 0; i < length; i++)
+    {
+      bool in = (tdi)? (tdi[i / 8] >> (i % 8)) & 1 : false;
+
+      if (clock(last && i == length - 1, in) && tdo)
+        tdo[i / 8] |= 1 << (i % 8);
+    }
+}
+
+void IOSpiSim::tx_tms(unsigned char *pat, int length, int force)
+{
+  int i;
+
+  for (i = 0; i < length; i++)
+    clock((pat[i / 8] >> (i % 8)) & 1, false);
+}
+
+int IOSpiSim::nextState(int s, bool tms)
+{
+  switch (s)
+    {
+    case Jtag::TEST_LOGIC_RESET:
+      return (tms)? Jtag::TEST_LOGIC_RESET : Jtag::RUN_TEST_IDLE;
+    case Jtag::RUN_TEST_IDLE:
+    case Jtag::UPDATE_DR:
+    case Jtag::UPDATE_IR:
+      return (tms)? Jtag::SELECT_DR_SCAN : Jtag::RUN_TEST_IDLE;
+    case Jtag::SELECT_DR_SCAN:
+      return (tms)? Jtag::SELECT_IR_SCAN : Jtag::CAPTURE_DR;
+    case Jtag::CAPTURE_DR:
+    case Jtag::SHIFT_DR:
+    case Jtag::EXIT2_DR:
+      return (tms)? Jtag::EXIT1_DR : Jtag::SHIFT_DR;
+    case Jtag::EXIT1_DR:
+      return (tms)? Jtag::UPDATE_DR : Jtag::PAUSE_DR;
+    case Jtag::PAUSE_DR:
+      return (tms)? Jtag::EXIT2_DR : Jtag::PAUSE_DR;
+    case Jtag::SELECT_IR_SCAN:
+      return (tms)? Jtag::TEST_LOGIC_RESET : Jtag::CAPTURE_IR;
+    case Jtag::CAPTURE_IR:
+    case Jtag::SHIFT_IR:
+    case Jtag::EXIT2_IR:
+      return (tms)? Jtag::EXIT1_IR : Jtag::SHIFT_IR;
+    case Jtag::EXIT1_IR:
+      return (tms)? Jtag::UPDATE_IR : Jtag::PAUSE_IR;
+    case Jtag::PAUSE_IR:
+      return (tms)? Jtag::EXIT2_IR : Jtag::PAUSE_IR;
+    }
+  return Jtag::TEST_LOGIC_RESET;
+}
+
+/* One rising TCK edge: capture and shift happen in the current state,
+ * update on entering the update states
+ */
+bool IOSpiSim::clock(bool tms, bool tdi)
+{
+  bool tdo = false;
+
+  now += TCK_US;
+  switch (state)
+    {
+    case Jtag::CAPTURE_DR:
+      dr_in.clear();
+      status = 0x56320000 | ((seq_error)? 0x200 : 0) |
+        ((now < seq_done)? 0x100 : 0) | last_sr;
+      break;
+    case Jtag::SHIFT_DR:
+      tdo = drBit(dr_in.size());
+      dr_in.push_back(tdi);
+      break;
+    case Jtag::CAPTURE_IR:
+      ir_sr = 0x01;
+      break;
+    case Jtag::SHIFT_IR:
+      tdo = ir_sr & 1;
+      ir_sr = (ir_sr >> 1) | ((tdi)? 1 << (IRLEN - 1) : 0);
+      break;
+    }
+  state = nextState(state, tms);
+  if (state == Jtag::UPDATE_DR && ir == IR_USER1)
+    updateUser1();
+  else if (state == Jtag::UPDATE_DR && ir == IR_USER3 && v2)
+    updateUser3();
+  else if (state == Jtag::UPDATE_IR)
+    ir = ir_sr;
+  else if (state == Jtag::TEST_LOGIC_RESET)
+    ir = IR_IDCODE;
+  return tdo;
+}
+
+/* TDO for bit k of the DR scan */
+bool IOSpiSim::drBit(unsigned int k)
+{
+  unsigned int i;
+
+  switch (ir)
+    {
+    case IR_IDCODE:
+      return (k < 32)? (SIM_IDCODE >> k) & 1 : dr_in[k - 32];
+    case IR_USER1:
+      /* MISO of the previous transfer */
+      return ram[k % RAM_BITS];
+    case IR_USER2:
+      return v2 && k < 32 && ((SIM_SIGNATURE >> k) & 1);
+    case IR_USER3:
+      if (!v2)
+        return false;
+      if (k < 32)
+        return (status >> k) & 1;
+      /* the read buffer, each byte MSB first as it came from the flash.
+       * Bytes the running command has not written yet are old.
+       */
+      k -= 32;
+      i = (k / 8) % sizeof(rdbuf);
+      if (i < rd_n && now < rd_t0 + (i + 1) * rd_step)
+        return (rdbuf_old[i] >> (7 - k % 8)) & 1;
+      return (rdbuf[i] >> (7 - k % 8)) & 1;
+    }
+  /* BYPASS */
+  return (k == 0)? false : dr_in[k - 1];
+}
+
+/* Version 1 protocol, see bscan_common.v: after the 32 bit magic
+ * 0x59a659a6 and the 16 bit length, both MSB first, the next length
+ * TDI bits go to MOSI with CS low. MISO is stored and shifted out with
+ * the next scan.
+ */
+void IOSpiSim::updateUser1(void)
+{
+  unsigned int n = dr_in.size(), e, len = 0, i, j;
+  uint64_t win = 0;
+
+  for (e = 0; e < n; e++)
+    {
+      win = ((win << 1) | dr_in[e]) & ((1ULL << 47) - 1);
+      if (e >= 46 && (win >> 15) == 0x59a659a6)
+        break;
+    }
+  if (e >= n)
+    return;
+  len = (win & 0x7fff) << 1;
+  if (len == 0)
+    return;
+  if (now < seq_done)
+    {
+      sim_error(&errors, "USER1 transfer while the v2 core is busy");
+      return;
+    }
+  /* the length LSB is not looked at, data starts after it */
+  e += 2;
+  if (e >= n)
+    len = 0;
+  else if (len > n - e)
+    len = n - e;
+  flash.begin(now);
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      unsigned char mosi = 0, miso;
+
+      for (j = 0; j < 8; j++)
+        mosi = (mosi << 1) | dr_in[e + i + j];
+      miso = flash.xfer(mosi);
+      for (j = 0; j < 8; j++)
+        ram[(i + j) % RAM_BITS] = (miso >> (7 - j)) & 1;
+    }
+  flash.end();
+}
+
+/* FIFO byte k, the first bit goes out first (MSB) */
+unsigned char IOSpiSim::fifoByte(unsigned int k)
+{
+  unsigned char b = 0;
+  unsigned int j;
+
+  for (j = 0; j < 8; j++)
+    b = (b << 1) | dr_in[64 + 8 * k + j];
+  return b;
+}
+
+/* Command channel: cmd, flags, addr, len, data, all LSB first */
+void IOSpiSim::updateUser3(void)
+{
+  unsigned int cmd = 0, flags = 0, addr = 0, len = 0, i;
+
+  if (dr_in.size() < 64)
+    return;
+  for (i = 0; i < 8; i++)
+    {
+      cmd |= dr_in[i] << i;
+      flags |= dr_in[8 + i] << i;
+    }
+  for (i = 0; i < 32; i++)
+    addr |= (uint32_t)dr_in[16 + i] << i;
+  for (i = 0; i < 16; i++)
+    len |= dr_in[48 + i] << i;
+  if (cmd == 0)
+    return;
+  if (now < seq_done)
+    {
+      sim_error(&errors, "v2 command 0x%02x while the core is busy, "
+                "the core drops it", cmd);
+      return;
+    }
+  seq_error = false;
+  switch (cmd)
+    {
+    case 0x01:
+      seqProgram(addr, len, flags);
+      break;
+    case 0x02:
+    case 0x03:
+      seqRead(cmd, addr, len, flags);
+      break;
+    default:
+      sim_error(&errors, "unknown v2 command 0x%02x", cmd);
+    }
+}
+
+static void seq_addr(SpiSimFlash &flash, unsigned int addr, bool addr4)
+{
+  if (addr4)
+    flash.xfer(addr >> 24);
+  flash.xfer(addr >> 16);
+  flash.xfer(addr >> 8);
+  flash.xfer(addr);
+}
+
+/* WREN, PP and RDSR polling for each page, like the Q_* states */
+void IOSpiSim::seqProgram(unsigned int addr, unsigned int len,
+                          unsigned int flags)
+{
+  bool addr4 = flags & 0x02;
+  unsigned int i, j, n, fifo_len = (dr_in.size() - 64) / 8;
+  double t = now, poll = 17 * SEQ_BIT_US;
+  unsigned char sr;
+
+  if (len * 8 > FIFO_BITS)
+    sim_error(&errors, "v2 PROGRAM of %u bytes, the FIFO holds %u",
+              len, FIFO_BITS / 8);
+  if (len > fifo_len)
+    {
+      sim_error(&errors, "v2 PROGRAM of %u bytes with %u bytes of data",
+                len, fifo_len);
+      len = fifo_len;
+    }
+  for (i = 0; i < len; i += n)
+    {
+      n = 256 - ((addr + i) & 0xff);
+      if (n > len - i)
+        n = len - i;
+      flash.begin(t);
+      flash.xfer(0x06);
+      flash.end();
+      t += 9 * SEQ_BIT_US;
+      flash.begin(t);
+      flash.xfer((addr4)? 0x12 : 0x02);
+      seq_addr(flash, addr + i, addr4);
+      for (j = 0; j < n; j++)
+        flash.xfer(fifoByte((i + j) % (FIFO_BITS / 8)));
+      flash.end();
+      t += (8 * ((addr4)? 5 : 4) + 8 * n + 1) * SEQ_BIT_US;
+      /* skip the polls that only see WIP */
+      if (flash.busy(t))
+        {
+          unsigned long polls =
+            (unsigned long)((flash.readyAt() - t) / poll) + 1;
+
+          if (polls >= RDSR_LIMIT)
+            {
+              t += RDSR_LIMIT * poll;
+              seq_error = true;
+              break;
+            }
+          t += polls * poll;
+        }
+      flash.begin(t);
+      flash.xfer(0x05);
+      sr = flash.xfer(0);
+      flash.end();
+      t += poll;
+      last_sr = sr;
+    }
+  seq_done = t;
+}
+
+/* READ fills the read buffer, CRC reads len * 256 bytes and leaves the
+ * CRC-32 in the first 4 bytes, LSB first on TDO
+ */
+void IOSpiSim::seqRead(unsigned int cmd, unsigned int addr, unsigned int len,
+                       unsigned int flags)
+{
+  bool quad = flags & 0x01, addr4 = flags & 0x02;
+  unsigned int n = (cmd == 0x03)? len * 256 : len, i;
+  std::vector<unsigned char> data(n);
+  uint32_t crc;
+
+  if (cmd == 0x02 && n > sizeof(rdbuf))
+    sim_error(&errors, "v2 READ of %u bytes, the buffer holds %u",
+              n, (unsigned int)sizeof(rdbuf));
+  flash.begin(now);
+  if (addr4)
+    flash.xfer((quad)? 0x6C : 0x0C);
+  else
+    flash.xfer((quad)? 0x6B : 0x0B);
+  seq_addr(flash, addr, addr4);
+  flash.xfer(0);
+  for (i = 0; i < n; i++)
+    data[i] = flash.xfer(0);
+  flash.end();
+  memcpy(rdbuf_old, rdbuf, sizeof(rdbuf));
+  rd_t0 = now + 8 * ((addr4)? 6 : 5) * SEQ_BIT_US;
+  rd_step = ((quad)? 2 : 8) * SEQ_BIT_US;
+  seq_done = rd_t0 + n * rd_step + 9 * SEQ_BIT_US;
+  if (cmd == 0x02)
+    {
+      rd_n = (n < sizeof(rdbuf))? n : sizeof(rdbuf);
+      for (i = 0; i < n; i++)
+        rdbuf[i % sizeof(rdbuf)] = data[i];
+      return;
+    }
+  /* the CRC is stored at the end */
+  rd_n = 4;
+  rd_t0 = seq_done;
+  rd_step = 0;
+  crc = crc32_update(0, (n)? &data[0] : 0, n);
+  for (i = 0; i < 4; i++)
+    rdbuf[i] = bitRevTable[(crc >> (8 * i)) & 0xff];
+}
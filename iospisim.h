@@ -0,0 +1,109 @@
+/* Simulated 7-series FPGA with the bscan_spi v2 core and a SPI flash
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+IOSpiSim stands in for a cable, so the SPI flash algorithms run without
+hardware. Behind the TAP sits a device with a 6 bit IR and the registers
+of bscan_spi/bscan_xc7_spi_v2.v: USER1 with the version 1 protocol,
+USER2 with the signature and USER3 with the command channel. Without v2
+only USER1 answers, like with the older cores. The flash knows the
+usual 25-series commands. Time only moves with TCK and Usleep(), flash
+and core timings are shortened. Whatever would go wrong on the real
+core or flash, like a command while the core is busy or a page program
+without WREN, is reported and counted in getErrors().
+*/
+
+#ifndef IOSPISIM_H
+#define IOSPISIM_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "iobase.h"
+
+/* Times in us, contents as seen on the SPI bus (not bit reversed) */
+class SpiSimFlash
+{
+ public:
+  SpiSimFlash(const unsigned char *id, unsigned int size,
+              unsigned int sector_size);
+  std::vector<unsigned char> mem;
+  unsigned char sr;     /* status register, bit 6 is QE for Macronix */
+  unsigned char sr2;    /* status register 2, bit 1 is QE for Winbond */
+  int errors;
+
+  void begin(double t);                 /* CS low */
+  unsigned char xfer(unsigned char mosi);
+  void end(void);                       /* CS high, writes happen here */
+  bool busy(double t) { return t < ready; }
+  double readyAt(void) { return ready; }
+
+ private:
+  unsigned char jedec[3];
+  unsigned int sector;
+  double now, ready;
+  bool wel;
+  bool ignore;                          /* command refused */
+  std::vector<unsigned char> cmd;       /* bytes of the current command */
+
+  bool quadOK(void);
+  unsigned int addrLen(unsigned char op);
+  unsigned int address(unsigned int alen);
+  void program(unsigned int alen);
+  void eraseBlock(unsigned int size, unsigned int alen, double t);
+};
+
+class IOSpiSim : public IOBase
+{
+ public:
+  IOSpiSim(SpiSimFlash &f, bool v2core);
+  void Usleep(unsigned int usec);
+  int getErrors(void) { return errors + flash.errors; }
+
+ protected:
+  void txrx_block(const unsigned char *tdi, unsigned char *tdo, int length,
+                  bool last);
+  void tx_tms(unsigned char *pat, int length, int force);
+
+ private:
+  SpiSimFlash &flash;
+  bool v2;
+  int errors;
+  double now;
+  int state;                            /* Jtag::tapState_t */
+  unsigned int ir, ir_sr;
+  uint32_t status;                      /* USER3 status of this scan */
+  std::vector<unsigned char> dr_in;     /* TDI bits of this DR scan */
+  std::vector<unsigned char> ram;       /* USER1 MISO bits */
+  unsigned char rdbuf[2048];            /* v2 read buffer */
+  unsigned char rdbuf_old[2048];        /* before the last READ or CRC */
+  unsigned int rd_n;                    /* bytes it writes */
+  double rd_t0, rd_step;                /* byte i is there at t0+(i+1)*step */
+  double seq_done;                      /* v2 sequencer busy until */
+  bool seq_error;
+  unsigned char last_sr;
+
+  bool clock(bool tms, bool tdi);
+  int nextState(int s, bool tms);
+  bool drBit(unsigned int k);
+  void updateUser1(void);
+  void updateUser3(void);
+  unsigned char fifoByte(unsigned int k);
+  void seqProgram(unsigned int addr, unsigned int len, unsigned int flags);
+  void seqRead(unsigned int cmd, unsigned int addr, unsigned int len,
+               unsigned int flags);
+};
+
+#endif /* IOSPISIM_H */
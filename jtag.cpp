@@ -224,6 +224,26 @@ void Jtag::shiftIR(const byte *tdi, byte *tdo)
   setTapState(postIRState);
 }
 
+/* Load the same instruction into several devices in one IR scan,
+ * e.g. to start identical FPGAs together
+ */
+void Jtag::shiftIRAll(const byte *tdi, const int *devs, int ndevs)
+{
+  setTapState(SHIFT_IR);
+  if(fp_dbg)
+      fprintf(fp_dbg, "shiftIRAll In: %02x to %d devices\n", *tdi, ndevs);
+  for(int dev=numDevices-1; dev>=0; dev--)
+    {
+      bool sel=false;
+      for(int k=0; k<ndevs; k++)
+	if(devs[k]==dev)sel=true;
+      if(sel)io->shiftTDI(tdi,devices[dev].irlen,dev==0);
+      else io->shift(true,devices[dev].irlen,dev==0);
+    }
+  nextTapState(true);
+  setTapState(postIRState);
+}
+
 void Jtag::setTapState(tapState_t state, int pre)
 {
   bool tms;
@@ -106,6 +106,7 @@ class Jtag
   int selectDevice(int dev);
   void shiftDR(const byte *tdi, byte *tdo, int length, int align=0, bool exit=true);// Some devices use TCK for aligning data, for example, Xilinx FPGAs for configuration data.
   void shiftIR(const byte *tdi, byte *tdo=0); // No length argumant required as IR length specified in chainParam_t 
+  void shiftIRAll(const byte *tdi, const int *devs, int ndevs); // Same instruction to all devs, BYPASS to the others
   inline void longToByteArray(unsigned long l, byte *b){
     b[0]=(byte)(l&0xff);
     b[1]=(byte)((l>>8)&0xff);
@@ -0,0 +1,111 @@
+/* Device independent parts of the programming algorithms
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+A manifest is a text file with one line per block:
+    <offset> <length> <crc32>
+all numbers in hex with 0x prefix, lines starting with '#' are comments.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "progalg.h"
+#include "crc32.h"
+
+int ProgAlg::readRange(byte * /*data*/, unsigned int /*offset*/,
+                       unsigned int /*len*/)
+{
+  fprintf(stderr, "Device can't read back a partial range\n");
+  return -1;
+}
+
+int ProgAlg::verifyDigest(uint32_t crc, unsigned int offset, unsigned int len)
+{
+  byte *buf = new byte[DIGEST_BLOCK];
+  uint32_t dev_crc = 0;
+  unsigned int i, n;
+
+  for (i = 0; i < len; i += n)
+    {
+      n = (len - i > DIGEST_BLOCK)? DIGEST_BLOCK : len - i;
+      if (readRange(buf, offset + i, n))
+        {
+          delete[] buf;
+          return -1;
+        }
+      dev_crc = crc32_update_rev(dev_crc, buf, n);
+    }
+  delete[] buf;
+  if (dev_crc != crc)
+    {
+      fprintf(stderr, "Block at 0x%06x len 0x%06x mismatch: "
+              "device 0x%08x, expected 0x%08x\n", offset, len, dev_crc, crc);
+      return 1;
+    }
+  return 0;
+}
+
+int ProgAlg::verifyManifest(FILE *fp, unsigned int offset)
+{
+  char line[256];
+  unsigned int addr, len, nblocks = 0, nbad = 0, lineno = 0;
+  uint32_t crc;
+  char *p;
+  int res;
+
+  while (fgets(line, sizeof(line), fp))
+    {
+      lineno++;
+      p = line + strspn(line, " \t");
+      if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0)
+        continue;
+      addr = strtoul(p, &p, 0);
+      len = strtoul(p, &p, 0);
+      crc = strtoul(p, &p, 0);
+      if (len == 0)
+        {
+          fprintf(stderr, "Manifest line %u malformed\n", lineno);
+          return -1;
+        }
+      res = verifyDigest(crc, offset + addr, len);
+      if (res < 0)
+        return -1;
+      nblocks++;
+      nbad += res;
+    }
+  if (nbad)
+    fprintf(stderr, "%u of %u blocks differ\n", nbad, nblocks);
+  else
+    fprintf(stderr, "All %u blocks verified\n", nblocks);
+  return nbad;
+}
+
+int ProgAlg::writeManifest(FILE *fp, const byte *data, unsigned int len,
+                           unsigned int block)
+{
+  unsigned int i, n;
+
+  if (block == 0)
+    block = DIGEST_BLOCK;
+  fprintf(fp, "# offset length crc32\n");
+  for (i = 0; i < len; i += n)
+    {
+      n = (len - i > block)? block : len - i;
+      fprintf(fp, "0x%08x 0x%08x 0x%08x\n", i, n,
+              crc32_update_rev(0, data + i, n));
+    }
+  return ferror(fp)? -1 : 0;
+}
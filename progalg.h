@@ -3,6 +3,8 @@
 #ifndef PROGALG_H
 #define PROGALG_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include "bitfile.h"
 
 
@@ -19,6 +21,25 @@ class ProgAlg
   virtual int read(BitFile &file) = 0;
   virtual void reconfig() = 0;
   virtual void disable() = 0;
+  /* Read len bytes at offset into data, in BitFile order.
+   * Returns -1 if the algorithm can't read a partial range.
+   */
+  virtual int readRange(byte *data, unsigned int offset, unsigned int len);
+  /* Compare the CRC-32 of len bytes at offset against crc, reading the
+   * device in DIGEST_BLOCK chunks. The CRC is the one of the bytes as
+   * stored in the device, like crc32 of a .bin file.
+   * Returns 1 on mismatch, -1 on error.
+   */
+  int verifyDigest(uint32_t crc, unsigned int offset, unsigned int len);
+  /* Check every block listed in a manifest, shifted by offset.
+   * Returns the number of mismatching blocks, -1 on error.
+   */
+  int verifyManifest(FILE *fp, unsigned int offset);
+  /* Write a manifest for data with one line per block of block bytes */
+  static int writeManifest(FILE *fp, const byte *data, unsigned int len,
+                           unsigned int block);
+
+  static const unsigned int DIGEST_BLOCK = 0x10000;
 };
 
 #endif //PROGALG_H
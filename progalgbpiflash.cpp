@@ -0,0 +1,674 @@
+/* BPI (parallel NOR) Flash JTAG programming algorithms
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+The flash is accessed through the bscan_bpi core. The host sends a stream
+of 16 bit op words through USER1, LSB first:
+
+  0x1000            ADDR:  next two words are the low and high half of
+                           the flash word address
+  0x2000 | (n-1)    WRITE: the next n words are written, the address
+                           increments after each write
+  0x3000 | (n-1)    READ:  n words are read while the host shifts n
+                           dummy words, the address increments
+  0x0000            NOP
+
+Words read during one scan are shifted out at the start of the next scan.
+
+Image bytes are written as little endian words, i.e. byte 2n goes to
+D[7:0], byte 2n+1 to D[15:8]. Bitfile data is kept bit reversed, which is
+the bit order Xilinx FPGAs expect on the BPI data bus.
+
+*/
+#include <sys/time.h>
+
+#include "progalgbpiflash.h"
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+const byte ProgAlgBPIFlash::USER1=0x02;
+
+#define BPI_OP_NOP           0x0000
+#define BPI_OP_ADDR          0x1000
+#define BPI_OP_WRITE         0x2000
+#define BPI_OP_READ          0x3000
+
+/* CFI primary vendor command sets */
+#define CFI_CMDSET_INTEL_EXT 0x0001
+#define CFI_CMDSET_AMD_STD   0x0002
+#define CFI_CMDSET_INTEL_STD 0x0003
+
+/* Intel/Micron command set */
+#define INTEL_READ_ARRAY     0xFF
+#define INTEL_READ_ID        0x90
+#define INTEL_CLEAR_STATUS   0x50
+#define INTEL_BLOCK_ERASE    0x20
+#define INTEL_BUFFER_PROGRAM 0xE8
+#define INTEL_CONFIRM        0xD0
+#define INTEL_LOCK_SETUP     0x60
+#define INTEL_READY          0x80
+#define INTEL_ERRORS         0x3a /* erase, program, VPP, block locked */
+
+/* AMD/Spansion command set */
+#define AMD_RESET            0xF0
+#define AMD_READ_ID          0x90
+#define AMD_ERASE_SETUP      0x80
+#define AMD_SECTOR_ERASE     0x30
+#define AMD_WRITE_BUFFER     0x25
+#define AMD_BUFFER_CONFIRM   0x29
+#define AMD_DQ7              0x80
+#define AMD_DQ5              0x20
+
+#define CFI_QUERY            0x98
+#define CFI_QUERY_ADDR       0x55
+
+#define deltaT(tvp1, tvp2) (((tvp2)->tv_sec-(tvp1)->tv_sec)*1000000 + \
+			    (tvp2)->tv_usec - (tvp1)->tv_usec)
+
+ProgAlgBPIFlash::ProgAlgBPIFlash(Jtag &j)
+{
+  char *fname = getenv("BPI_DEBUG");
+  if (fname)
+    fp_dbg = fopen(fname,"wb");
+  else
+    fp_dbg = NULL;
+  jtag = &j;
+  ops = new uint16_t[MAX_OPS];
+  nops = 0;
+  nreads = 0;
+  tdi = new byte[2*MAX_OPS];
+  tdo = new byte[2*MAX_OPS];
+  size = 0;
+  wbuf_words = 1;
+  cmdset = 0;
+  nregions = 0;
+}
+
+ProgAlgBPIFlash::~ProgAlgBPIFlash(void)
+{
+  delete[] ops;
+  delete[] tdi;
+  delete[] tdo;
+  if (fp_dbg)
+    fclose(fp_dbg);
+}
+
+void ProgAlgBPIFlash::op_addr(unsigned int addr)
+{
+  assert(nops + 3 <= MAX_OPS);
+  ops[nops++] = BPI_OP_ADDR;
+  ops[nops++] = addr & 0xffff;
+  ops[nops++] = addr >> 16;
+}
+
+void ProgAlgBPIFlash::op_write_burst(unsigned int addr, const uint16_t *data,
+                                     int n)
+{
+  op_addr(addr);
+  assert(n > 0 && n <= 4096 && nops + 1 + n <= MAX_OPS);
+  ops[nops++] = BPI_OP_WRITE | (n - 1);
+  memcpy(ops + nops, data, n * sizeof(uint16_t));
+  nops += n;
+}
+
+void ProgAlgBPIFlash::op_write(unsigned int addr, uint16_t data)
+{
+  op_write_burst(addr, &data, 1);
+}
+
+void ProgAlgBPIFlash::op_read(unsigned int addr, int n)
+{
+  op_addr(addr);
+  assert(n > 0 && nreads + n <= MAX_READ && nops + 1 + n <= MAX_OPS);
+  ops[nops++] = BPI_OP_READ | (n - 1);
+  memset(ops + nops, 0, n * sizeof(uint16_t));
+  nops += n;
+  nreads += n;
+}
+
+/* Shift the queued op words and return the first nresult words shifted
+ * out, i.e. the words read during the previous scan.
+ */
+int ProgAlgBPIFlash::scan(uint16_t *result, int nresult)
+{
+  int k, words = (nops > nresult)? nops : nresult;
+
+  if (words == 0)
+    return 0;
+  for (k = 0; k < words; k++)
+    {
+      uint16_t w = (k < nops)? ops[k] : BPI_OP_NOP;
+      tdi[2*k] = w & 0xff;
+      tdi[2*k+1] = w >> 8;
+    }
+  jtag->shiftIR(&USER1);
+  jtag->shiftDR(tdi, (result)? tdo : NULL, words*16);
+  if (result)
+    for (k = 0; k < nresult; k++)
+      result[k] = tdo[2*k] | (tdo[2*k+1] << 8);
+  if (fp_dbg)
+    {
+      fprintf(fp_dbg, "Ops");
+      for (k = 0; k < nops && k < 16; k++)
+        fprintf(fp_dbg, " %04x", ops[k]);
+      fprintf(fp_dbg, "%s\n", (nops > 16)? "...": "");
+    }
+  nops = 0;
+  nreads = 0;
+  return 0;
+}
+
+/* Run the queued ops and, if they contain reads, fetch the results */
+int ProgAlgBPIFlash::execute(uint16_t *rdata)
+{
+  int n = nreads;
+
+  scan(NULL, 0);
+  if (n)
+    scan(rdata, n);
+  return n;
+}
+
+uint16_t ProgAlgBPIFlash::read_word(unsigned int addr)
+{
+  uint16_t w;
+
+  op_read(addr, 1);
+  execute(&w);
+  return w;
+}
+
+void ProgAlgBPIFlash::read_array()
+{
+  op_write(0, (cmdset == CFI_CMDSET_AMD_STD)? AMD_RESET : INTEL_READ_ARRAY);
+  execute(NULL);
+}
+
+/* Return start of the erase block containing byte address addr */
+unsigned int ProgAlgBPIFlash::block_start(unsigned int addr,
+                                          unsigned int *bsize)
+{
+  unsigned int base = 0;
+
+  for (int i = 0; i < nregions; i++)
+    {
+      unsigned int rsize = regions[i].blocks * regions[i].block_size;
+      if (addr < base + rsize)
+        {
+          *bsize = regions[i].block_size;
+          return base + ((addr - base)/regions[i].block_size)
+            * regions[i].block_size;
+        }
+      base += rsize;
+    }
+  *bsize = 0;
+  return addr;
+}
+
+int ProgAlgBPIFlash::bpi_flashinfo(void)
+{
+  uint16_t q[0x30];
+  int i;
+
+  /* Query from any state */
+  op_write(0, INTEL_READ_ARRAY);
+  op_write(0, AMD_RESET);
+  op_write(CFI_QUERY_ADDR, CFI_QUERY);
+  op_read(0x10, 0x30);
+  execute(q);
+  for (i = 0; i < 0x30; i++)
+    q[i] &= 0xff;
+  if (q[0] != 'Q' || q[1] != 'R' || q[2] != 'Y')
+    {
+      fprintf(stderr, "No CFI flash found, BPI bitfile probably not loaded "
+              "(%02x %02x %02x)\n", q[0], q[1], q[2]);
+      return -1;
+    }
+  cmdset = q[0x03] | (q[0x04] << 8);
+  size = 1 << q[0x17];
+  wbuf_words = (1 << (q[0x1a] | (q[0x1b] << 8)))/2;
+  if (wbuf_words < 1)
+    wbuf_words = 1;
+  else if (wbuf_words > 512)
+    wbuf_words = 512;
+  nregions = q[0x1c];
+  if (nregions < 1 || nregions > MAX_REGIONS)
+    {
+      fprintf(stderr, "Unexpected number of CFI erase regions %d\n",
+              nregions);
+      return -1;
+    }
+  for (i = 0; i < nregions; i++)
+    {
+      unsigned int bsize = q[0x1f + 4*i] | (q[0x20 + 4*i] << 8);
+
+      regions[i].blocks = (q[0x1d + 4*i] | (q[0x1e + 4*i] << 8)) + 1;
+      regions[i].block_size = (bsize)? bsize * 256 : 128;
+    }
+
+  /* Read manufacturer and device ID */
+  if (cmdset == CFI_CMDSET_AMD_STD)
+    {
+      op_write(0x555, 0xAA);
+      op_write(0x2AA, 0x55);
+      op_write(0x555, AMD_READ_ID);
+    }
+  else if (cmdset == CFI_CMDSET_INTEL_EXT || cmdset == CFI_CMDSET_INTEL_STD)
+    op_write(0, INTEL_READ_ID);
+  else
+    {
+      fprintf(stderr, "Unsupported CFI command set 0x%04x\n", cmdset);
+      return -1;
+    }
+  op_read(0, 2);
+  execute(q);
+  manf_id = q[0] & 0xff;
+  dev_id = q[1];
+  read_array();
+
+  fprintf(stderr, "CFI: manufacturer 0x%02x device 0x%04x, %s command set\n",
+          manf_id, dev_id,
+          (cmdset == CFI_CMDSET_AMD_STD)? "AMD" : "Intel");
+  fprintf(stderr, "%d bytes total, %d byte write buffer",
+          size, wbuf_words*2);
+  for (i = 0; i < nregions; i++)
+    fprintf(stderr, ", %d x %d kiB", regions[i].blocks,
+            regions[i].block_size/1024);
+  fprintf(stderr, "\n");
+  return 1;
+}
+
+/* Wait at maximum "limit" Milliseconds for the operation at word address
+ * addr to finish and report a '.' every "report" Milliseconds.
+ * For the AMD command set, data is the last word written (0xffff for erase)
+ * retval = 0 : All fine
+ * else Error
+ */
+int ProgAlgBPIFlash::wait_ready(unsigned int addr, uint16_t data, int report,
+                                int limit, double *delta)
+{
+  int j = 0, rc = 1;
+  uint16_t s;
+  struct timeval tv[2];
+
+  gettimeofday(tv, NULL);
+  /* poll every 100 us */
+  while (j < limit * 10)
+    {
+      s = read_word(addr);
+      if (cmdset == CFI_CMDSET_AMD_STD)
+        {
+          if (((s ^ data) & AMD_DQ7) == 0)
+            {
+              rc = 0;
+              break;
+            }
+          if (s & AMD_DQ5)
+            {
+              /* Timeout inside the flash, check once more */
+              s = read_word(addr);
+              if (((s ^ data) & AMD_DQ7) == 0)
+                rc = 0;
+              else
+                {
+                  fprintf(stderr, "\nFlash reports failure at 0x%08x\n",
+                          addr*2);
+                  op_write(0, AMD_RESET);
+                  execute(NULL);
+                }
+              break;
+            }
+        }
+      else if (s & INTEL_READY)
+        {
+          if (s & INTEL_ERRORS)
+            {
+              fprintf(stderr, "\nFlash reports failure at 0x%08x, "
+                      "status 0x%02x%s\n", addr*2, s & 0xff,
+                      (s & 0x02)? " (block locked)" : "");
+              op_write(addr, INTEL_CLEAR_STATUS);
+              execute(NULL);
+            }
+          else
+            rc = 0;
+          break;
+        }
+      jtag->Usleep(100);
+      j++;
+      if ((jtag->getVerbose()) && (report > 0) &&
+          ((j%(report*10)) == (report*10 -1)))
+        {
+          fprintf(stderr,".");
+          fflush(stderr);
+        }
+    }
+  gettimeofday(tv+1, NULL);
+  *delta = deltaT(tv, tv + 1);
+  return rc;
+}
+
+int ProgAlgBPIFlash::erase_block(unsigned int addr)
+{
+  unsigned int waddr = addr/2;
+  double delta;
+
+  if (cmdset == CFI_CMDSET_AMD_STD)
+    {
+      op_write(0x555, 0xAA);
+      op_write(0x2AA, 0x55);
+      op_write(0x555, AMD_ERASE_SETUP);
+      op_write(0x555, 0xAA);
+      op_write(0x2AA, 0x55);
+      op_write(waddr, AMD_SECTOR_ERASE);
+    }
+  else
+    {
+      /* Blocks of Intel style flashes come up locked */
+      op_write(waddr, INTEL_LOCK_SETUP);
+      op_write(waddr, INTEL_CONFIRM);
+      op_write(waddr, INTEL_BLOCK_ERASE);
+      op_write(waddr, INTEL_CONFIRM);
+    }
+  execute(NULL);
+  if (wait_ready(waddr, 0xffff, 500, 8000, &delta))
+    {
+      fprintf(stderr,"\nErase failed for block at 0x%08x\n", addr);
+      return -1;
+    }
+  return 0;
+}
+
+/* Program n words at byte address addr through the write buffer.
+ * The words must not cross a write buffer boundary.
+ */
+int ProgAlgBPIFlash::program_buffer(unsigned int addr, const uint16_t *data,
+                                    int n)
+{
+  unsigned int waddr = addr/2;
+  unsigned int bsize, baddr = block_start(addr, &bsize)/2;
+  double delta;
+
+  if (cmdset == CFI_CMDSET_AMD_STD)
+    {
+      op_write(0x555, 0xAA);
+      op_write(0x2AA, 0x55);
+      op_write(baddr, AMD_WRITE_BUFFER);
+      op_write(baddr, n - 1);
+      op_write_burst(waddr, data, n);
+      op_write(baddr, AMD_BUFFER_CONFIRM);
+    }
+  else
+    {
+      op_write(waddr, INTEL_BUFFER_PROGRAM);
+      op_write(waddr, n - 1);
+      op_write_burst(waddr, data, n);
+      op_write(waddr, INTEL_CONFIRM);
+    }
+  execute(NULL);
+  if (wait_ready(waddr + n - 1, data[n-1], 0, 100, &delta))
+    {
+      fprintf(stderr,"\nProgram failed at 0x%08x\n", addr);
+      return -1;
+    }
+  return 0;
+}
+
+/* Convert len image bytes to words, an odd last byte is padded with 0xff */
+void ProgAlgBPIFlash::file2words(const byte *data, unsigned int len,
+                                 uint16_t *words)
+{
+  for (unsigned int k = 0; 2*k < len; k++)
+    words[k] = data[2*k] | (((2*k + 1 < len)? data[2*k+1] : 0xff) << 8);
+}
+
+int ProgAlgBPIFlash::get_range(BitFile &file, unsigned int *offset,
+                               unsigned int *data_end, bool whole)
+{
+  *offset = file.getOffset();
+  if (*offset & 1)
+    {
+      fprintf(stderr,"BPI offset must be even\n");
+      return -1;
+    }
+  if (*offset >= size)
+    {
+      fprintf(stderr,"Offset greater than flash\n");
+      return -1;
+    }
+  if (file.getRLength() != 0 &&
+      (whole || file.getRLength() < file.getLength()/8))
+    *data_end = *offset + file.getRLength();
+  else if (whole)
+    *data_end = size;
+  else
+    *data_end = *offset + file.getLength()/8;
+  if (*data_end > size)
+    {
+      fprintf(stderr,"Access outside flash area requested, clipping\n");
+      *data_end = size;
+    }
+  return 0;
+}
+
+int ProgAlgBPIFlash::erase(void)
+{
+  unsigned int addr, bsize;
+  struct timeval tv[2];
+
+  gettimeofday(tv, NULL);
+  for (addr = 0; addr < size; addr += bsize)
+    {
+      block_start(addr, &bsize);
+      if(jtag->getVerbose())
+        {
+          fprintf(stderr, "\rErasing block at 0x%08x", addr);
+          fflush(stderr);
+        }
+      if (erase_block(addr))
+        return -1;
+    }
+  read_array();
+  gettimeofday(tv+1, NULL);
+  if(jtag->getVerbose())
+    fprintf(stderr, "\nErase took %.3f s\n", deltaT(tv, tv + 1)/1.0e6);
+  return 0;
+}
+
+int ProgAlgBPIFlash::program(BitFile &pfile)
+{
+  unsigned int offset, data_end, addr, bsize, chunk, i;
+  uint16_t *words;
+  int rc = 0;
+  struct timeval tv[2];
+
+  if (pfile.getLength() == 0)
+    {
+      fprintf(stderr,"Sourcefile empty, aborting\n");
+      return -1;
+    }
+  if (get_range(pfile, &offset, &data_end, false))
+    return -1;
+
+  gettimeofday(tv, NULL);
+  /* Erase all blocks touched by the image */
+  addr = block_start(offset, &bsize);
+  while (addr < data_end && bsize)
+    {
+      if(jtag->getVerbose())
+        {
+          fprintf(stderr, "\rErasing block at 0x%08x", addr);
+          fflush(stderr);
+        }
+      if (erase_block(addr))
+        return -1;
+      addr = block_start(addr + bsize, &bsize);
+    }
+
+  chunk = wbuf_words * 2;
+  words = new uint16_t[wbuf_words];
+  for (i = offset; i < data_end; )
+    {
+      unsigned int end = (i/chunk + 1) * chunk;
+      int k, n;
+
+      if (end > data_end)
+        end = data_end;
+      n = (end - i + 1)/2;
+      file2words(pfile.getData() + i - offset, end - i, words);
+      /* Erased words need not be programmed */
+      for (k = 0; k < n && words[k] == 0xffff; k++)
+        ;
+      if (k < n)
+        {
+          if(jtag->getVerbose() && ((i/chunk) % 64 == 0))
+            {
+              fprintf(stderr, "\r\t\t\tWriting data at 0x%08x "
+                      "(%3d%%)", i, (i - offset)*100/(data_end - offset));
+              fflush(stderr);
+            }
+          if (program_buffer(i, words, n))
+            {
+              rc = -1;
+              break;
+            }
+        }
+      i = end;
+    }
+  delete[] words;
+  read_array();
+  gettimeofday(tv+1, NULL);
+  if (rc == 0 && jtag->getVerbose())
+    fprintf(stderr, "\nProgramming took %.3f s\n", deltaT(tv, tv + 1)/1.0e6);
+  return rc;
+}
+
+/* Read and verify share the pipelined chunk loop: the scan that starts
+ * reading chunk n returns chunk n-1.
+ */
+int ProgAlgBPIFlash::read(BitFile &rfile)
+{
+  unsigned int offset, data_end, i, k, prev = 0, prev_n = 0;
+  uint16_t *rbuf = new uint16_t[MAX_READ];
+  byte *data;
+
+  if (get_range(rfile, &offset, &data_end, true))
+    {
+      delete[] rbuf;
+      return -1;
+    }
+  rfile.setLength((data_end - offset) * 8);
+  data = rfile.getData();
+  read_array();
+  for (i = offset; prev_n || i == offset; i += 2*MAX_READ)
+    {
+      unsigned int n = 0;
+
+      if (i < data_end)
+        {
+          n = (data_end - i + 1)/2;
+          if (n > (unsigned int)MAX_READ)
+            n = MAX_READ;
+          op_read(i/2, n);
+        }
+      scan(rbuf, prev_n);
+      for (k = 0; k < prev_n; k++)
+        {
+          unsigned int b = prev - offset + 2*k;
+          data[b] = rbuf[k] & 0xff;
+          if (prev + 2*k + 1 < data_end)
+            data[b + 1] = rbuf[k] >> 8;
+        }
+      if(jtag->getVerbose() && n)
+        {
+          fprintf(stderr, "\rReading at 0x%08x (%3d%%)", i,
+                  (i - offset)*100/(data_end - offset));
+          fflush(stderr);
+        }
+      prev = i;
+      prev_n = n;
+    }
+  if(jtag->getVerbose())
+    fprintf(stderr, "\n");
+  delete[] rbuf;
+  return 0;
+}
+
+/* return 0 on success, anything else on failure */
+int ProgAlgBPIFlash::verify(BitFile &vfile)
+{
+  unsigned int offset, data_end, i, prev = 0, prev_n = 0;
+  uint16_t *rbuf = new uint16_t[MAX_READ];
+  uint16_t *fbuf = new uint16_t[MAX_READ];
+  int errors = 0;
+
+  if (get_range(vfile, &offset, &data_end, false))
+    {
+      errors = 1;
+      goto v_cleanup;
+    }
+  read_array();
+  for (i = offset; prev_n || i == offset; i += 2*MAX_READ)
+    {
+      unsigned int n = 0;
+
+      if (i < data_end)
+        {
+          n = (data_end - i + 1)/2;
+          if (n > (unsigned int)MAX_READ)
+            n = MAX_READ;
+          op_read(i/2, n);
+        }
+      scan(rbuf, prev_n);
+      if (prev_n)
+        {
+          unsigned int k, end = prev + 2*prev_n;
+
+          if (end > data_end)
+            end = data_end;
+          file2words(vfile.getData() + prev - offset, end - prev, fbuf);
+          /* An odd last byte only has the low half in the image */
+          if ((end - prev) & 1)
+            fbuf[prev_n - 1] = (fbuf[prev_n - 1] & 0xff) |
+              (rbuf[prev_n - 1] & 0xff00);
+          for (k = 0; k < prev_n; k++)
+            if (rbuf[k] != fbuf[k])
+              {
+                fprintf(stderr, "\nVerify failed at 0x%08x read 0x%04x "
+                        "file 0x%04x\n", prev + 2*k, rbuf[k], fbuf[k]);
+                if (++errors > 5)
+                  goto v_cleanup;
+              }
+        }
+      if(jtag->getVerbose() && n)
+        {
+          fprintf(stderr, "\rVerifying at 0x%08x (%3d%%)", i,
+                  (i - offset)*100/(data_end - offset));
+          fflush(stderr);
+        }
+      prev = i;
+      prev_n = n;
+    }
+  if(jtag->getVerbose())
+    fprintf(stderr, "\n");
+  if (errors)
+    fprintf(stderr, "Verify: Failure!\n");
+  else
+    fprintf(stderr, "Verify: Success!\n");
+ v_cleanup:
+  delete[] rbuf;
+  delete[] fbuf;
+  return errors;
+}
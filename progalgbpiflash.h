@@ -0,0 +1,91 @@
+/* BPI (parallel NOR) Flash JTAG programming algorithms
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+The flash is accessed through the bscan_bpi core, see bscan_bpi/README.txt
+
+*/
+
+#ifndef  PROGALGBPIFLASH_H
+#define  PROGALGBPIFLASH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bitfile.h"
+#include "jtag.h"
+
+typedef unsigned char byte;
+
+class ProgAlgBPIFlash
+{
+ private:
+  static const byte USER1;
+
+  /* Maximum number of op words in one scan and of words read in one scan */
+  static const int MAX_OPS = 4096;
+  static const int MAX_READ = 1024;
+  static const int MAX_REGIONS = 4;
+
+  Jtag *jtag;
+  FILE *fp_dbg;
+  uint16_t *ops;
+  int nops;
+  int nreads;
+  byte *tdi;
+  byte *tdo;
+
+  /* Geometry from the CFI query, sizes in bytes */
+  unsigned int size;
+  unsigned int wbuf_words;
+  int cmdset;
+  int manf_id;
+  int dev_id;
+  int nregions;
+  struct
+  {
+    unsigned int blocks;
+    unsigned int block_size;
+  } regions[MAX_REGIONS];
+
+  void op_addr(unsigned int addr);
+  void op_write(unsigned int addr, uint16_t data);
+  void op_write_burst(unsigned int addr, const uint16_t *data, int n);
+  void op_read(unsigned int addr, int n);
+  int scan(uint16_t *result, int nresult);
+  int execute(uint16_t *rdata);
+  uint16_t read_word(unsigned int addr);
+  unsigned int block_start(unsigned int addr, unsigned int *bsize);
+  void read_array();
+  int wait_ready(unsigned int addr, uint16_t data, int report, int limit,
+                 double *delta);
+  int erase_block(unsigned int addr);
+  int program_buffer(unsigned int addr, const uint16_t *data, int n);
+  void file2words(const byte *data, unsigned int len, uint16_t *words);
+  int get_range(BitFile &file, unsigned int *offset, unsigned int *data_end,
+                bool whole);
+
+ public:
+  ProgAlgBPIFlash(Jtag &j);
+  ~ProgAlgBPIFlash(void);
+  int bpi_flashinfo(void);
+  unsigned int getSize() const { return size; }
+  int erase(void);
+  int program(BitFile &file);
+  int verify(BitFile &file);
+  int read(BitFile &file);
+  void disable(){};
+};
+#endif /*PROGALGBPIFLASH_H */
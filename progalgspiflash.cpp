@@ -20,16 +20,20 @@ Code based on http://code.google.com/p/xilprg-hunz/
 
 */
 #include <sys/time.h>
+#include <unistd.h>
 
 #include "progalgspiflash.h"
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
 
 #include "bitrev.h"
+#include "crc32.h"
 
 const byte ProgAlgSPIFlash::USER1=0x02;
 const byte ProgAlgSPIFlash::USER2=0x03;
+const byte ProgAlgSPIFlash::USER3=0x22; /* 7-series */
 const byte ProgAlgSPIFlash::JSTART=0x0c;
 const byte ProgAlgSPIFlash::JSHUTDOWN=0x0d;
 const byte ProgAlgSPIFlash::CFG_IN=0x05;
@@ -50,9 +54,34 @@ const byte ProgAlgSPIFlash::BYPASS=0xff;
 #define AT45_SECTOR_ERASE    0x7C
 #define SECTOR_LOCKDOWN_READ 0x35
 #define AT45_READ_STATUS     0xD7
+#define AT45_BUFFER1_WRITE   0x84
+#define AT45_BUFFER2_WRITE   0x87
+#define AT45_BUFFER1_PROGRAM 0x83 /* Buffer to page program with erase */
+#define AT45_BUFFER2_PROGRAM 0x86
 
 #define AT45_READY            0x01
 
+/* Per flash buffer size in dual mode */
+#define DUAL_BUFSIZE         2505
+
+/* bscan_spi core signature in USER2, see bscan_xc7_spi_v2.v */
+#define CORE_SIGNATURE       0x5350
+#define V2_STATUS_MAGIC      0x5632
+#define V2_BUSY              0x100
+#define V2_ERROR             0x200
+#define V2_CMD_NOP           0x00
+#define V2_CMD_PROGRAM       0x01
+#define V2_CMD_READ          0x02
+#define V2_CMD_CRC           0x03
+/* Bytes per CRC command, the core counts in 256 byte units */
+#define V2_CRC_CHUNK         (1 << 20)
+#define V2_FLAG_QUAD         0x01
+#define V2_FLAG_ADDR4        0x02
+/* Bytes read at once when streaming to a file */
+#define READ_CHUNK           (1 << 18)
+/* Size of FIFO and read buffer of the v2 core */
+#define V2_BUFSIZE           2048
+
 /* Block protect bits */
 #define BP0 0x04
 #define BP1 0x08
@@ -67,6 +96,14 @@ ProgAlgSPIFlash::ProgAlgSPIFlash(Jtag &j)
       fp_dbg = NULL;
   jtag=&j;
   buf = 0;
+  journal = 0;
+  dual = 0;
+  dual_split = 0;
+  dual_buf = 0;
+  core_version = 1;
+  quad_read = 0;
+  crc_verify = 0;
+  addr4 = 0;
   miso_buf = new byte[5010];
   mosi_buf = new byte[5010];
   sector_size =  65536; /* Many devices have 64 kiByte sectors*/
@@ -78,6 +115,7 @@ ProgAlgSPIFlash::~ProgAlgSPIFlash(void)
   delete[] miso_buf;
   delete[] mosi_buf;
   if(buf) delete[] buf;
+  if(dual_buf) delete[] dual_buf;
   if(fp_dbg)
     fclose(fp_dbg);
 }
@@ -219,6 +257,9 @@ int ProgAlgSPIFlash::spi_flashinfo_w25(unsigned char *buf)
     case 0x19:
       pages = 2*65536;
       break;
+    case 0x20:
+      pages = 4*65536;
+      break;
     default:
       fprintf(stderr,"Unexpected W25 size ID 0x%02x\n", buf[2]);
       return -1;
@@ -374,6 +415,14 @@ int ProgAlgSPIFlash::spi_flashinfo_m25p_mx25l(unsigned char *buf, int is_mx25l)
             pages = 262144;
             sector_size = 65536;
             break;
+          case 0x19:
+            pages = 131072;
+            sector_size = 65536;
+            break;
+          case 0x1a:
+            pages = 262144;
+            sector_size = 65536;
+            break;
           default:
             fprintf(stderr,"Unexpected MX25L size ID 0x%02x\n", buf[2]);
             return -1;
@@ -441,6 +490,7 @@ int ProgAlgSPIFlash::spi_flashinfo_m25p_mx25l(unsigned char *buf, int is_mx25l)
           break;
 
       case 0xba:
+      case 0xbb:
         fprintf(stderr, "Found Numonyx N25Q Device, Device ID 0x%02x%02x\n",
                 fbuf[1], fbuf[2]);
         switch (fbuf[2])
@@ -453,6 +503,18 @@ int ProgAlgSPIFlash::spi_flashinfo_m25p_mx25l(unsigned char *buf, int is_mx25l)
             pages = 65536;
             sector_size = 65536;
             break;
+          case 0x19:
+            pages = 131072;
+            sector_size = 65536;
+            break;
+          case 0x20:
+            pages = 262144;
+            sector_size = 65536;
+            break;
+          case 0x21:
+            pages = 524288;
+            sector_size = 65536;
+            break;
           default:
             fprintf(stderr,"Unexpected N25Q size ID 0x%02x\n", buf[2]);
             return -1;
@@ -537,6 +599,9 @@ int ProgAlgSPIFlash::spi_flashinfo(void)
   byte fbuf[8]={READ_IDENTIFICATION, 0, 0, 0, 0, 0, 0, 0};
   int res;
   
+  dual_split = 0;
+  addr4 = 0;
+  core_version = (dual)? 1 : detect_core();
   // send JEDEC info
   spi_xfer_user1(NULL,0,0,fbuf,4,1);
 
@@ -545,7 +610,21 @@ int ProgAlgSPIFlash::spi_flashinfo(void)
   spi_xfer_user1(NULL,0,0,fbuf,4,1);
   
   // read result
-  spi_xfer_user1(fbuf,4,1,NULL, 0, 0);
+  if (dual)
+    {
+      byte fbuf1[4];
+
+      spi_xfer_user1_dual(fbuf, fbuf1, 4, 1, NULL, NULL, 0, 0);
+      if (memcmp(fbuf, fbuf1, 3))
+        {
+          fprintf(stderr, "Dual flash: second flash differs, JEDEC: "
+                  "%02x %02x 0x%02x\n", bitRevTable[fbuf1[0]],
+                  bitRevTable[fbuf1[1]], bitRevTable[fbuf1[2]]);
+          return -1;
+        }
+    }
+  else
+    spi_xfer_user1(fbuf,4,1,NULL, 0, 0);
   
   fbuf[0] = bitRevTable[fbuf[0]];
   fbuf[1] = bitRevTable[fbuf[1]];
@@ -601,12 +680,42 @@ int ProgAlgSPIFlash::spi_flashinfo(void)
       fprintf(stderr, "unknown JEDEC manufacturer: %02x\n",fbuf[0]);
       return -1;
     }
+  if (res == 1 && dual)
+    {
+      if (manf_id == 0x1f || manf_id == 0xbf)
+        {
+          fprintf(stderr, "Dual flash mode not supported for this flash\n");
+          return -1;
+        }
+      /* From now on both flashes look like one with double page size */
+      dual_split = 1;
+      pgsize *= 2;
+      sector_size *= 2;
+      fprintf(stderr, "Dual flash: ");
+    }
   if (res == 1)
     {
-      fprintf(stderr, "%d bytes/page, %d pages = %d bytes total \n",
+      fprintf(stderr, "%d bytes/page, %d pages = %u bytes total \n",
 	      pgsize, pages, pgsize *  pages);
+      /* Beyond 16 MiB per flash use the 4 byte address opcodes, the flash
+         stays in 3 byte mode for the FPGA to boot */
+      if ((uint64_t)pages * ((dual_split)? pgsize/2 : pgsize) > 0x1000000)
+        {
+          addr4 = 1;
+          fprintf(stderr, "Using 4 byte addresses\n");
+        }
+      if (buf)
+        delete[] buf;
       buf = new byte[pgsize+16];
+      if (core_version >= 2)
+        {
+          quad_read = quad_read_ok();
+          fprintf(stderr, "Using bscan_spi v2 core%s\n",
+                  (quad_read)? " with quad output read" : "");
+        }
     }
+  else
+    core_version = 1; /* v2 core only handles plain page program flashes */
   if (!buf)
       return -1;
   return res;
@@ -642,6 +751,10 @@ int ProgAlgSPIFlash::spi_xfer_user1
 {
   int cnt, rc, maxlen = miso_len+miso_skip;
   
+  if (dual)
+    return spi_xfer_user1_split(last_miso, miso_len, miso_skip,
+                                mosi, mosi_len, preamble);
+
   if(mosi) {
     if(mosi_len + preamble + 4 + 2 > maxlen)
       maxlen = mosi_len + preamble + 4 + 2;
@@ -711,6 +824,410 @@ int ProgAlgSPIFlash::spi_xfer_user1
   return rc;
 }
 
+/* Dual flash operation (bscan_xc7_spi_dual.vhd)
+ *
+ * Two flashes share clock and chip select. After the usual header, the
+ * core takes two TDI bits per SPI clock, the first for flash 0 and the
+ * second for flash 1, and returns MISO of both flashes in the same order.
+ *
+ * The configuration image is split nibble wise, like the FPGA reads it in
+ * SPIx8 mode: for each pair of image bytes a, b flash 0 receives
+ * (a & 0xf0) | (b >> 4) and flash 1 receives (a << 4) | (b & 0x0f).
+ * Both flashes are seen as one flash with doubled page and sector size.
+ */
+
+static uint16_t spread_bits(uint8_t in)
+{
+  uint16_t out = 0;
+  for (int i = 0; i < 8; i++)
+    if (in & (1 << i))
+      out |= 1 << (2*i);
+  return out;
+}
+
+static uint8_t gather_bits(uint16_t in)
+{
+  uint8_t out = 0;
+  for (int i = 0; i < 8; i++)
+    if (in & (1 << (2*i)))
+      out |= 1 << i;
+  return out;
+}
+
+void ProgAlgSPIFlash::setDual(bool on)
+{
+  dual = (on)? 1 : 0;
+  if (dual && !dual_buf)
+    dual_buf = new byte[4 * DUAL_BUFSIZE];
+}
+
+/* Raw transfer, mosi0/mosi1 and the miso buffers hold data for one flash
+ * each, laid out like for spi_xfer_user1. mosi0 and mosi1 may be the same.
+ */
+int ProgAlgSPIFlash::spi_xfer_user1_dual
+(uint8_t *last_miso0, uint8_t *last_miso1, int miso_len, int miso_skip,
+ const uint8_t *mosi0, const uint8_t *mosi1, int mosi_len, int preamble)
+{
+  int cnt, rc, maxlen = 2*(miso_len+miso_skip);
+  int n = mosi_len + preamble;
+
+  assert(2*n + 6 + 1 <= 5010 && 2*(miso_len+miso_skip) <= 5010);
+  if(mosi0) {
+    /* one extra byte to clock out the last SPI bit */
+    if(2*n + 6 + 1 > maxlen)
+      maxlen = 2*n + 6 + 1;
+    mosi_buf[0]=0x59;
+    mosi_buf[1]=0xa6;
+    mosi_buf[2]=0x59;
+    mosi_buf[3]=0xa6;
+    mosi_buf[4]=(n*16)>>8;
+    mosi_buf[5]=(n*16)&0xff;
+    for(cnt=0;cnt<6;cnt++)
+      mosi_buf[cnt]=bitRevTable[mosi_buf[cnt]];
+
+    for(cnt=0;cnt<n;cnt++)
+      {
+        uint8_t w0 = (cnt < preamble)? bitRevTable[mosi0[cnt]] : mosi0[cnt];
+        uint8_t w1 = (cnt < preamble)? bitRevTable[mosi1[cnt]] : mosi1[cnt];
+        uint16_t v = spread_bits(w0) | (spread_bits(w1) << 1);
+        mosi_buf[6+2*cnt] = v & 0xff;
+        mosi_buf[7+2*cnt] = v >> 8;
+      }
+    mosi_buf[6+2*n] = 0;
+  }
+
+  rc=xc_user((mosi0)?mosi_buf:NULL,(last_miso0||last_miso1)?miso_buf:NULL,
+             maxlen*8);
+
+  for(cnt=0; cnt<miso_len; cnt++)
+    {
+      uint16_t v = miso_buf[2*(cnt+miso_skip)] |
+        (miso_buf[2*(cnt+miso_skip)+1] << 8);
+      if (last_miso0)
+        last_miso0[cnt] = gather_bits(v);
+      if (last_miso1)
+        last_miso1[cnt] = gather_bits(v >> 1);
+    }
+
+  if(fp_dbg && mosi0 && n)
+    {
+      fprintf(fp_dbg,"In0");
+      for (cnt=0; cnt<n && cnt<32; cnt++)
+        fprintf(fp_dbg," %02x", mosi0[cnt]);
+      fprintf(fp_dbg,"\nIn1");
+      for (cnt=0; cnt<n && cnt<32; cnt++)
+        fprintf(fp_dbg," %02x", mosi1[cnt]);
+      fprintf(fp_dbg,"\n");
+    }
+  return rc;
+}
+
+/* spi_xfer_user1 in dual mode. Before the flashes are identified, both get
+ * the same data and flash 0 answers. Afterwards the payload is split between
+ * and merged from both flashes, the preamble is sent to both.
+ */
+int ProgAlgSPIFlash::spi_xfer_user1_split
+(uint8_t *last_miso, int miso_len, int miso_skip, uint8_t *mosi,
+ int mosi_len, int preamble)
+{
+  byte *out0 = dual_buf, *out1 = dual_buf + DUAL_BUFSIZE;
+  byte *in0 = dual_buf + 2*DUAL_BUFSIZE, *in1 = dual_buf + 3*DUAL_BUFSIZE;
+  int cnt, rc, n, m;
+
+  if (!dual_split)
+    return spi_xfer_user1_dual(last_miso, NULL, miso_len, miso_skip,
+                               mosi, mosi, mosi_len, preamble);
+
+  n = (mosi_len + 1)/2;
+  m = (miso_len + 1)/2;
+  assert(n + preamble <= DUAL_BUFSIZE && m <= DUAL_BUFSIZE);
+  if (mosi)
+    {
+      memcpy(out0, mosi, preamble);
+      memcpy(out1, mosi, preamble);
+      for (cnt = 0; cnt < n; cnt++)
+        {
+          /* data is kept bit reversed, split the bytes as seen by the flash */
+          byte a = bitRevTable[mosi[preamble + 2*cnt]];
+          byte b = (2*cnt + 1 < mosi_len)?
+            bitRevTable[mosi[preamble + 2*cnt + 1]] : 0xff;
+          out0[preamble + cnt] = bitRevTable[(a & 0xf0) | (b >> 4)];
+          out1[preamble + cnt] = bitRevTable[((a << 4) & 0xf0) | (b & 0x0f)];
+        }
+    }
+  rc = spi_xfer_user1_dual((last_miso)? in0 : NULL, (last_miso)? in1 : NULL,
+                           m, miso_skip, (mosi)? out0 : NULL, out1,
+                           n, preamble);
+  if (last_miso)
+    {
+      for (cnt = 0; cnt < m; cnt++)
+        {
+          byte f0 = bitRevTable[in0[cnt]];
+          byte f1 = bitRevTable[in1[cnt]];
+          last_miso[2*cnt] = bitRevTable[(f0 & 0xf0) | (f1 >> 4)];
+          if (2*cnt + 1 < miso_len)
+            last_miso[2*cnt + 1] =
+              bitRevTable[((f0 << 4) & 0xf0) | (f1 & 0x0f)];
+        }
+    }
+  return rc;
+}
+
+/* Read the signature of the bscan_spi core from USER2:
+ * bits 31:16 "SP", 15:8 protocol version, 7:0 variant (1 = dual flash)
+ * Returns 0 if there is no core with a signature
+ */
+uint32_t ProgAlgSPIFlash::readCoreSignature(void)
+{
+  byte tdi[4] = {0, 0, 0, 0};
+  byte tdo[4];
+  uint32_t sig;
+
+  jtag->shiftIR(&USER2);
+  jtag->shiftDR(tdi, tdo, 32);
+  sig = tdo[0] | (tdo[1] << 8) | (tdo[2] << 16) | ((uint32_t)tdo[3] << 24);
+  if ((sig >> 16) != CORE_SIGNATURE)
+    return 0;
+  return sig;
+}
+
+/* Returns the protocol version of the core, 1 if there is no signature */
+int ProgAlgSPIFlash::detect_core(void)
+{
+  uint32_t sig = readCoreSignature();
+
+  if (sig == 0)
+    return 1;
+  return (sig >> 8) & 0xff;
+}
+
+/* Quad output read (0x6B) needs support and, for some vendors, the QE bit */
+int ProgAlgSPIFlash::quad_read_ok(void)
+{
+  byte fbuf[4] = {0, 0, 0, 0};
+
+  switch (manf_id)
+    {
+    case 0x20: /* N25Q has quad read always enabled, M25P has none */
+      return ((prod_id >> 8) == 0xba || (prod_id >> 8) == 0xbb);
+    case 0xef: /* Winbond: QE is bit 1 of status register 2 */
+      fbuf[0] = 0x35;
+      break;
+    case 0xc2: /* Macronix: QE is bit 6 of the status register */
+      fbuf[0] = READ_STATUS_REGISTER;
+      break;
+    default:
+      return 0;
+    }
+  spi_xfer_user1(NULL,0,0,fbuf, 1, 1);
+  spi_xfer_user1(fbuf,1,1,NULL, 0, 0);
+  fbuf[0] = bitRevTable[fbuf[0]];
+  return (manf_id == 0xef)? (fbuf[0] & 0x02) != 0 : (fbuf[0] & 0x40) != 0;
+}
+
+/* One scan on the v2 command channel: send command with len data bytes and
+ * get the status word and rlen bytes of the read buffer, both from before
+ * the command starts.
+ */
+int ProgAlgSPIFlash::v2_xfer(byte cmd, unsigned int addr, const byte *data,
+                             int len, byte *rdata, int rlen, uint32_t *status)
+{
+  /* For READ, len is the number of bytes to read and no data follows */
+  int nbytes = 8 + ((data)? len : 0);
+  byte flags = ((quad_read)? V2_FLAG_QUAD : 0) | ((addr4)? V2_FLAG_ADDR4 : 0);
+
+  if (nbytes < 4 + rlen)
+    nbytes = 4 + rlen;
+  assert(len <= V2_BUFSIZE && rlen <= V2_BUFSIZE);
+  memset(mosi_buf, 0, nbytes);
+  mosi_buf[0] = cmd;
+  mosi_buf[1] = flags;
+  mosi_buf[2] = addr & 0xff;
+  mosi_buf[3] = (addr >> 8) & 0xff;
+  mosi_buf[4] = (addr >> 16) & 0xff;
+  mosi_buf[5] = (addr >> 24) & 0xff;
+  mosi_buf[6] = len & 0xff;
+  mosi_buf[7] = len >> 8;
+  if (data)
+    memcpy(mosi_buf + 8, data, len);
+  jtag->shiftIR(&USER3);
+  jtag->shiftDR(mosi_buf, miso_buf, nbytes*8);
+  *status = miso_buf[0] | (miso_buf[1] << 8) | (miso_buf[2] << 16) |
+    ((uint32_t)miso_buf[3] << 24);
+  if ((*status >> 16) != V2_STATUS_MAGIC)
+    {
+      fprintf(stderr, "\nbscan_spi v2 core not responding (0x%08x)\n",
+              *status);
+      return -1;
+    }
+  if (rdata && rlen)
+    memcpy(rdata, miso_buf + 4, rlen);
+  if (fp_dbg)
+    fprintf(fp_dbg, "V2 cmd %02x addr %06x len %d status %08x\n",
+            cmd, addr, len, *status);
+  return 0;
+}
+
+/* Poll the v2 core for at most "limit" Milliseconds until it is idle
+ * retval = 0 : All fine
+ * else Error
+ */
+int ProgAlgSPIFlash::v2_wait(int limit)
+{
+  uint32_t status;
+  int j;
+
+  for (j = 0; j < limit * 10; j++)
+    {
+      if (v2_xfer(V2_CMD_NOP, 0, NULL, 0, NULL, 0, &status))
+        return -1;
+      if (!(status & V2_BUSY))
+        {
+          if (status & V2_ERROR)
+            {
+              /* the core keeps the status byte in bus order */
+              fprintf(stderr, "\nbscan_spi v2 core: timeout, flash status "
+                      "0x%02x\n", status & 0xff);
+              return -1;
+            }
+          return 0;
+        }
+      jtag->Usleep(100);
+    }
+  fprintf(stderr, "\nbscan_spi v2 core stays busy\n");
+  return -1;
+}
+
+/* Let the v2 core program len bytes, len <= V2_BUFSIZE, page aligned start */
+int ProgAlgSPIFlash::program_v2(unsigned int addr, const byte *data, int len)
+{
+  uint32_t status;
+
+  if (v2_xfer(V2_CMD_PROGRAM, addr, data, len, NULL, 0, &status))
+    return -1;
+  /* 8 pages at up to 5 ms each */
+  return v2_wait(50 * ((len + 255)/256));
+}
+
+/* Read len bytes at addr with the v2 core. The scan that starts reading a
+ * chunk also returns the previous one. start and total describe the whole
+ * read for the progress display.
+ */
+int ProgAlgSPIFlash::read_v2(byte *dest, unsigned int addr, unsigned int len,
+                             unsigned int start, unsigned int total)
+{
+  unsigned int i, n, prev_n = 0;
+  byte *prev = NULL;
+  uint32_t status;
+
+  for (i = addr; i < addr + len || prev_n; i += n)
+    {
+      n = (i < addr + len)? addr + len - i : 0;
+      if (n > V2_BUFSIZE)
+        n = V2_BUFSIZE;
+      if (prev_n && v2_wait(100))
+        return -1;
+      if (v2_xfer((n)? V2_CMD_READ : V2_CMD_NOP, i, NULL, n,
+                  prev, prev_n, &status))
+        return -1;
+      /* nothing to read with the first scan, data of this chunk follows */
+      prev = dest + (i - addr);
+      prev_n = n;
+      if(jtag->getVerbose() && n)
+        {
+          fprintf(stderr, "\rReading at 0x%06x (%3d%%)", i,
+                  (int)((uint64_t)(i - start)*100/total));
+          fflush(stderr);
+        }
+    }
+  return 0;
+}
+
+/* Let the v2 core calculate the CRC-32 of len bytes at addr, len a multiple
+ * of 256 and at most 0xffff00
+ */
+int ProgAlgSPIFlash::crc_v2(unsigned int addr, unsigned int len, uint32_t *crc)
+{
+  byte rdata[4];
+  uint32_t status;
+
+  if (v2_xfer(V2_CMD_CRC, addr, NULL, len >> 8, NULL, 0, &status))
+    return -1;
+  /* 1 MiB takes about 250 ms with single bit reads */
+  if (v2_wait(1000 + (len >> 10)))
+    return -1;
+  if (v2_xfer(V2_CMD_NOP, 0, NULL, 0, rdata, 4, &status))
+    return -1;
+  *crc = rdata[0] | (rdata[1] << 8) | (rdata[2] << 16) |
+    ((uint32_t)rdata[3] << 24);
+  return 0;
+}
+
+/* Compare flash and file by CRC-32 in V2_CRC_CHUNK sized parts, the tail
+ * that is no multiple of 256 bytes is read back.
+ * Returns the number of differing parts.
+ */
+int ProgAlgSPIFlash::verify_crc(const byte *data, unsigned int offset,
+                                unsigned int len)
+{
+  unsigned int i, n;
+  uint32_t fcrc, dcrc;
+  int k = 0;
+
+  for (i = 0; i < (len & ~0xffU); i += n)
+    {
+      n = (len & ~0xffU) - i;
+      if (n > V2_CRC_CHUNK)
+        n = V2_CRC_CHUNK;
+      if(jtag->getVerbose())
+        {
+          fprintf(stderr, "\rVerifying CRC at 0x%06x (%3d%%)", offset + i,
+                  (int)((uint64_t)i * 100 / len));
+          fflush(stderr);
+        }
+      if (crc_v2(offset + i, n, &dcrc))
+        return k + 1;
+      fcrc = crc32_update_rev(0, data + i, n);
+      if (fcrc != dcrc)
+        {
+          fprintf(stderr, "\nVerify failed for 0x%06x-0x%06x: "
+                  "flash CRC %08x, file CRC %08x\n",
+                  offset + i, offset + i + n - 1, dcrc, fcrc);
+          k++;
+        }
+    }
+  if (i < len)
+    {
+      byte rdata[256];
+
+      if (read_v2(rdata, offset + i, len - i, offset + i, len - i))
+        return k + 1;
+      if (memcmp(rdata, data + i, len - i))
+        {
+          fprintf(stderr, "\nVerify failed for 0x%06x-0x%06x\n",
+                  offset + i, offset + len - 1);
+          k++;
+        }
+    }
+  if(jtag->getVerbose())
+    fprintf(stderr, "\n");
+  return k;
+}
+
+/* Send command and return the status byte of each flash in rbuf.
+ * Returns the number of status bytes
+ */
+int ProgAlgSPIFlash::read_status(byte *fbuf, byte *rbuf)
+{
+  if (dual)
+    {
+      spi_xfer_user1_dual(rbuf, rbuf + 1, 1, 1, fbuf, fbuf, 1, 1);
+      return 2;
+    }
+  spi_xfer_user1(rbuf,1,1,fbuf, 1, 1);
+  return 1;
+}
+
 int ProgAlgSPIFlash::xc_user(byte *in, byte *out, int len)
 {
   jtag->shiftIR(&USER1);
@@ -718,55 +1235,87 @@ int ProgAlgSPIFlash::xc_user(byte *in, byte *out, int len)
   return 0;
 }
 
-void page2padd(byte *buf, int page, int pgsize)
+/* Fill in the address of page after the command in buf[0]. With 4 byte
+ * addresses, buf[0] is changed to the matching 4 byte opcode.
+ * Returns the length of command and address.
+ */
+int ProgAlgSPIFlash::page2padd(byte *buf, unsigned int page)
 {
+    /* In dual mode the page number is the same for both flashes */
+    unsigned int size = (dual_split)? pgsize/2 : pgsize;
+
     if (buf == NULL)
-        return;
+        return 0;
+
+    if (addr4)
+    {
+        switch (buf[0])
+        {
+        case PAGE_READ:    buf[0] = 0x13; break;
+        case 0x0B:         buf[0] = 0x0C; break; /* fast read */
+        case PAGE_PROGRAM: buf[0] = 0x12; break;
+        case SECTOR_ERASE: buf[0] = 0xDC; break;
+        case 0x20:         buf[0] = 0x21; break; /* 4 kiB erase */
+        case 0x52:         buf[0] = 0x5C; break; /* 32 kiB erase */
+        }
+        buf[1] = page >> 16;
+        buf[2] = page >> 8;
+        buf[3] = page & 0xff;
+        buf[4] = 0;
+        return 5;
+    }
 
     // see UG333 page 19
-    if(pgsize>512)
+    if(size>512)
       page<<=2;
-    else if (pgsize > 256)
+    else if (size > 256)
       page<<=1;
     
     buf[1] = page >> 8;
     buf[2] = page & 0xff;
     buf[3] = 0;
+    return 4;
 }
 
-/* read full pages
- * Writing of bitfile will delete trailing 0xff's
- */
-
-int ProgAlgSPIFlash::read(BitFile &rfile) 
+/* Range of a read request, offset page aligned and clipped to the flash */
+int ProgAlgSPIFlash::read_limits(BitFile &rfile, unsigned int *offset,
+                                 unsigned int *len)
 {
-    unsigned int offset, len , data_end, i, rc=0;
-    unsigned int rlen;
-    int l;
-    byte buf[4]= {PAGE_READ, 0, 0, 0};
+    unsigned int data_end;
 
-    offset = (rfile.getOffset()/pgsize) * pgsize;
-    if (offset > pages * pgsize)
+    *offset = (rfile.getOffset()/pgsize) * pgsize;
+    if (*offset > pages * pgsize)
     {
         fprintf(stderr,"Offset greater than PROM\n");
         return -1;
     }
     if (rfile.getRLength() != 0)
-    {
-        data_end = offset + rfile.getRLength();
-        len  =  rfile.getRLength();
-    }
+        data_end = *offset + rfile.getRLength();
     else
-    {
         data_end = pages * pgsize;
-        len  = data_end - offset;
-    }
-    if (len  > pages * pgsize)
+    if (data_end > pages * pgsize)
     {
         fprintf(stderr,"Read outside PROM arearequested, clipping\n");
         data_end = pages* pgsize;
     }
-    rfile.setLength(len * 8);
+    *len = data_end - *offset;
+    return 0;
+}
+
+/* Read len bytes at the page aligned offset into dest. start and total
+ * describe the whole read for the progress display.
+ */
+int ProgAlgSPIFlash::read_range(byte *dest, unsigned int offset,
+                                unsigned int len, unsigned int start,
+                                unsigned int total)
+{
+    unsigned int data_end = offset + len, i;
+    unsigned int rlen = 0;
+    int l, plen = 4;
+    byte buf[5]= {PAGE_READ, 0, 0, 0, 0};
+
+    if (core_version >= 2)
+        return read_v2(dest, offset, len, start, total);
     l = -pgsize;
     for(i = offset; i < data_end+pgsize; i+= pgsize)
     {
@@ -776,33 +1325,103 @@ int ProgAlgSPIFlash::read(BitFile &rfile)
         if(jtag->getVerbose())
         {
             fprintf(stderr, "\rReading page %6d/%6d at flash page %6d",
-                    (l+ 2*pgsize -1)/pgsize , (len+pgsize -1)/pgsize, 
+                    (i - start + pgsize -1)/pgsize, (total+pgsize -1)/pgsize,
                     (i+pgsize -1)/pgsize); 
             fflush(stderr);
         }
-        page2padd(buf, i/pgsize, pgsize);
+        if (i < data_end)
+            plen = page2padd(buf, i/pgsize);
         if (l < 0) /* don't write when sending first page*/
-            spi_xfer_user1(NULL, 0, 0, buf, rlen, 4);
+            spi_xfer_user1(NULL, 0, 0, buf, rlen, plen);
         else if (i >= data_end)
-            spi_xfer_user1(rfile.getData()+l, rlen, 4, NULL, 0, 0);
+            spi_xfer_user1(dest+l, rlen, plen, NULL, 0, 0);
         else
-            spi_xfer_user1(rfile.getData()+l, pgsize, 4, buf, rlen, 4);
+            spi_xfer_user1(dest+l, pgsize, plen, buf, rlen, plen);
         l+= pgsize;
     }
-  
+    return 0;
+}
+
+/* read full pages
+ * Writing of bitfile will delete trailing 0xff's
+ */
+
+int ProgAlgSPIFlash::read(BitFile &rfile) 
+{
+    unsigned int offset, len;
+    int rc;
+
+    if (read_limits(rfile, &offset, &len))
+        return -1;
+    rfile.setLength(len * 8);
+    rc = read_range(rfile.getData(), offset, len, offset, len);
     fprintf(stderr, "\n");
     return rc;
 }
 
-/* return 0 on success, anything else on failure */
+/* Read like above, but hand the data to out chunk by chunk instead of
+ * keeping the whole image in memory
+ */
+int ProgAlgSPIFlash::read(BitFile &rfile, BitFileWriter &out)
+{
+    unsigned int offset, len, i, n;
+    byte *chunk;
+    int rc = 0;
 
+    if (read_limits(rfile, &offset, &len))
+        return -1;
+    if (out.begin(rfile, len))
+        return -1;
+    chunk = new byte[READ_CHUNK];
+    for (i = 0; i < len; i += n)
+    {
+        n = (len - i > READ_CHUNK)? READ_CHUNK : len - i;
+        rc = read_range(chunk, offset + i, n, offset, len);
+        if (rc)
+            break;
+        out.write(chunk, n);
+    }
+    out.finish();
+    delete[] chunk;
+    fprintf(stderr, "\n");
+    return rc;
+}
+
+/* Read any range, a partial first page goes through buf */
+int ProgAlgSPIFlash::readRange(byte *data, unsigned int offset,
+                               unsigned int len)
+{
+    unsigned int skip = offset % pgsize, n;
+
+    if (offset > pages * pgsize || len > pages * pgsize - offset)
+    {
+        fprintf(stderr,"Read outside PROM area requested, aborting\n");
+        return -1;
+    }
+    if (skip)
+    {
+        n = (len > pgsize - skip)? pgsize - skip : len;
+        if (read_range(buf, offset - skip, skip + n, offset, len))
+            return -1;
+        memcpy(data, buf + skip, n);
+        data += n;
+        offset += n;
+        len -= n;
+    }
+    if (len == 0)
+        return 0;
+    return read_range(data, offset, len, offset, len);
+}
+
+/* Pages in the holes of a sparse image are not compared */
 int ProgAlgSPIFlash::verify(BitFile &vfile) 
 {
     unsigned int i, offset, data_end, res, k=0;
-    unsigned int rlen;
-    int l, len = vfile.getLength()/8;
+    unsigned int rlen, r;
+    int l, plen, len = vfile.getLength()/8;
+    std::vector<bit_range> ext;
     byte *data = new byte[pgsize];
-    byte buf[4] = {PAGE_READ, 0,0,0};
+    byte buf[5] = {PAGE_READ, 0,0,0,0};
     
     if (data == 0 || len == 0)
     {
@@ -834,15 +1453,74 @@ int ProgAlgSPIFlash::verify(BitFile &vfile)
         data_end = pages * pgsize;
         len = data_end - offset;
     }
+    vfile.getRanges(0, len, pgsize, ext);
+    if (crc_verify && core_version < 2)
+        fprintf(stderr, "CRC verify needs the bscan_spi v2 core, "
+                "reading back\n");
+    if (crc_verify && core_version >= 2)
+    {
+        for (r = 0; r < ext.size(); r++)
+            k += verify_crc(vfile.getData() + ext[r].start,
+                            offset + ext[r].start, ext[r].len);
+        fprintf(stderr, "Verify: %s\n", (k)? "Failure!" : "Success!");
+        goto v_cleanup;
+    }
+    if (core_version >= 2)
+    {
+        /* Read back and compare in READ_CHUNK parts, the ranges and so
+           the parts start on a page */
+        byte *rdata = new byte[READ_CHUNK];
+        unsigned int s, n;
+
+        for (r = 0; r < ext.size() && k <= 5; r++)
+        {
+            for (s = ext[r].start; s < ext[r].start + ext[r].len && k <= 5;
+                 s += n)
+            {
+                n = ext[r].start + ext[r].len - s;
+                if (n > READ_CHUNK)
+                    n = READ_CHUNK;
+                if (read_v2(rdata, offset + s, n, offset, len))
+                {
+                    delete[] rdata;
+                    k = 1;
+                    goto v_cleanup;
+                }
+                for (i = s; i < s + n && k <= 5; i += rlen)
+                {
+                    rlen = (s + n - i > pgsize)? pgsize : s + n - i;
+                    if (memcmp(rdata + (i - s), vfile.getData() + i, rlen))
+                    {
+                        unsigned int j;
+                        fprintf(stderr, "\nVerify failed  at flash_page "
+                                "%6d\nread:", (offset + i)/pgsize + 1);
+                        k++;
+                        for(j =0; j<rlen; j++)
+                            fprintf(stderr, "%02x", rdata[i - s + j]);
+                        fprintf(stderr, "\nfile:");
+                        for(j =0; j<rlen; j++)
+                            fprintf(stderr, "%02x", vfile.getData()[i+j]);
+                        fprintf(stderr, "\n");
+                    }
+                }
+            }
+        }
+        if(jtag->getVerbose())
+            fprintf(stderr, "\n");
+        delete[] rdata;
+        fprintf(stderr, "Verify: %s\n", (k)? "Failure!" : "Success!");
+        goto v_cleanup;
+    }
     l = -pgsize;
     for(i = offset; i < data_end+pgsize; i+= pgsize)
     {
         if (i < data_end) /* Read last page */
             rlen = ((data_end - i) > pgsize)? pgsize: data_end - i;
-        page2padd(buf, i/pgsize, pgsize);
+        plen = page2padd(buf, i/pgsize);
         // get: flash_page n-1, send: read flashpage n             
-        res=spi_xfer_user1(data, pgsize, 4, buf, rlen, 4);
-        if (l >= 0) /* don't compare when sending first page*/
+        res=spi_xfer_user1(data, pgsize, plen, buf, rlen, plen);
+        /* don't compare when sending first page*/
+        if (l >= 0 && BitFile::inRanges(ext, l))
         {
             if(jtag->getVerbose())
             {
@@ -900,17 +1578,20 @@ int ProgAlgSPIFlash::wait(byte command, int report, int limit, double *delta)
     int j = 0;
     int done = 0;
     byte fbuf[4];
-    byte rbuf[1];
+    byte rbuf[2];
+    int n;
     struct timeval tv[2];
 
     fbuf[0] = command;
-    spi_xfer_user1(NULL,0,0,fbuf, 1, 1);
+    read_status(fbuf, rbuf);
     gettimeofday(tv, NULL);
     /* wait for command complete */
     do
     {
+        int k;
+
         jtag->Usleep(1000);       
-        spi_xfer_user1(rbuf,1,1,fbuf, 1, 1);
+        n = read_status(fbuf, rbuf);
         j++;
         if ((jtag->getVerbose()) &&((j%report) == (report -1)))
         {
@@ -918,10 +1599,13 @@ int ProgAlgSPIFlash::wait(byte command, int report, int limit, double *delta)
             fprintf(stderr,".");
             fflush(stderr);
         }
-        if (command == AT45_READ_STATUS)
-            done = (rbuf[0] & AT45_READY)?1:0;
-        else
-            done = (rbuf[0] & WRITE_BUSY)?0:1;
+        for (k = 0, done = 1; k < n; k++)
+        {
+            if (command == AT45_READ_STATUS)
+                done &= (rbuf[k] & AT45_READY)?1:0;
+            else
+                done &= (rbuf[k] & WRITE_BUSY)?0:1;
+        }
     }
     while (!done && (j < limit));
     gettimeofday(tv+1, NULL);
@@ -935,17 +1619,20 @@ int ProgAlgSPIFlash::wait(byte command, byte mask, byte value, int report, int l
     int j = 0;
     int done = 0;
     byte fbuf[4];
-    byte rbuf[1];
+    byte rbuf[2];
+    int n;
     struct timeval tv[2];
 
     fbuf[0] = command;
-    spi_xfer_user1(NULL,0,0,fbuf, 1, 1);
+    read_status(fbuf, rbuf);
     gettimeofday(tv, NULL);
     /* wait for command complete */
     do
     {
+        int k;
+
         jtag->Usleep(1000);       
-        spi_xfer_user1(rbuf,1,1,fbuf, 1, 1);
+        n = read_status(fbuf, rbuf);
         j++;
         if ((jtag->getVerbose()) &&((j%report) == (report -1)))
         {
@@ -953,7 +1640,8 @@ int ProgAlgSPIFlash::wait(byte command, byte mask, byte value, int report, int l
             fprintf(stderr,".");
             fflush(stderr);
                 }
-        done = (rbuf[0] & mask)==mask;
+        for (k = 0, done = 1; k < n; k++)
+            done &= (rbuf[k] & mask)==mask;
     }
     while (!done && (j < limit));
     gettimeofday(tv+1, NULL);
@@ -962,16 +1650,111 @@ int ProgAlgSPIFlash::wait(byte command, byte mask, byte value, int report, int l
 }
 
 
+/* Read back len bytes at flash address addr and compare them with data.
+ * addr must be page aligned.
+ * Returns the number of differing pages
+ */
+int ProgAlgSPIFlash::compare_range(const byte *data, unsigned int addr,
+                                   unsigned int len)
+{
+    unsigned int i, data_end = addr + len;
+    unsigned int rlen = 0, plen;
+    int l = -pgsize, k = 0, hlen = 4;
+    byte *rbuf = new byte[pgsize];
+    byte fbuf[5] = {PAGE_READ, 0,0,0,0};
+
+    for(i = addr; i < data_end + pgsize; i+= pgsize)
+    {
+        plen = rlen; /* length of the page received in this transfer */
+        if (i < data_end)
+        {
+            rlen = ((data_end - i) > pgsize)? pgsize: data_end - i;
+            hlen = page2padd(fbuf, i/pgsize);
+            spi_xfer_user1(rbuf, pgsize, hlen, fbuf, rlen, hlen);
+        }
+        else
+            spi_xfer_user1(rbuf, pgsize, hlen, NULL, 0, 0);
+        if (l >= 0 && memcmp(rbuf, data + l, plen))
+            k++;
+        l+= pgsize;
+    }
+    delete[] rbuf;
+    return k;
+}
+
+/* The journal is a small text file, written next to the programming run:
+ *
+ *   xc3sprog spi journal 1
+ *   flash <manf> <prod> offset <offset> length <len> crc <crc> sector <size>
+ *   done <start> <end>
+ *   ...
+ *
+ * A "done" line is appended and synced after each erase sector has been
+ * erased and completely programmed.  When the header matches the current
+ * image and flash, programming resumes after the last completed sector,
+ * once that sector has been read back successfully.
+ */
+#define JOURNAL_MAGIC "xc3sprog spi journal 1\n"
+
+unsigned int ProgAlgSPIFlash::journal_resume(const byte *data,
+                                             unsigned int offset,
+                                             unsigned int data_end,
+                                             const char *header)
+{
+    FILE *fp;
+    char line[256];
+    unsigned int start, end, done_start = 0, done_end = 0;
+
+    fp = fopen(journal, "r");
+    if (!fp)
+        return offset;
+    if (!fgets(line, sizeof(line), fp) || strcmp(line, JOURNAL_MAGIC) ||
+        !fgets(line, sizeof(line), fp) || strcmp(line, header))
+    {
+        fprintf(stderr, "Journal %s belongs to a different image or flash, "
+                "starting from scratch\n", journal);
+        fclose(fp);
+        return offset;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        /* Ignore a line torn by an interrupted write */
+        if (sscanf(line, "done %x %x", &start, &end) != 2 ||
+            start < offset || end <= start || end > data_end)
+            continue;
+        done_start = start;
+        done_end = end;
+    }
+    fclose(fp);
+    if (done_end == 0)
+        return offset;
+
+    if (compare_range(data + done_start - offset, done_start,
+                      done_end - done_start))
+    {
+        fprintf(stderr, "Last journaled sector at 0x%06x does not read back, "
+                "starting from scratch\n", done_start);
+        return offset;
+    }
+    fprintf(stderr, "Resuming from journal at address 0x%06x\n", done_end);
+    return done_end;
+}
+
 int ProgAlgSPIFlash::sectorerase_and_program(BitFile &pfile) 
 {
   unsigned int i, offset, data_end, data_page = 0;
-  byte fbuf[4];
-  unsigned int sector_nr = 0;
-  int j;
+  unsigned int start, unit_start, rlen;
+  /* The v2 core programs up to a FIFO full of pages by itself */
+  unsigned int step = (core_version >= 2)? V2_BUFSIZE : pgsize;
+  byte fbuf[5];
+  unsigned int sector_nr = 0, r = 0;
+  int j, rc = 0;
   int len = pfile.getLength()/8;
+  std::vector<bit_range> ext;
   double max_sector_erase = 0.0;
   double max_page_program = 0.0;
   double delta;
+  FILE *fp_journal = NULL;
 
   if (len == 0)
   {
@@ -1001,10 +1784,61 @@ int ProgAlgSPIFlash::sectorerase_and_program(BitFile &pfile)
       fprintf(stderr,"Program outside PROM areas requested, clipping\n");
       data_end = pages * pgsize;
   }
-  for(i = offset ; i < data_end; i+= pgsize)
+
+  start = offset;
+  if (journal)
+  {
+      char header[256];
+
+      snprintf(header, sizeof(header),
+               "flash %02x %04x offset %x length %x crc %08x sector %x\n",
+               manf_id, prod_id, offset, data_end - offset,
+               crc32_update(0, pfile.getData(), data_end - offset),
+               sector_size);
+      start = journal_resume(pfile.getData(), offset, data_end, header);
+      if (start != offset)
+          fp_journal = fopen(journal, "a");
+      else
+      {
+          fp_journal = fopen(journal, "w");
+          if (fp_journal)
+              fprintf(fp_journal, "%s%s", JOURNAL_MAGIC, header);
+      }
+      if (!fp_journal)
+      {
+          fprintf(stderr, "Can't open journal %s: %s\n", journal,
+                  strerror(errno));
+          return -1;
+      }
+      fflush(fp_journal);
+      /* A sparse range may have ended inside the sector we resume in,
+       * that sector is erased already and holds its data
+       */
+      if (start % sector_size)
+          sector_nr = start/sector_size + 1;
+  }
+
+  /* Only the pages holding data of a sparse image are programmed and
+   * only their sectors erased
+   */
+  pfile.getRanges(0, data_end - offset, pgsize, ext);
+  unit_start = start;
+  for(i = start ; i < data_end; i+= rlen)
     {
-      unsigned int rlen = ((data_end -i) > pgsize) ? pgsize : 
-          (data_end -i);
+      while (r < ext.size() && offset + ext[r].start + ext[r].len <= i)
+        r++;
+      if (r == ext.size())
+        break;
+      if (i < offset + ext[r].start)
+        {
+          i = offset + ext[r].start;
+          unit_start = i;
+        }
+      rlen = step - i % step;
+      if (rlen > data_end - i)
+        rlen = data_end - i;
+      if (rlen > offset + ext[r].start + ext[r].len - i)
+        rlen = offset + ext[r].start + ext[r].len - i;
       /* Find out if sector needs to be erased*/
       if (sector_nr   <= i/sector_size)
 	{
@@ -1014,8 +1848,7 @@ int ProgAlgSPIFlash::sectorerase_and_program(BitFile &pfile)
 	  spi_xfer_user1(NULL,0,0,fbuf, 0, 1);
 	  /* Erase selected page */
 	  fbuf[0] = sector_erase_cmd;
-          page2padd(fbuf, i/pgsize, pgsize);
-          spi_xfer_user1(NULL,0,0,fbuf, 0, 4);
+          spi_xfer_user1(NULL,0,0,fbuf, 0, page2padd(fbuf, i/pgsize));
 	  if(jtag->getVerbose())
               fprintf(stderr,"\rErasing sector %2d/%2d", 
                       sector_nr, 
@@ -1024,7 +1857,8 @@ int ProgAlgSPIFlash::sectorerase_and_program(BitFile &pfile)
 	  if(j != 0)
            {
              fprintf(stderr,"\nErase failed for sector %2d\n", sector_nr);
-             return -1;
+             rc = -1;
+             goto cleanup;
            }
          else
            {
@@ -1041,19 +1875,30 @@ int ProgAlgSPIFlash::sectorerase_and_program(BitFile &pfile)
          fflush(stderr);
        }
 
-      /* Enable Write */
-      fbuf[0] = WRITE_ENABLE;
-      spi_xfer_user1(NULL,0,0,fbuf, 0, 1);
-      buf[0] = PAGE_PROGRAM;
-      page2padd(buf, i/pgsize, pgsize);
-      memcpy(buf+4,&pfile.getData()[i-offset], rlen);
-      spi_xfer_user1(NULL,0,0,buf, rlen, 4);
-      j = wait(READ_STATUS_REGISTER, 1, 50, &delta);
+      if (core_version >= 2)
+        {
+          j = program_v2(i, &pfile.getData()[i-offset], rlen);
+          delta = 0.0;
+        }
+      else
+        {
+          /* Enable Write */
+          fbuf[0] = WRITE_ENABLE;
+          spi_xfer_user1(NULL,0,0,fbuf, 0, 1);
+          int plen;
+
+          buf[0] = PAGE_PROGRAM;
+          plen = page2padd(buf, i/pgsize);
+          memcpy(buf+plen,&pfile.getData()[i-offset], rlen);
+          spi_xfer_user1(NULL,0,0,buf, rlen, plen);
+          j = wait(READ_STATUS_REGISTER, 1, 50, &delta);
+        }
       if(j != 0)
        {
          fprintf(stderr,"\nPage Program failed for flashpage %6d\n", 
                  i/pgsize +1);
-         return -1;
+         rc = -1;
+         goto cleanup;
        }
       else
 	{
@@ -1062,13 +1907,31 @@ int ProgAlgSPIFlash::sectorerase_and_program(BitFile &pfile)
 	  
 	}
       data_page++;
+      /* Record each sector once it is erased and completely written */
+      if (fp_journal && 
+          (i + rlen >= data_end || (i + rlen) % sector_size == 0 ||
+           i + rlen == offset + ext[r].start + ext[r].len))
+        {
+          fprintf(fp_journal, "done %x %x\n", unit_start, i + rlen);
+          fflush(fp_journal);
+          fsync(fileno(fp_journal));
+          unit_start = i + rlen;
+        }
     }
   if(jtag->getVerbose())
     {
       fprintf(stderr, "\nMaximum erase time %.1f ms, Max PP time %.0f us\n",
 	      max_sector_erase/1.0e3, max_sector_erase/1e1);
     }
-  return 0;
+ cleanup:
+  if (fp_journal)
+    {
+      fclose(fp_journal);
+      /* Keep the journal for the next attempt unless we are done */
+      if (rc == 0)
+        unlink(journal);
+    }
+  return rc;
 }
 
 
@@ -1087,12 +1950,13 @@ void ProgAlgSPIFlash::sst_disable_write_protect()
 
 int ProgAlgSPIFlash::program_sst(BitFile &pfile)
 {
-    byte fbuf[4];
+    byte fbuf[5];
     byte AAIP_Cmd[6]={0xad,0x00,0x00,0x00,0xaa,0xaa};
     double delta;
     const unsigned long tCE=50;
     const unsigned long tBP=10;
     bool inAAImode;
+    std::vector<bit_range> ext;
 
     unsigned int i, offset, data_end= 0;
 
@@ -1148,77 +2012,85 @@ int ProgAlgSPIFlash::program_sst(BitFile &pfile)
      }
      */
 
-    unsigned int sector_nr = 0;
+    unsigned int sector_nr = 0, r;
     int j;
+    /* Only sectors and words holding data of a sparse image are touched */
+    pfile.getRanges(0, data_end - offset, 2, ext);
     /* Sector erasing */
-    for(i = offset ; i < data_end; i+= sector_size) {
+    for (r = 0; r < ext.size(); r++)
+    {
+        unsigned int end = offset + ext[r].start + ext[r].len;
 
-        if (sector_nr   <= i/sector_size)
+        for(i = offset + ext[r].start; i < end;
+            i = (i/sector_size + 1) * sector_size)
         {
-            sector_nr = i/sector_size +1;
-            /* Enable Write */
-            fbuf[0] = WRITE_ENABLE;
-            spi_xfer_user1(NULL,0,0,fbuf, 0, 1);
-            /* Erase selected page */
-            fbuf[0] = sector_erase_cmd;
-            page2padd(fbuf, i/pgsize, pgsize);
-            spi_xfer_user1(NULL,0,0,fbuf, 0, 4);
-            if(jtag->getVerbose())
-                fprintf(stderr,"\rErasing sector %2d/%2d",
-                        sector_nr,
-                        (data_end + sector_size + 1)/sector_size);
-            j = wait(READ_STATUS_REGISTER, 100, 3000, &delta);
-            if(j != 0)
+            if (sector_nr   <= i/sector_size)
             {
-                fprintf(stderr,"\nErase failed for sector %2d\n", sector_nr);
-                return -1;
-            }
-            else
-            {
-              //  if (delta > max_sector_erase)
-              //      max_sector_erase= delta;
+                sector_nr = i/sector_size +1;
+                /* Enable Write */
+                fbuf[0] = WRITE_ENABLE;
+                spi_xfer_user1(NULL,0,0,fbuf, 0, 1);
+                /* Erase selected page */
+                fbuf[0] = sector_erase_cmd;
+                spi_xfer_user1(NULL,0,0,fbuf, 0, page2padd(fbuf, i/pgsize));
+                if(jtag->getVerbose())
+                    fprintf(stderr,"\rErasing sector %2d/%2d",
+                            sector_nr,
+                            (data_end + sector_size + 1)/sector_size);
+                j = wait(READ_STATUS_REGISTER, 100, 3000, &delta);
+                if(j != 0)
+                {
+                    fprintf(stderr,"\nErase failed for sector %2d\n",
+                            sector_nr);
+                    return -1;
+                }
             }
         }
     }
     fprintf(stderr,"\n");
 
-    inAAImode = false;
+    /* One auto address increment run per range */
+    for (r = 0; r < ext.size(); r++)
+    {
+        unsigned int start = offset + ext[r].start;
 
-    fbuf[0] = 0x06; // WREN
-    spi_xfer_user1(NULL,0,0,fbuf,0,1);
-    jtag->Usleep(tCE);
+        inAAImode = false;
 
-    if (wait( READ_STATUS_REGISTER, 0x40, 0x40, tCE>>2, tCE, &delta)!=0) {
-        fprintf(stderr,"Error waiting for flash\n");
-        return -1;
-    }
+        fbuf[0] = 0x06; // WREN
+        spi_xfer_user1(NULL,0,0,fbuf,0,1);
+        jtag->Usleep(tCE);
 
-    for(i = offset ; i < data_end; i+= 2)
-    {
-
-        if (inAAImode) {
-            AAIP_Cmd[1] = bitRevTable[ pfile.getData()[i-offset] ];
-            AAIP_Cmd[2] = bitRevTable[ pfile.getData()[i-offset+1] ];
-        } else {
-            AAIP_Cmd[1] = (offset>>16)&0xff;
-            AAIP_Cmd[2] = (offset>>8)&0xff;
-            AAIP_Cmd[3] = (offset)&0xff;
+        if (wait( READ_STATUS_REGISTER, 0x40, 0x40, tCE>>2, tCE, &delta)!=0) {
+            fprintf(stderr,"Error waiting for flash\n");
+            return -1;
+        }
 
-            AAIP_Cmd[4] = bitRevTable[ pfile.getData()[i-offset] ];
-            AAIP_Cmd[5] = bitRevTable[ pfile.getData()[i-offset+1] ];
+        for(i = start ; i < start + ext[r].len; i+= 2)
+        {
+            if (inAAImode) {
+                AAIP_Cmd[1] = bitRevTable[ pfile.getData()[i-offset] ];
+                AAIP_Cmd[2] = bitRevTable[ pfile.getData()[i-offset+1] ];
+            } else {
+                AAIP_Cmd[1] = (start>>16)&0xff;
+                AAIP_Cmd[2] = (start>>8)&0xff;
+                AAIP_Cmd[3] = (start)&0xff;
+
+                AAIP_Cmd[4] = bitRevTable[ pfile.getData()[i-offset] ];
+                AAIP_Cmd[5] = bitRevTable[ pfile.getData()[i-offset+1] ];
+            }
+            spi_xfer_user1(NULL,0,0,&AAIP_Cmd[0], 0, inAAImode ? 3 : 6);
+            inAAImode=true;
         }
-        spi_xfer_user1(NULL,0,0,&AAIP_Cmd[0], 0, inAAImode ? 3 : 6);
-        inAAImode=true;
-    }
-    printf("Programming done\n");
 
-    fbuf[0] = 0x04; // WRDI
-    spi_xfer_user1(NULL,0,0,fbuf, 0, 1);
+        fbuf[0] = 0x04; // WRDI
+        spi_xfer_user1(NULL,0,0,fbuf, 0, 1);
 
-    if (wait(READ_STATUS_REGISTER, 0x01, 0x0, tBP>>2, tBP, &delta)<0) {
-        fprintf(stderr,"Timeout\n");
-        return -1;
+        if (wait(READ_STATUS_REGISTER, 0x01, 0x0, tBP>>2, tBP, &delta)<0) {
+            fprintf(stderr,"Timeout\n");
+            return -1;
+        }
     }
+    printf("Programming done\n");
 
     return 0;
 }
@@ -1238,6 +2110,8 @@ int ProgAlgSPIFlash::program(BitFile &pfile)
       fprintf(stderr, "dude, that file is larger than the flash!\n");
       return -1;
     }
+  if (journal && (manf_id == 0x1f || manf_id == 0xbf))
+    fprintf(stderr, "Journal not supported for this flash, ignoring\n");
   switch (manf_id) {
   case 0x1f: /* Atmel */
     return program_at45(pfile);
@@ -1260,7 +2134,9 @@ int ProgAlgSPIFlash::program(BitFile &pfile)
 int ProgAlgSPIFlash::program_at45(BitFile &pfile)
 {
     int len = pfile.getLength()/8;
-    unsigned int i, offset, data_end, data_page= 0;
+    unsigned int i, offset, data_end, data_page= 0, r = 0;
+    unsigned int prog_page = 0; /* flash page being programmed */
+    std::vector<bit_range> ext;
     double max_page_program = 0.0;
     double delta;
     
@@ -1286,10 +2162,24 @@ int ProgAlgSPIFlash::program_at45(BitFile &pfile)
         fprintf(stderr,"Program outside PROM areas requested, clipping\n");
         data_end = pages * pgsize;
     }
-    buf[0] = 0x82;/* page program with builtin erase */
+    /* The AT45 has two SRAM buffers. Load the next page into one buffer
+     * while the other one is still programmed into the array, so the
+     * JTAG transfer is hidden behind the page program time.
+     */
+    pfile.getRanges(0, data_end - offset, pgsize, ext);
     for(i = offset ; i < data_end; i+= pgsize)
     {
-        unsigned int j;
+        /* Skip the holes of a sparse image */
+        while (r < ext.size() && offset + ext[r].start + ext[r].len <= i)
+            r++;
+        if (r == ext.size())
+            break;
+        if (i < offset + ext[r].start)
+            i = offset + ext[r].start;
+
+        int j;
+        int sram = data_page & 1;
+        byte fbuf[4];
         unsigned int rlen = ((data_end -i) > pgsize) ? pgsize : 
             (data_end -i);
         if(jtag->getVerbose())
@@ -1301,25 +2191,48 @@ int ProgAlgSPIFlash::program_at45(BitFile &pfile)
             fflush(stderr);
         }
         
-        page2padd(buf, i/pgsize, pgsize);
+        /* Buffer write, starting at buffer address 0 */
+        buf[0] = (sram)? AT45_BUFFER2_WRITE : AT45_BUFFER1_WRITE;
+        buf[1] = buf[2] = buf[3] = 0;
         memcpy(buf+4,&pfile.getData()[i-offset], rlen);
-        spi_xfer_user1(NULL,0,0,buf, rlen, 4);
-        /* Page Erase/Program takes up to 35 ms (t_pep, UG333.pdf page 43)*/
-        j = wait(AT45_READ_STATUS, 1, 35, &delta);
-        if(j != 0)
-        {
-            fprintf(stderr,"\nPage Program failed for flashpage %6d\n", 
-                    i/pgsize +1);
-            return -1;
-        }
-        else
+        if (rlen < pgsize)
+            memset(buf + 4 + rlen, 0xff, pgsize - rlen);
+        spi_xfer_user1(NULL,0,0,buf, pgsize, 4);
+
+        if (data_page)
         {
+            /* Page Erase/Program takes up to 35 ms (t_pep, UG333.pdf page 43)*/
+            j = wait(AT45_READ_STATUS, 1, 35, &delta);
+            if(j != 0)
+            {
+                fprintf(stderr,"\nPage Program failed for flashpage %6d\n", 
+                        prog_page);
+                return -1;
+            }
             if (delta > max_page_program)
                 max_page_program= delta;
-	  
-	}
+        }
+
+        /* Buffer to main memory page program with builtin erase */
+        fbuf[0] = (sram)? AT45_BUFFER2_PROGRAM : AT45_BUFFER1_PROGRAM;
+        prog_page = i/pgsize;
+        page2padd(fbuf, prog_page);
+        spi_xfer_user1(NULL,0,0,fbuf, 0, 4);
         data_page++;
     }
+    if (data_page)
+    {
+        if (wait(AT45_READ_STATUS, 1, 35, &delta) != 0)
+        {
+            fprintf(stderr,"\nPage Program failed for flashpage %6d\n", 
+                    prog_page);
+            return -1;
+        }
+        if (delta > max_page_program)
+            max_page_program= delta;
+    }
+    if(jtag->getVerbose())
+        fprintf(stderr, "\nMax PP time %.1f ms\n", max_page_program/1.0e3);
  
     return 0;
 }
@@ -1331,7 +2244,15 @@ int ProgAlgSPIFlash::erase_bulk(void)
     double delta;
 
     // get status
-    spi_xfer_user1(fbuf,2,1, NULL, 0, 0);
+    if (dual)
+    {
+        byte sbuf[2];
+
+        spi_xfer_user1_dual(fbuf, sbuf, 2, 1, NULL, NULL, 0, 0);
+        fbuf[1] |= sbuf[1];
+    }
+    else
+        spi_xfer_user1(fbuf,2,1, NULL, 0, 0);
     fbuf[0] = bitRevTable[fbuf[0]];
     fbuf[1] = bitRevTable[fbuf[1]];
     if (fbuf[1] & (BP0 | BP1 | BP2))
@@ -1390,7 +2311,7 @@ int ProgAlgSPIFlash::erase_at45(void)
 
         fbuf[0] = AT45_SECTOR_ERASE;
         fbuf[3] = 0;
-        page2padd(fbuf, page, pgsize);
+        page2padd(fbuf, page);
         if(jtag->getVerbose())
 	    fprintf(stderr,"\rErasing sector %2d%c", 
                     page/pages_per_sector,
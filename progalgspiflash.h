@@ -29,14 +29,16 @@ Code based on http://code.google.com/p/xilprg-hunz/
 
 #include "bitfile.h"
 #include "jtag.h"
+#include "progalg.h"
 
 typedef unsigned char byte;
 
-class ProgAlgSPIFlash
+class ProgAlgSPIFlash : public ProgAlg
 {
  private:
   static const byte USER1;
   static const byte USER2;
+  static const byte USER3;
   static const byte CFG_IN;
   static const byte JSHUTDOWN;
   static const byte JSTART;
@@ -56,10 +58,39 @@ class ProgAlgSPIFlash
   byte *miso_buf;
   byte *mosi_buf;
   byte *buf;
+  const char *journal;
+  int dual;
+  int dual_split;
+  byte *dual_buf;
+  int core_version;  /* protocol of the loaded bscan_spi core */
+  int quad_read;     /* v2 core may use quad output read */
+  int crc_verify;
+  int addr4;         /* use 4 byte address opcodes */
 
   int xc_user(byte *in, byte *out, int len);
   int spi_xfer_user1(uint8_t *last_miso, int miso_len, int miso_skip, 
 		     uint8_t *mosi, int mosi_len, int preamble);
+  int spi_xfer_user1_split(uint8_t *last_miso, int miso_len, int miso_skip, 
+                           uint8_t *mosi, int mosi_len, int preamble);
+  int spi_xfer_user1_dual(uint8_t *last_miso0, uint8_t *last_miso1,
+                          int miso_len, int miso_skip,
+                          const uint8_t *mosi0, const uint8_t *mosi1,
+                          int mosi_len, int preamble);
+  int read_status(byte *fbuf, byte *rbuf);
+  int detect_core(void);
+  int quad_read_ok(void);
+  int v2_xfer(byte cmd, unsigned int addr, const byte *data, int len,
+              byte *rdata, int rlen, uint32_t *status);
+  int v2_wait(int limit);
+  int program_v2(unsigned int addr, const byte *data, int len);
+  int read_v2(byte *dest, unsigned int addr, unsigned int len,
+              unsigned int start, unsigned int total);
+  int read_limits(BitFile &rfile, unsigned int *offset, unsigned int *len);
+  int read_range(byte *dest, unsigned int offset, unsigned int len,
+                 unsigned int start, unsigned int total);
+  int crc_v2(unsigned int addr, unsigned int len, uint32_t *crc);
+  int verify_crc(const byte *data, unsigned int offset, unsigned int len);
+  int page2padd(byte *buf, unsigned int page);
   int spi_flashinfo_s33 (unsigned char * fbuf);
   int spi_flashinfo_amic (unsigned char * fbuf);
   int spi_flashinfo_amic_quad (unsigned char * fbuf);
@@ -74,6 +105,9 @@ class ProgAlgSPIFlash
   int program_sst(BitFile &pfile);
   void sst_disable_write_protect();
   int sectorerase_and_program(BitFile &file);
+  int compare_range(const byte *data, unsigned int addr, unsigned int len);
+  unsigned int journal_resume(const byte *data, unsigned int offset,
+                              unsigned int data_end, const char *header);
   int erase_at45();
   int erase_bulk();
   int erase_sst();
@@ -83,10 +117,24 @@ class ProgAlgSPIFlash
   ProgAlgSPIFlash(Jtag &j);
   ~ProgAlgSPIFlash(void);
   int spi_flashinfo(void);
+  /* Signature of a resident bscan_spi core, 0 if none */
+  uint32_t readCoreSignature(void);
+  /* Record progress in fname and resume from it on the next attempt */
+  void setJournal(const char *fname) { journal = fname; }
+  /* Two flashes in parallel, needs the bscan_xc7_spi_dual core */
+  void setDual(bool on);
+  /* Verify by CRC-32 calculated in the v2 core instead of reading back */
+  void setCrcVerify(bool on) { crc_verify = (on)? 1 : 0; }
   int erase(void);
   int program(BitFile &file);
   int verify(BitFile &file);
   int read(BitFile &file);
+  int read(BitFile &file, BitFileWriter &out);
+  int readRange(byte *data, unsigned int offset, unsigned int len);
+  /* Size in bits, like the other ProgAlgs */
+  unsigned int getSize() const { return pages * pgsize * 8; }
+  unsigned int getPageSize() const { return pgsize; }
+  void reconfig(){};
   void disable(){};
   void test(int test_count);
 };
@@ -289,6 +289,15 @@ int ProgAlgXC2C::array_verify(BitFile &file)
   return res;
 }
 
+uint32_t ProgAlgXC2C::read_usercode(void)
+{
+  byte data[4];
+
+  jtag->shiftIR(&USERCODE);
+  jtag->shiftDR(0, data, 32);
+  return jtag->byteArrayToLong(data);
+}
+
 void ProgAlgXC2C::done_program(void)
 {
   byte a_data[1];
@@ -63,7 +63,7 @@ class ProgAlgXC2C
   void array_read(BitFile &file);
   void array_program(BitFile &file);
   void done_program(void);
-  void read_usercode(void);
+  uint32_t read_usercode(void);
 };
 
 
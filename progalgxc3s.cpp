@@ -22,7 +22,10 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
     Added programming time measurements.
 */
 
+#include <vector>
+
 #include "progalgxc3s.h"
+#include "configstream.h"
 #include "utilities.h"
 
 
@@ -41,6 +44,15 @@ static const byte ISC_ENABLE[2]  = { 0xd0, 0xff };
 static const byte ISC_DISABLE[2] = { 0xd6, 0xff };
 static const byte BYPASS[2]      = { 0xff, 0xff };
 static const byte ISC_DNA[1]     = { 0x31 };
+static const byte CFG_OUT[2]     = { 0xc4, 0xff };
+
+/* Limits for the waits after JPROGRAM and JSTART */
+static const double INIT_TIMEOUT = 1.0;
+static const double DONE_TIMEOUT = 0.1;
+/* Loading an image from flash after IPROG, seconds */
+static const double BOOT_TIMEOUT = 5.0;
+/* TCK cycles in Run-Test/Idle between two polls */
+static const int POLL_TCK = 1000;
 
 
 ProgAlgXC3S::ProgAlgXC3S(Jtag &j, int fam)
@@ -198,22 +210,24 @@ void ProgAlgXC3S::flow_program_legacy(BitFile &file)
     }
  
 }
-void ProgAlgXC3S::array_program(BitFile &file)
+int ProgAlgXC3S::array_program(BitFile &file)
 {
-  unsigned char buf[1] = {0};
-  int i = 0;
-
   if (family == FAMILY_XC2S || family == FAMILY_XC2SE)
-      return flow_program_xc2s(file);
+    {
+      flow_program_xc2s(file);
+      return 0;
+    }
   
   flow_enable();
 
   /* JPROGAM: Triger reconfiguration, not explained in ug332, but
      DS099 Figure 28:  Boundary-Scan Configuration Flow Diagram (p.49) */
   jtag->shiftIR(JPROGRAM);
-  do
-    jtag->shiftIR(CFG_IN, buf);
-  while (! (buf[0] & 0x10)); /* wait until configuration cleared */
+  if (wait_init())
+    {
+      flow_disable();
+      return 1;
+    }
 
   /* As ISC_DNA only works on a unconfigured device, see AR #29977*/
   switch(family)
@@ -247,17 +261,604 @@ void ProgAlgXC3S::array_program(BitFile &file)
      failed, while flow_program_legacy appears to work just fine on XC7VX690T.
      (jorisvr) */
 
-  /* Wait until device comes up */
-  while ((( buf[0] & 0x23) != 0x21) && (i <50))
+  return wait_done();
+}
+
+/* Words for CFG_IN, most significant bit first */
+static void put_cfg_word(byte *buf, uint32_t w, int bits)
+{
+  int i;
+
+  for (i = 0; i < bits / 8; i++)
+    buf[i] = bitRevTable[0xff & (w >> (bits - 8 - 8 * i))];
+}
+
+/* Read a configuration register through CFG_IN/CFG_OUT, see UG470
+ * table 6-3. Returns -1 for families where this is not supported.
+ */
+int ProgAlgXC3S::read_reg(int reg, uint32_t *val)
+{
+  byte buf[32];
+  byte data[4];
+  int n = 0, bits, i;
+
+  switch(family)
+    {
+    case FAMILY_XC6S:
+      bits = 16;
+      put_cfg_word(buf + n, 0xaa99, bits); n += 2;
+      put_cfg_word(buf + n, 0x5566, bits); n += 2;
+      put_cfg_word(buf + n, 0x2000, bits); n += 2;
+      put_cfg_word(buf + n, 0x2801 | (reg << 5), bits); n += 2; /* read */
+      put_cfg_word(buf + n, 0x2000, bits); n += 2;
+      put_cfg_word(buf + n, 0x2000, bits); n += 2;
+      break;
+    case FAMILY_XC5VLX:
+    case FAMILY_XC5VLXT:
+    case FAMILY_XC5VSXT:
+    case FAMILY_XC5VFXT:
+    case FAMILY_XC5VTXT:
+    case FAMILY_XC7:
+      bits = 32;
+      put_cfg_word(buf + n, 0xaa995566, bits); n += 4;
+      put_cfg_word(buf + n, 0x20000000, bits); n += 4;
+      put_cfg_word(buf + n, 0x28000001 | (reg << 13), bits); n += 4;
+      put_cfg_word(buf + n, 0x20000000, bits); n += 4;
+      put_cfg_word(buf + n, 0x20000000, bits); n += 4;
+      break;
+    default:
+      return -1;
+    }
+
+  jtag->shiftIR(CFG_IN);
+  jtag->shiftDR(buf, 0, n * 8);
+  jtag->shiftIR(CFG_OUT);
+  jtag->shiftDR(0, data, bits);
+  *val = 0;
+  for (i = 0; i < bits / 8; i++)
+    *val = (*val << 8) | bitRevTable[data[i]];
+
+  desync(bits);
+  return 0;
+}
+
+/* STAT is register 8 on Spartan-6 */
+int ProgAlgXC3S::read_stat(uint32_t *stat)
+{
+  return read_reg((family == FAMILY_XC6S) ? 8 : CFG_REG_STAT, stat);
+}
+
+/* Desync, so the configuration logic waits for a new stream */
+void ProgAlgXC3S::desync(int bits)
+{
+  byte buf[16];
+  int n = 0;
+
+  if (bits == 16)
+    {
+      put_cfg_word(buf + n, 0x30a1, bits); n += 2; /* write CMD */
+      put_cfg_word(buf + n, 0x000d, bits); n += 2; /* DESYNC */
+      put_cfg_word(buf + n, 0x2000, bits); n += 2;
+      put_cfg_word(buf + n, 0x2000, bits); n += 2;
+    }
+  else
+    {
+      put_cfg_word(buf + n, 0x30008001, bits); n += 4; /* write CMD */
+      put_cfg_word(buf + n, 0x0000000d, bits); n += 4; /* DESYNC */
+      put_cfg_word(buf + n, 0x20000000, bits); n += 4;
+      put_cfg_word(buf + n, 0x20000000, bits); n += 4;
+    }
+  jtag->shiftIR(CFG_IN);
+  jtag->shiftDR(buf, 0, n * 8);
+  jtag->shiftIR(BYPASS);
+}
+
+/* Flags of the STAT register in a common layout */
+#define ST_CRC_ERROR  0x01
+#define ST_ID_ERROR   0x02
+#define ST_DEC_ERROR  0x04
+#define ST_INIT_B     0x08
+#define ST_DONE       0x10
+
+int ProgAlgXC3S::decode_stat(uint32_t stat)
+{
+  int flags = 0;
+
+  if (stat & 0x0001)
+    flags |= ST_CRC_ERROR;
+  if (family == FAMILY_XC6S)
+    {
+      /* UG380 table 5-35 */
+      if (stat & 0x0002)
+        flags |= ST_ID_ERROR;
+      if (stat & 0x0040)
+        flags |= ST_DEC_ERROR;
+      if (stat & 0x1000)
+        flags |= ST_INIT_B;
+      if (stat & 0x2000)
+        flags |= ST_DONE;
+    }
+  else
+    {
+      if (stat & 0x1000)
+        flags |= ST_INIT_B;
+      if (stat & 0x4000)
+        flags |= ST_DONE;
+      if (stat & 0x8000)
+        flags |= ST_ID_ERROR;
+      if (stat & 0x10000)
+        flags |= ST_DEC_ERROR;
+    }
+  return flags;
+}
+
+/* Wait for the device to clear its configuration after JPROGRAM */
+int ProgAlgXC3S::wait_init(void)
+{
+  Timer timer;
+  byte buf[1] = {0};
+
+  jtag->shiftIR(CFG_IN, buf);
+  while (! (buf[0] & 0x10)) /* wait until configuration cleared */
+    {
+      if (timer.elapsed() > INIT_TIMEOUT)
+        {
+          fprintf(stderr, "Device did not clear after JPROGRAM, "
+                  "INSTRUCTION_CAPTURE is 0x%02x\n", buf[0]);
+          return 1;
+        }
+      jtag->cycleTCK(POLL_TCK);
+      jtag->shiftIR(CFG_IN, buf);
+    }
+  return 0;
+}
+
+/* Wait for DONE after startup and report why configuration failed */
+int ProgAlgXC3S::wait_done(void)
+{
+  Timer timer;
+  byte buf[1] = {0};
+  uint32_t stat;
+  int flags;
+
+  while (true)
     {
       jtag->shiftIR(BYPASS, buf);
-      jtag->Usleep(1000);
-      i++;
+      if ((buf[0] & 0x23) == 0x21)
+        return 0;
+      if (timer.elapsed() > DONE_TIMEOUT)
+        break;
+      jtag->cycleTCK(POLL_TCK);
+    }
+
+  if (read_stat(&stat))
+    {
+      fprintf(stderr, "Device failed to configure, "
+              "INSTRUCTION_CAPTURE is 0x%02x\n", buf[0]);
+      return 1;
+    }
+  flags = decode_stat(stat);
+  if (flags & ST_DONE)
+    return 0;
+  fprintf(stderr, "Device failed to configure, STAT is 0x%08x:", stat);
+  if (flags & ST_CRC_ERROR)
+    fprintf(stderr, " CRC error");
+  if (flags & ST_ID_ERROR)
+    fprintf(stderr, " bitstream for other device (IDCODE error)");
+  if (flags & ST_DEC_ERROR)
+    fprintf(stderr, " decryption error");
+  if (!(flags & ST_INIT_B))
+    fprintf(stderr, " INIT_B low");
+  if (!(flags & (ST_CRC_ERROR | ST_ID_ERROR | ST_DEC_ERROR)) &&
+      (flags & ST_INIT_B))
+    fprintf(stderr, " startup did not complete, DONE low");
+  fprintf(stderr, "\n");
+  return 1;
+}
+
+/* Load a partial stream into the running device, no JPROGRAM and no
+ * startup sequence
+ */
+void ProgAlgXC3S::partial_program(BitFile &file)
+{
+  Timer timer;
+  byte data[1];
+
+  jtag->shiftIR(CFG_IN);
+  jtag->shiftDR((file.getData()),0,file.getLength());
+  jtag->cycleTCK(1);
+  jtag->shiftIR(BYPASS);
+  data[0]=0x0;
+  jtag->shiftDR(data,0,1);
+  jtag->cycleTCK(1);
+
+  if (jtag->getVerbose())
+    fprintf(stderr, "Partial configuration time %.1f ms\n",
+            timer.elapsed() * 1000);
+}
+
+/* Configure the identical FPGAs at chain positions devs with the same
+ * bitstream. JPROGRAM, JSTART and the wait for DONE are shared, only
+ * the bitstream itself is shifted into each device in turn.
+ */
+int ProgAlgXC3S::broadcast_program(BitFile &file, const int *devs, int ndevs)
+{
+  Timer timer;
+  int k, res = 0;
+
+  if (family == FAMILY_XC2S || family == FAMILY_XC2SE)
+    {
+      fprintf(stderr, "Broadcast configuration not supported for XC2S\n");
+      return 1;
+    }
+
+  for (k = 0; k < ndevs; k++)
+    {
+      jtag->selectDevice(devs[k]);
+      flow_enable();
+    }
+
+  /* clear all devices at once */
+  jtag->shiftIRAll(JPROGRAM, devs, ndevs);
+  for (k = 0; k < ndevs; k++)
+    {
+      jtag->selectDevice(devs[k]);
+      if (wait_init())
+        {
+          for (k = 0; k < ndevs; k++)
+            {
+              jtag->selectDevice(devs[k]);
+              flow_disable();
+            }
+          jtag->selectDevice(devs[0]);
+          return 1;
+        }
+    }
+
+  for (k = 0; k < ndevs; k++)
+    {
+      if (jtag->getVerbose())
+        fprintf(stderr, "Loading device at chain position %d\n", devs[k]);
+      jtag->selectDevice(devs[k]);
+      jtag->shiftIR(JSHUTDOWN);
+      jtag->cycleTCK(tck_len);
+      jtag->shiftIR(CFG_IN);
+      jtag->shiftDR((file.getData()),0,file.getLength());
+      jtag->cycleTCK(1);
+    }
+
+  /* start all devices together */
+  jtag->shiftIRAll(JSTART, devs, ndevs);
+  jtag->cycleTCK(2*tck_len);
+  jtag->shiftIRAll(BYPASS, devs, ndevs);
+  jtag->cycleTCK(1);
+
+  for (k = 0; k < ndevs; k++)
+    {
+      jtag->selectDevice(devs[k]);
+      flow_disable();
+    }
+
+  /* Wait until all devices come up, they started together */
+  for (k = 0; k < ndevs; k++)
+    {
+      jtag->selectDevice(devs[k]);
+      if (wait_done())
+        {
+          fprintf(stderr, "Device at chain position %d failed to configure\n",
+                  devs[k]);
+          res = 1;
+        }
+    }
+  jtag->selectDevice(devs[0]);
+
+  if (jtag->getVerbose())
+    fprintf(stderr, "%d devices configured in %.1f ms\n", ndevs,
+            timer.elapsed() * 1000);
+  return res;
+}
+
+/* Compare USR_ACCESS of the device with the AXSS value the bitstream
+ * writes, bitgen -g USR_ACCESS. Returns 1 if the device is configured
+ * with file, 0 if not and -1 if that can't be told.
+ */
+int ProgAlgXC3S::is_loaded(BitFile &file)
+{
+  uint32_t stat, axss;
+  int k, found = 0;
+  uint32_t want = 0;
+
+  switch(family)
+    {
+    case FAMILY_XC5VLX:
+    case FAMILY_XC5VLXT:
+    case FAMILY_XC5VSXT:
+    case FAMILY_XC5VFXT:
+    case FAMILY_XC5VTXT:
+    case FAMILY_XC7:
+      break;
+    default:
+      return -1;
+    }
+
+  ConfigStream cs(file.getData(), file.getLengthBytes(), 32);
+  if (cs.parse() < 0)
+    return -1;
+  for (k = 0; k < cs.getNumPackets(); k++)
+    {
+      const cfg_packet &p = cs.getPacket(k);
+      if (p.op == CFG_OP_WRITE && p.reg == CFG_REG_AXSS && p.count == 1)
+        {
+          want = cs.getWord(p.data);
+          found = 1;
+        }
+    }
+  if (!found)
+    {
+      if (jtag->getVerbose())
+        fprintf(stderr, "Bitstream sets no USR_ACCESS value\n");
+      return -1;
+    }
+
+  if (read_stat(&stat) || !(decode_stat(stat) & ST_DONE))
+    return 0;
+  if (read_reg(CFG_REG_AXSS, &axss))
+    return -1;
+  if (jtag->getVerbose())
+    fprintf(stderr, "USR_ACCESS device 0x%08x, file 0x%08x\n", axss, want);
+  return (axss == want) ? 1 : 0;
+}
+
+/* Frames per CFG_OUT chunk of a readback */
+#define READBACK_FRAMES 256
+
+/* Compare the frames of one chunk of readback data */
+static unsigned int compare_frames(const byte *rb, const byte *ref,
+                                   const byte *msk, unsigned int len,
+                                   unsigned int frame_bytes,
+                                   unsigned int first, uint32_t far,
+                                   unsigned int *nreported)
+{
+  unsigned int i, j, n, bad = 0, nbits;
+
+  for (i = 0; i < len; i += frame_bytes)
+    {
+      n = (len - i < frame_bytes) ? len - i : frame_bytes;
+      nbits = 0;
+      for (j = i; j < i + n; j++)
+        {
+          byte d = (rb[j] ^ ref[j]) & ((msk) ? ~msk[j] : 0xff);
+          for (; d; d &= d - 1)
+            nbits++;
+        }
+      if (nbits == 0)
+        continue;
+      bad++;
+      if (*nreported < 20)
+        fprintf(stderr, "Frame %u after FAR 0x%08x: %u bits differ\n",
+                first + i / frame_bytes, far, nbits);
+      else if (*nreported == 20)
+        fprintf(stderr, "More frames differ, not listed\n");
+      (*nreported)++;
+    }
+  return bad;
+}
+
+/* Read the configuration memory back through CFG_OUT and compare it with
+ * the FDRI data of file, see UG470 "Readback and Configuration
+ * Verification". Data is read in chunks of READBACK_FRAMES frames within
+ * one DR scan, so memory use does not depend on the device size. Bits set
+ * in mask, the .msk file of bitgen -m, are not compared.
+ * Returns the number of differing frames, -1 on error.
+ */
+int ProgAlgXC3S::readback_verify(BitFile &file, BitFile *mask)
+{
+  Timer timer;
+  std::vector<cfg_block> blocks, mblocks;
+  unsigned int k, done, len, frame_bytes, total = 0, nreported = 0;
+  int fw, bad = 0;
+  byte cmd[4 * 48];
+  byte *buf;
+
+  switch(family)
+    {
+    case FAMILY_XC4VLX:
+    case FAMILY_XC4VFX:
+    case FAMILY_XC4VSX:
+    case FAMILY_XC5VLX:
+    case FAMILY_XC5VLXT:
+    case FAMILY_XC5VSXT:
+    case FAMILY_XC5VFXT:
+    case FAMILY_XC5VTXT:
+    case FAMILY_XC7:
+      break;
+    default:
+      fprintf(stderr, "Readback not supported for this family\n");
+      return -1;
+    }
+
+  fw = ConfigStream::frameWordsForPart(file.getPartName());
+  ConfigStream cs(file.getData(), file.getLengthBytes(), 32);
+  ConfigStream ms((mask) ? mask->getData() : file.getData(),
+                  (mask) ? mask->getLengthBytes() : file.getLengthBytes(), 32);
+  if (fw == 0 || cs.parse() < 0 || cs.getFdriBlocks(blocks) <= 0)
+    {
+      fprintf(stderr, "No uncompressed frame data in bitstream\n");
+      return -1;
+    }
+  if (mask)
+    {
+      if (ms.parse() < 0 || ms.getFdriBlocks(mblocks) != (int)blocks.size())
+        {
+          fprintf(stderr, "Mask file differs in frame layout\n");
+          return -1;
+        }
+      for (k = 0; k < blocks.size(); k++)
+        if (mblocks[k].far != blocks[k].far ||
+            mblocks[k].count != blocks[k].count)
+          {
+            fprintf(stderr, "Mask file differs in frame layout\n");
+            return -1;
+          }
+    }
+
+  frame_bytes = fw * 4;
+  buf = new byte[READBACK_FRAMES * frame_bytes];
+
+  for (k = 0; k < blocks.size(); k++)
+    {
+      const cfg_block &b = blocks[k];
+      unsigned int nbytes = b.count * 4;
+      const byte *ref = file.getData() + b.data * 4;
+      const byte *msk = (mask) ? mask->getData() + mblocks[k].data * 4 : 0;
+      int n = 0;
+
+      put_cfg_word(cmd + n, 0xffffffff, 32); n += 4;
+      put_cfg_word(cmd + n, 0xaa995566, 32); n += 4;
+      put_cfg_word(cmd + n, 0x20000000, 32); n += 4;
+      put_cfg_word(cmd + n, 0x30008001, 32); n += 4; /* write CMD */
+      put_cfg_word(cmd + n, 0x00000007, 32); n += 4; /* RCRC */
+      put_cfg_word(cmd + n, 0x20000000, 32); n += 4;
+      put_cfg_word(cmd + n, 0x30008001, 32); n += 4; /* write CMD */
+      put_cfg_word(cmd + n, 0x00000004, 32); n += 4; /* RCFG */
+      put_cfg_word(cmd + n, 0x20000000, 32); n += 4;
+      put_cfg_word(cmd + n, 0x30002001, 32); n += 4; /* write FAR */
+      put_cfg_word(cmd + n, b.far, 32); n += 4;
+      put_cfg_word(cmd + n, 0x28006000, 32); n += 4; /* read FDRO */
+      /* one pad frame precedes the data */
+      put_cfg_word(cmd + n, 0x48000000 | (b.count + fw), 32); n += 4;
+      while (n < (int)sizeof(cmd))
+        {
+          put_cfg_word(cmd + n, 0x20000000, 32); n += 4;
+        }
+      jtag->shiftIR(CFG_IN);
+      jtag->shiftDR(cmd, 0, n * 8);
+      jtag->shiftIR(CFG_OUT);
+
+      jtag->shiftDR(0, buf, frame_bytes * 8, 0, false);
+      for (done = 0; done < nbytes; done += len)
+        {
+          len = nbytes - done;
+          if (len > READBACK_FRAMES * frame_bytes)
+            len = READBACK_FRAMES * frame_bytes;
+          jtag->shiftDR(0, buf, len * 8, 0, done + len == nbytes);
+          bad += compare_frames(buf, ref + done, (msk) ? msk + done : 0, len,
+                                frame_bytes, done / frame_bytes, b.far,
+                                &nreported);
+        }
+      total += nbytes;
+    }
+  delete [] buf;
+  desync(32);
+
+  if (jtag->getVerbose())
+    fprintf(stderr, "Read back %u frames in %.1f s, %d differ\n",
+            total / frame_bytes, timer.elapsed(), bad);
+  return bad;
+}
+
+/* Reboot the device from flash address addr with IPROG, see UG470
+ * "Reconfiguration and MultiBoot" and UG380 "IPROG using ICAP". On
+ * Spartan-6 the golden image at address 0 is the fallback. On
+ * Virtex-5 and 7 series the BOOTSTS register then tells which image
+ * was loaded.
+ */
+int ProgAlgXC3S::warm_boot(uint32_t addr)
+{
+  Timer timer;
+  byte buf[48];
+  byte ir[1] = {0};
+  uint32_t bootsts;
+  int n = 0, bits, st;
+  bool up = false;
+
+  switch(family)
+    {
+    case FAMILY_XC6S:
+      bits = 16;
+      put_cfg_word(buf + n, 0xffff, bits); n += 2;
+      put_cfg_word(buf + n, 0xaa99, bits); n += 2;
+      put_cfg_word(buf + n, 0x5566, bits); n += 2;
+      put_cfg_word(buf + n, 0x3261, bits); n += 2; /* write GENERAL1 */
+      put_cfg_word(buf + n, addr & 0xffff, bits); n += 2;
+      put_cfg_word(buf + n, 0x3281, bits); n += 2; /* write GENERAL2 */
+      put_cfg_word(buf + n, 0x0b00 | ((addr >> 16) & 0xff), bits); n += 2;
+      put_cfg_word(buf + n, 0x32a1, bits); n += 2; /* write GENERAL3 */
+      put_cfg_word(buf + n, 0x0000, bits); n += 2;
+      put_cfg_word(buf + n, 0x32c1, bits); n += 2; /* write GENERAL4 */
+      put_cfg_word(buf + n, 0x0b00, bits); n += 2;
+      put_cfg_word(buf + n, 0x30a1, bits); n += 2; /* write CMD */
+      put_cfg_word(buf + n, 0x000e, bits); n += 2; /* IPROG */
+      put_cfg_word(buf + n, 0x2000, bits); n += 2;
+      put_cfg_word(buf + n, 0x2000, bits); n += 2;
+      break;
+    case FAMILY_XC5VLX:
+    case FAMILY_XC5VLXT:
+    case FAMILY_XC5VSXT:
+    case FAMILY_XC5VFXT:
+    case FAMILY_XC5VTXT:
+    case FAMILY_XC7:
+      bits = 32;
+      put_cfg_word(buf + n, 0xffffffff, bits); n += 4;
+      put_cfg_word(buf + n, 0xaa995566, bits); n += 4;
+      put_cfg_word(buf + n, 0x20000000, bits); n += 4;
+      put_cfg_word(buf + n, 0x30020001, bits); n += 4; /* write WBSTAR */
+      put_cfg_word(buf + n, addr, bits); n += 4;
+      put_cfg_word(buf + n, 0x30008001, bits); n += 4; /* write CMD */
+      put_cfg_word(buf + n, 0x0000000f, bits); n += 4; /* IPROG */
+      put_cfg_word(buf + n, 0x20000000, bits); n += 4;
+      break;
+    default:
+      fprintf(stderr, "Warm boot not supported for this family\n");
+      return -1;
+    }
+
+  if (jtag->getVerbose())
+    fprintf(stderr, "Booting from 0x%06x\n", addr);
+  jtag->shiftIR(CFG_IN);
+  jtag->shiftDR(buf, 0, n * 8);
+  jtag->shiftIR(BYPASS);
+  jtag->Usleep(1000); /* let configuration clear */
+
+  while (true)
+    {
+      jtag->shiftIR(BYPASS, ir);
+      if ((ir[0] & 0x23) == 0x21)
+        {
+          up = true;
+          break;
+        }
+      if (timer.elapsed() > BOOT_TIMEOUT)
+        {
+          fprintf(stderr, "Device did not come up after IPROG, "
+                  "INSTRUCTION_CAPTURE is 0x%02x\n", ir[0]);
+          break;
+        }
+      jtag->cycleTCK(POLL_TCK);
+    }
+
+  /* The Spartan-6 BOOTSTS has its own layout, only DONE is reported */
+  if (bits == 16)
+    {
+      if (up)
+        fprintf(stderr, "Device configured after %.1f ms\n",
+                timer.elapsed() * 1000);
+      return (up) ? 0 : 1;
     }
-  if (i == 50)
-    fprintf(stderr, 
-	    "Device failed to configure, INSTRUCTION_CAPTURE is 0x%02x\n",
-	    buf[0]);
+  if (read_reg(CFG_REG_BOOTSTS, &bootsts))
+    return -1;
+  st = bootsts & 0xff;
+  fprintf(stderr, "BOOTSTS 0x%08x: %s image loaded after %.1f ms",
+          bootsts, (st & 0x02) ? "fallback" : "requested",
+          timer.elapsed() * 1000);
+  if (st & 0x08)
+    fprintf(stderr, ", watchdog timeout");
+  if (st & 0x10)
+    fprintf(stderr, ", IDCODE error");
+  if (st & 0x20)
+    fprintf(stderr, ", CRC error");
+  fprintf(stderr, "\n");
+  return ((st & 0x01) && !(st & 0x02)) ? 0 : 1;
 }
 
 void ProgAlgXC3S::reconfig(void)
@@ -60,10 +60,21 @@ class ProgAlgXC3S
   void flow_program_xc2s(BitFile &file);
   void flow_array_program(BitFile &file);
   void flow_program_legacy(BitFile &file);
+  int read_reg(int reg, uint32_t *val);
+  int read_stat(uint32_t *stat);
+  void desync(int bits);
+  int decode_stat(uint32_t stat);
+  int wait_init(void);
+  int wait_done(void);
  public:
   ProgAlgXC3S(Jtag &j, int family);
-  void array_program(BitFile &file);
+  int array_program(BitFile &file);
+  int broadcast_program(BitFile &file, const int *devs, int ndevs);
+  void partial_program(BitFile &file);
+  int readback_verify(BitFile &file, BitFile *mask);
+  int is_loaded(BitFile &file);
   void reconfig();
+  int warm_boot(uint32_t addr);
 };
 
 
@@ -32,6 +32,7 @@ const byte ProgAlgXC95X::ISC_READ=0xee;
 const byte ProgAlgXC95X::ISC_ENABLE=0xe9;
 
 const byte ProgAlgXC95X::XSC_BLANK_CHECK=0xe5;
+const byte ProgAlgXC95X::USERCODE=0xfd;
 
 const byte ProgAlgXC95X::BYPASS=0xff;
 
@@ -373,3 +374,12 @@ int ProgAlgXC95X::array_verify(JedecFile &file)
   flow_disable();
   return ret;
 }
+
+uint32_t ProgAlgXC95X::read_usercode(void)
+{
+  byte data[4];
+
+  jtag->shiftIR(&USERCODE);
+  jtag->shiftDR(0, data, 32);
+  return jtag->byteArrayToLong(data);
+}
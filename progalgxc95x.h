@@ -39,6 +39,7 @@ class ProgAlgXC95X
   static const byte ISC_ENABLE;
   
   static const byte XSC_BLANK_CHECK;
+  static const byte USERCODE;
 
   static const byte BYPASS;
 
@@ -59,6 +60,7 @@ class ProgAlgXC95X
   int array_verify(JedecFile &file);
   void array_read(JedecFile &file);
   void array_program(JedecFile &file);
+  uint32_t read_usercode(void);
 };
 
 
@@ -195,6 +195,10 @@ int ProgAlgXCF::program(BitFile &file)
 
   unsigned int skipblocks = skipbits / block_size;
   unsigned int nblocks    = (nbits + block_size - 1) / block_size;
+  std::vector<bit_range> ext;
+
+  /* Blocks in the holes of a sparse image stay erased */
+  file.getRanges(0, (nbits + 7) / 8, block_size / 8, ext);
 
   Timer timer;
   jtag->shiftIR(&ISC_DISABLE);
@@ -212,6 +216,9 @@ int ProgAlgXCF::program(BitFile &file)
       unsigned int frame = (skipblocks + i) * FRAMES_PER_BLOCK;
       int j;
 
+      if (!BitFile::inRanges(ext, i * block_size / 8))
+        continue;
+
       if (jtag->getVerbose())
         {
           fprintf(stderr, "\rProgramming block %6u/%6u at XCF frame 0x%04x",
@@ -319,6 +326,9 @@ int ProgAlgXCF::verify(BitFile &file)
 
   unsigned int skipblocks = skipbits / block_size;
   unsigned int nblocks    = (nbits + block_size - 1) / block_size;
+  std::vector<bit_range> ext;
+
+  file.getRanges(0, (nbits + 7) / 8, block_size / 8, ext);
 
   Timer timer;
   jtag->setTapState(Jtag::TEST_LOGIC_RESET);
@@ -331,6 +341,9 @@ int ProgAlgXCF::verify(BitFile &file)
       unsigned int frame = (skipblocks + i) * FRAMES_PER_BLOCK;
       int res;
 
+      if (!BitFile::inRanges(ext, i * block_size / 8))
+        continue;
+
       if(jtag->getVerbose())
         {
           fprintf(stderr, "\rVerify block %6u/%6u at XCF frame 0x%04x",
@@ -368,7 +381,6 @@ int ProgAlgXCF::verify(BitFile &file)
 
 int ProgAlgXCF::read(BitFile &file)
 {
-  byte data[MAX_BLOCK_SIZE/8];
   unsigned int skipbits, nbits;
 
   skipbits = file.getOffset() * 8;
@@ -394,12 +406,40 @@ int ProgAlgXCF::read(BitFile &file)
       nbits = size - skipbits;
     }
 
-  unsigned int skipblocks = skipbits / block_size;
-  unsigned int nblocks    = (nbits + block_size - 1) / block_size;
- 
   file.setLength(nbits);
 
   Timer timer;
+  read_blocks(file.getData(), skipbits / block_size, nbits);
+
+  if (jtag->getVerbose())
+    fprintf(stderr, "\nSuccess! Read time %.1f ms\n", timer.elapsed() * 1.0e3);
+
+  return 0;
+}
+
+int ProgAlgXCF::readRange(byte *dest, unsigned int offset, unsigned int len)
+{
+  if ((offset * 8) % block_size != 0)
+    {
+      fprintf(stderr, "Read does not start at block boundary (offset = %u bits), aborting\n", offset * 8);
+      return -1;
+    }
+  if (offset * 8 > size || len * 8 > size - offset * 8)
+    {
+      fprintf(stderr,"Read outside PROM area requested, aborting\n");
+      return -1;
+    }
+  read_blocks(dest, offset * 8 / block_size, len * 8);
+  return 0;
+}
+
+/* Read nbits starting at block skipblocks into dest */
+void ProgAlgXCF::read_blocks(byte *dest, unsigned int skipblocks,
+                             unsigned int nbits)
+{
+  byte data[MAX_BLOCK_SIZE/8];
+  unsigned int nblocks    = (nbits + block_size - 1) / block_size;
+
   jtag->setTapState(Jtag::TEST_LOGIC_RESET);
   jtag->shiftIR(&ISC_ENABLE);
   data[0]=0x34;
@@ -427,15 +467,10 @@ int ProgAlgXCF::read(BitFile &file)
       unsigned int blkbytes = block_size / 8;
       if ((i + 1) * block_size > nbits)
         blkbytes = (nbits - (i * block_size) + 7) / 8;
-      memcpy(&(file.getData())[i*block_size/8], data, blkbytes);
+      memcpy(&dest[i*block_size/8], data, blkbytes);
     }
 
-  if (jtag->getVerbose())
-    fprintf(stderr, "\nSuccess! Read time %.1f ms\n", timer.elapsed() * 1.0e3);
-
   jtag->tapTestLogicReset();
-
-  return 0;
 }
 
 void ProgAlgXCF::disable()
@@ -53,6 +53,8 @@ class ProgAlgXCF : public ProgAlg
   unsigned int size;
   bool use_optimized_algs;
 
+  void read_blocks(byte *dest, unsigned int skipblocks, unsigned int nbits);
+
  public:
   ProgAlgXCF(Jtag &j, int si);
   virtual ~ProgAlgXCF() { }
@@ -61,6 +63,7 @@ class ProgAlgXCF : public ProgAlg
   virtual int program(BitFile &file);
   virtual int verify(BitFile &file);
   virtual int read(BitFile &file);
+  virtual int readRange(byte *data, unsigned int offset, unsigned int len);
   virtual void disable();
   virtual void reconfig();
 };
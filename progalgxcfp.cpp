@@ -606,6 +606,66 @@ int ProgAlgXCFP::read(BitFile &file)
 }
 
 
+/* Read len bytes at the PROM address offset, which must be a multiple of
+ * the 32 byte read size
+ */
+int ProgAlgXCFP::readRange(byte *dest, unsigned int offset, unsigned int len)
+{
+  byte data[32];
+  unsigned int p, n;
+  int ret;
+
+  if (offset % 32)
+    {
+      fprintf(stderr, "Read does not start at 32 byte boundary (offset = %u), aborting\n", offset);
+      return -1;
+    }
+  if (offset > getSize() / 8 || len > getSize() / 8 - offset)
+    {
+      fprintf(stderr, "Read outside PROM area requested, aborting\n");
+      return -1;
+    }
+
+  jtag->tapTestLogicReset();
+  jtag->Usleep(1000);
+
+  ret = verify_idcode();
+  if (ret)
+    return ret;
+
+  enable();
+
+  for (p = 0; p < len; p += 32)
+    {
+      unsigned int addr = offset + p;
+
+      /* address is set again at the start of each block */
+      if (p == 0 || addr % block_size == 0)
+        {
+          jtag->longToByteArray(addr, data);
+          jtag->shiftIR(ISC_ADDRESS_SHIFT);
+          jtag->shiftDR(data, 0, 24);
+          jtag->cycleTCK(1);
+        }
+      jtag->shiftIR(ISC_READ);
+      jtag->Usleep(25);
+
+      jtag->shiftIR(ISC_DATA_SHIFT);
+      jtag->cycleTCK(1);
+      n = (len - p > 32)? 32 : len - p;
+      if (n == 32)
+        jtag->shiftDR(0, dest + p, 256);
+      else
+        {
+          jtag->shiftDR(0, data, 256);
+          memcpy(dest + p, data, n);
+        }
+    }
+
+  disable();
+  return 0;
+}
+
 void ProgAlgXCFP::reconfig(void)
 {
   jtag->shiftIR(XSC_CONFIG);
@@ -36,6 +36,7 @@ class ProgAlgXCFP : public ProgAlg
   virtual int program(BitFile &file);
   virtual int verify(BitFile &file);
   virtual int read(BitFile &file);
+  virtual int readRange(byte *data, unsigned int offset, unsigned int len);
   virtual void reconfig();
   virtual void disable();
 
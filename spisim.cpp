@@ -0,0 +1,225 @@
+/* Run the SPI flash algorithms against a simulated bscan_spi core
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+For each flash below, an image is programmed, verified by reading back
+and by CRC, read and checked against the flash contents of the model.
+Flipped bits must make verify fail, the flash outside the image and the
+holes of a sparse image must keep their data. The exit code is the
+number of failed cases.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "iospisim.h"
+#include "jtag.h"
+#include "bitfile.h"
+#include "bitrev.h"
+#include "progalgspiflash.h"
+
+#define SIM_IDCODE   0x0362d093
+#define DATA_LEN     (40000 + 123)   /* several FIFOs and a partial page */
+
+struct sim_case
+{
+  const char *name;
+  unsigned char jedec[3];
+  unsigned int size;       /* bytes */
+  unsigned int sector;     /* erased by 0xD8 */
+  bool v2;                 /* v2 core, else only USER1 */
+  unsigned char sr, sr2;   /* QE bits */
+};
+
+static const sim_case cases[] =
+  {
+    {"N25Q128, v2 core, quad read", {0x20, 0xba, 0x18}, 16 << 20, 65536,
+     true, 0, 0},
+    {"N25Q256, v2 core, 4 byte addresses", {0x20, 0xba, 0x19}, 32 << 20,
+     65536, true, 0, 0},
+    {"W25Q128, v2 core, QE clear", {0xef, 0x40, 0x18}, 16 << 20, 65536,
+     true, 0, 0},
+    {"W25Q128, v2 core, QE set", {0xef, 0x40, 0x18}, 16 << 20, 65536,
+     true, 0, 0x02},
+    {"MX25L25635, v2 core, QE set", {0xc2, 0x20, 0x19}, 32 << 20, 65536,
+     true, 0x40, 0},
+    {"N25Q128, version 1 core", {0x20, 0xba, 0x18}, 16 << 20, 65536,
+     false, 0, 0},
+  };
+
+static unsigned int seed = 1;
+
+static byte next_byte(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static int check(bool ok, const char *what)
+{
+  if (!ok)
+    fprintf(stderr, "Check failed: %s\n", what);
+  return (ok)? 0 : 1;
+}
+
+/* Does the flash hold the populated bytes of file? */
+static bool flash_holds(SpiSimFlash &flash, BitFile &file)
+{
+  std::vector<bit_range> parts;
+  unsigned int k, i;
+
+  file.getRanges(0, file.getLengthBytes(), 1, parts);
+  for (k = 0; k < parts.size(); k++)
+    for (i = parts[k].start; i < parts[k].start + parts[k].len; i++)
+      if (flash.mem[file.getOffset() + i] != bitRevTable[file.getData()[i]])
+        return false;
+  return true;
+}
+
+static void fill(SpiSimFlash &flash, unsigned int start, unsigned int len)
+{
+  for (unsigned int i = start; i < start + len; i++)
+    flash.mem[i] = (i * 7) & 0xff;
+}
+
+static bool filled(SpiSimFlash &flash, unsigned int start, unsigned int len)
+{
+  for (unsigned int i = start; i < start + len; i++)
+    if (flash.mem[i] != ((i * 7) & 0xff))
+      return false;
+  return true;
+}
+
+static int run_case(const sim_case *c, bool verbose)
+{
+  SpiSimFlash flash(c->jedec, c->size, c->sector);
+  IOSpiSim io(flash, c->v2);
+  Jtag jtag(&io);
+  BitFile file, sparse, rfile;
+  std::vector<byte> data(DATA_LEN);
+  /* crosses 16 MiB on the 32 MiB flashes */
+  unsigned int offset = c->size / 2 - 0x3000;
+  unsigned int base = offset + 0x100000;
+  unsigned int top = c->size - 0x10000;
+  unsigned int i;
+  int fail = 0;
+
+  flash.sr = c->sr;
+  flash.sr2 = c->sr2;
+  /* another image that must survive */
+  fill(flash, top, 0x10000);
+  /* a sector in the hole of the sparse image */
+  fill(flash, base + 0x20000, 0x10000);
+
+  jtag.setVerbose(verbose);
+  if (jtag.getChain() != 1 || jtag.getDeviceID(0) != SIM_IDCODE)
+    return check(false, "IDCODE");
+  jtag.setDeviceIRLength(0, 6);
+  jtag.selectDevice(0);
+  ProgAlgSPIFlash alg(jtag);
+  if (alg.spi_flashinfo() != 1)
+    return check(false, "flash identification");
+  fail += check((alg.readCoreSignature() != 0) == c->v2, "core signature");
+
+  for (i = 0; i < DATA_LEN; i++)
+    data[i] = next_byte();
+  file.place(&data[0], 0, DATA_LEN);
+  file.setOffset(offset);
+  fail += check(alg.program(file) == 0, "program");
+  fail += check(flash_holds(flash, file), "flash holds the image");
+  fail += check(alg.verify(file) == 0, "verify");
+  alg.setCrcVerify(true);
+  fail += check(alg.verify(file) == 0, "CRC verify");
+  alg.setCrcVerify(false);
+
+  rfile.setOffset(offset);
+  rfile.setRLength(DATA_LEN);
+  fail += check(alg.read(rfile) == 0 &&
+                rfile.getLengthBytes() == DATA_LEN &&
+                memcmp(rfile.getData(), &data[0], DATA_LEN) == 0, "read");
+
+  /* in a CRC block and in the tail that is read back */
+  flash.mem[offset + 1000] ^= 0x10;
+  fail += check(alg.verify(file) != 0, "verify finds a flipped bit");
+  alg.setCrcVerify(true);
+  fail += check(alg.verify(file) != 0, "CRC verify finds a flipped bit");
+  flash.mem[offset + 1000] ^= 0x10;
+  flash.mem[offset + DATA_LEN - 1] ^= 0x01;
+  fail += check(alg.verify(file) != 0,
+                "CRC verify finds a flipped bit in the tail");
+  flash.mem[offset + DATA_LEN - 1] ^= 0x01;
+  alg.setCrcVerify(false);
+
+  /* two parts with whole sectors between them */
+  sparse.place(&data[0], 0, 5000);
+  sparse.place(&data[5000], 0x40000, 3000);
+  sparse.setOffset(base);
+  fail += check(alg.program(sparse) == 0, "program sparse image");
+  fail += check(flash_holds(flash, sparse), "flash holds the sparse image");
+  fail += check(filled(flash, base + 0x20000, 0x10000),
+                "hole of the sparse image untouched");
+  alg.setCrcVerify(c->v2);
+  fail += check(alg.verify(sparse) == 0, "verify sparse image");
+
+  fail += check(filled(flash, top, 0x10000), "flash after the image untouched");
+  fail += check(io.getErrors() == 0, "no errors in the model");
+  return fail;
+}
+
+void usage(void)
+{
+  fprintf(stderr,
+          "\nUsage: spisim [-v]\n"
+          "   -h\t\tprint this help\n"
+          "   -v\t\tverbose output\n");
+  exit(255);
+}
+
+int main(int argc, char **args)
+{
+  bool verbose = false;
+  unsigned int k;
+  int failed = 0;
+
+  while (true)
+    {
+      switch (getopt(argc, args, "?hv"))
+        {
+        case -1: goto args_done;
+        case 'v':
+          verbose = true;
+          break;
+        default:
+          usage();
+        }
+    }
+ args_done:
+  for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++)
+    {
+      fprintf(stderr, "*** %s\n", cases[k].name);
+      if (run_case(&cases[k], verbose))
+        {
+          fprintf(stderr, "*** %s: FAILED\n", cases[k].name);
+          failed++;
+        }
+      else
+        fprintf(stderr, "*** %s: ok\n", cases[k].name);
+    }
+  fprintf(stderr, "%d of %u cases failed\n", failed, k);
+  return failed;
+}
@@ -23,197 +23,12 @@ Modifyied from srecdec
 
 
 #include "srecfile.h"
+#include "hexfile.h"
 #include "io_exception.h"
 
 #include <string.h>
 #include <stdlib.h>
 
-int SrecFile::DecodeSRecordLine(char *source, unsigned char *dest, S_Record *SRec)
-{
-  char buffer[16];
-  int i,l;
-
-  if(*source!='S')
-  {
-     fprintf(stderr, "\r\n%s\r\n",source);
-     if(*source != 'S')
-       { 
-	 fprintf(stderr, "DecodeSRecordLine: unexpected char 0x%02x", *source);
-	 if (isprint(*source))
-	   fprintf(stderr," \"%c\"", *source);
-	 fprintf(stderr, "\n");  
-	 return -1;
-       }
-  }
-  source++;
-  SRec->Type=*source++-'0';
-  for(i=0;i<2;i++)
-  {
-    buffer[i]=*source++;
-  }
-  buffer[i]=0;
-  SRec->Length=(char)Hex2Bin(buffer);
-  switch(SRec->Type)
-  {
-    case 0:  /* Start Record */
-      for(i=0;i<4;i++)
-      {
-        buffer[i]=*source++;
-      }
-      buffer[i]=0;
-      SRec->Address=Hex2Bin(buffer);
-      l=SRec->Length-3;  /* 2 Address Bytes + 1 Checksum Bytes */
-      for(i=0;i<l;i++)
-      {
-        buffer[0]=*source++;
-        buffer[1]=*source++;
-        buffer[2]=0;
-        *dest++=(unsigned char)Hex2Bin(buffer);
-      }
-      *dest=0;
-      SRec->DataLength=l;  /* Actual Number of Data Bytes */
-      break;
-    case 1: /* Data Record 16 bit address */
-      for(i=0;i<4;i++)
-      {
-        buffer[i]=*source++;
-      }
-      buffer[i]=0;
-      SRec->Address=Hex2Bin(buffer);
-      l=SRec->Length-3;  /* 2 Address Bytes + 1 Checksum Bytes */
-      for(i=0;i<l;i++)
-      {
-        buffer[0]=*source++;
-        buffer[1]=*source++;
-        buffer[2]=0;
-        *dest++=(unsigned char)Hex2Bin(buffer);
-      }
-      SRec->DataLength=l;  /* Actual Number of Data Bytes */
-      break;
-    case 2: /* Data Record 24 bit address */
-      for(i=0;i<6;i++)
-      {
-        buffer[i]=*source++;
-      }
-      buffer[i]=0;
-      SRec->Address=Hex2Bin(buffer);
-      l=SRec->Length-4;  /* 3 Address Bytes + 1 Checksum Bytes */
-      for(i=0;i<l;i++)
-      {
-        buffer[0]=*source++;
-        buffer[1]=*source++;
-        buffer[2]=0;
-        *dest++=(unsigned char)Hex2Bin(buffer);
-      }
-      SRec->DataLength=l;  /* Actual Number of Data Bytes */
-      break;
-    case 3: /* Data Record 32 bit address */
-      for(i=0;i<8;i++)
-      {
-        buffer[i]=*source++;
-      }
-      buffer[i]=0;
-      SRec->Address=Hex2Bin(buffer);
-      l=SRec->Length-5;  /* 4 Address Bytes + 1 Checksum Bytes */
-      for(i=0;i<l;i++)
-      {
-        buffer[0]=*source++;
-        buffer[1]=*source++;
-        buffer[2]=0;
-        *dest++=(unsigned char)Hex2Bin(buffer);
-      }
-      SRec->DataLength=l;  /* Actual Number of Data Bytes */
-      break;
-    case 9: /* End Record 16 bit address */
-      for(i=0;i<4;i++)
-      {
-        buffer[i]=*source++;
-      }
-      buffer[i]=0;
-      SRec->Address=Hex2Bin(buffer);
-      SRec->DataLength=0;
-      break;
-    case 8: /* End Record 24 bit address */
-      for(i=0;i<6;i++)
-      {
-        buffer[i]=*source++;
-      }
-      buffer[i]=0;
-      SRec->Address=Hex2Bin(buffer);
-      SRec->DataLength=0;
-      break;
-    case 7: /* End Record 32 bit address */
-      for(i=0;i<8;i++)
-      {
-        buffer[i]=*source++;
-      }
-      buffer[i]=0;
-      SRec->Address=Hex2Bin(buffer);
-      SRec->DataLength=0;
-      break;
-    default:
-      SRec->Type=255;
-      SRec->Address=0;
-      SRec->Length=0;
-      SRec->DataLength=0;
-      break;
-  }
- return -1;
-}
-
-
-long SrecFile::Hex2Bin(char *ptr)
-{
-   long tmp;
-   sscanf(ptr,"%lX",&tmp);
-   return((long)tmp);
-}
-
-char SrecFile::RecordType(char Type)
-{
-  char tmp=3;
-
-  switch(Type)
-  {
-    case 0:
-      tmp=STARTRECORD;
-      break;
-    case 1:
-    case 2:
-    case 3:
-      tmp=DATARECORD;
-      break;
-    case 7:
-    case 8:
-    case 9:
-     tmp=ENDRECORD;
-     break;
-  }
-  return(tmp);
-}
-
-int SrecFile::ReadOneLine(FILE *fp,char *dest, int len)
-{
-   char c;
-   int count=0;
-
-   while((!feof(fp)) && (count <len))
-   {
-     c=fgetc(fp);
-     if(c=='\r' || c=='\n')
-     {
-       if(count)  /* If CR or LF is at start of line do not return */
-         return(count);
-     }
-     else
-     {
-       dest[count]=c;
-       count++;
-     }
-   }
-   return(count);
-}
-
 SrecFile::SrecFile(void)
 {
     buffer = 0;
@@ -227,11 +42,10 @@ SrecFile::~SrecFile(void)
 
 int SrecFile::readSrecFile(char const * fname, unsigned int bufsize)
 {
-  unsigned char LBuf[256];
   char LineBuffer[256];
-  int i, k;
-  S_Record SRec;
-  unsigned long StartAddress=0xFFFFFFFFUL,Address=0,NumberOfBytes=0,MaxA=0;
+  std::vector<image_segment> segs;
+  unsigned int i;
+  int res;
   
   StartAddr  = 0;
   Bytes_Read = 0;
@@ -242,7 +56,8 @@ int SrecFile::readSrecFile(char const * fname, unsigned int bufsize)
     {
       if(!strchr(fname,'.'))
 	{
-	  strncpy(LineBuffer,fname, 252);
+	  strncpy(LineBuffer,fname, 250);
+	  LineBuffer[250] = 0;
 	  strcat(LineBuffer,".rom");
 	  fp=fopen(LineBuffer,"rb");
 	}
@@ -250,6 +65,11 @@ int SrecFile::readSrecFile(char const * fname, unsigned int bufsize)
   if (!fp)
     return -1;
 
+  res = readHexFile(fp, HEX_SREC, segs);
+  fclose(fp);
+  if (res)
+    return -3;
+
   if (bufsize == 0)
     bufsize = 1024*1024; /* Defaule size if no size given*/
 		 
@@ -259,45 +79,27 @@ int SrecFile::readSrecFile(char const * fname, unsigned int bufsize)
       fprintf(stderr, "Cannot allocate buffer\n");
       return -2;
     }
+  memset(buffer, 0xff, bufsize);
 
-  while(!feof(fp))
-  {
-    i=ReadOneLine(fp,LineBuffer, sizeof(LineBuffer));
-    if(i<=2)
-      break;
-    if (DecodeSRecordLine(LineBuffer,LBuf, &SRec) <0)
-      return -3;
-    k=RecordType(SRec.Type);
-    if(k==DATARECORD)
-      {
-	for(i=0;i<SRec.DataLength;)
-	  {
-	    Address=SRec.Address;
-	    Address+=i;
-	    if (Address<StartAddress)
-	      {
-		StartAddress=Address;
-	      }
-	    if (Address >= bufsize)
-	      {
-		fprintf(stderr,"\n Address: 0x%lx",Address);
-		Bytes_Read = 0;
-		fprintf(stderr, "\n Buffer too small, "
-			"Number of bytes read = %lu \n ",NumberOfBytes);
-		return -3;
-	      }
-	    buffer[(size_t)Address] = LBuf[i];
-	    NumberOfBytes++;
-	    if(Address>MaxA)
-        {
-          MaxA=Address;
-        }
-	    i++;
-	  }
-      }
-  }
-  StartAddr  = StartAddress;
-  Bytes_Read = NumberOfBytes;
-  EndAddr    = MaxA;
+  if (segs.size() == 0)
+    return 0;
+  for (i = 0; i < segs.size(); i++)
+    {
+      image_segment &s = segs[i];
+
+      if (s.addr + s.data.size() > bufsize)
+	{
+	  fprintf(stderr,"\n Address: 0x%lx",
+		  (unsigned long)(s.addr + s.data.size() - 1));
+	  fprintf(stderr, "\n Buffer too small, "
+		  "Number of bytes read = %u \n ", Bytes_Read);
+	  Bytes_Read = 0;
+	  return -3;
+	}
+      memcpy(buffer + s.addr, &s.data[0], s.data.size());
+      Bytes_Read += s.data.size();
+    }
+  StartAddr  = segs[0].addr;
+  EndAddr    = segs.back().addr + segs.back().data.size() - 1;
   return 0;
 }
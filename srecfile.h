@@ -28,19 +28,6 @@ Modifyied from sreddec
 #include <stdio.h>
 
 typedef unsigned char byte;
-typedef struct
-{
-   int Type;    /* S-Record Type */
-   long Address; /* Block Address */
-   int Length;  /* S-Record Length */
-   int DataLength; /* Actual Number of Data Bytes */
-}S_Record;
-
-
-#define  STARTRECORD  0
-#define  DATARECORD   1
-#define  ENDRECORD    2
-
 
 class SrecFile
 {
@@ -50,10 +37,6 @@ private:
   unsigned int Bytes_Read;
   byte *buffer;
 
-  int ReadOneLine(FILE *fp,char *dest, int len);
-  int DecodeSRecordLine(char *source, unsigned char *dest, S_Record *SRec);
-  long Hex2Bin(char *ptr);
-  char RecordType(char Type);
 public:
   SrecFile(void);
   ~SrecFile(void);
@@ -0,0 +1,472 @@
+/* Read gzip, xz and zstd compressed input files transparently
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#if defined(__WIN32__)
+#include <io.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <vector>
+
+#include "unpack.h"
+
+#define IN_SIZE   (1 << 16)
+#define OUT_SIZE  (1 << 18)
+#define PIPE_SIZE (1 << 20)   /* data unpacked ahead of the reader */
+
+/* Compressed input, from a file or from memory */
+struct unpack_src
+{
+  FILE *fp;
+  const unsigned char *data;
+  size_t len;
+  unsigned char head[8];      /* read to tell the format */
+  size_t nhead;
+};
+
+/* Unpacked data, appended to vec or written to the pipe fd */
+struct unpack_dst
+{
+  std::vector<unsigned char> *vec;
+  int fd;
+};
+
+typedef int (*unpack_fn)(unpack_src *s, unpack_dst *d, unsigned char *in,
+                         unsigned char *out);
+
+struct pack_format
+{
+  const char *name;
+  unsigned char magic[6];
+  size_t len;
+  unpack_fn unpack;   /* 0 if not built in */
+};
+
+/* The bytes read to tell the format come first, then the rest */
+static size_t get_in(unpack_src *s, unsigned char *buf, size_t len)
+{
+  size_t n = s->nhead;
+
+  memcpy(buf, s->head, n);
+  s->nhead = 0;
+  if (s->fp)
+    return n + fread(buf + n, 1, len - n, s->fp);
+  if (len - n > s->len)
+    len = s->len + n;
+  memcpy(buf + n, s->data, len - n);
+  s->data += len - n;
+  s->len -= len - n;
+  return len;
+}
+
+/* Hand over all of data, false once the reader has closed its end */
+static bool put_out(unpack_dst *d, const unsigned char *data, size_t len)
+{
+  if (d->vec)
+    {
+      d->vec->insert(d->vec->end(), data, data + len);
+      return true;
+    }
+  while (len)
+    {
+      ssize_t n = write(d->fd, data, len);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      len -= n;
+    }
+  return true;
+}
+
+/* The unpack functions return 0 at the end of the data, 1 if it is
+ * corrupt or truncated and -1 if the reader went away. in and out hold
+ * IN_SIZE and OUT_SIZE bytes.
+ */
+#ifdef HAVE_ZLIB
+static int unpack_gzip(unpack_src *s, unpack_dst *d, unsigned char *in,
+                       unsigned char *out)
+{
+  z_stream strm;
+  bool eof = false;
+  int res = Z_OK;
+
+  memset(&strm, 0, sizeof(strm));
+  /* 16 + MAX_WBITS: expect a gzip header */
+  if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK)
+    return 1;
+  do
+    {
+      if (strm.avail_in == 0 && !eof)
+        {
+          strm.next_in = in;
+          strm.avail_in = get_in(s, in, IN_SIZE);
+          eof = (strm.avail_in == 0);
+        }
+      if (res == Z_STREAM_END)
+        {
+          if (strm.avail_in == 0)
+            break;
+          /* Concatenated members, as gzip -d accepts them */
+          inflateReset(&strm);
+        }
+      strm.next_out = out;
+      strm.avail_out = OUT_SIZE;
+      res = inflate(&strm, Z_NO_FLUSH);
+      if (!put_out(d, out, OUT_SIZE - strm.avail_out))
+        {
+          inflateEnd(&strm);
+          return -1;
+        }
+    }
+  while (res == Z_OK || res == Z_STREAM_END);
+  inflateEnd(&strm);
+  return (res == Z_STREAM_END) ? 0 : 1;
+}
+#endif
+
+#ifdef HAVE_LZMA
+static int unpack_xz(unpack_src *s, unpack_dst *d, unsigned char *in,
+                     unsigned char *out)
+{
+  lzma_stream strm = LZMA_STREAM_INIT;
+  lzma_action action = LZMA_RUN;
+  lzma_ret res;
+
+  if (lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+    return 1;
+  do
+    {
+      if (strm.avail_in == 0 && action == LZMA_RUN)
+        {
+          strm.next_in = in;
+          strm.avail_in = get_in(s, in, IN_SIZE);
+          if (strm.avail_in == 0)
+            action = LZMA_FINISH;
+        }
+      strm.next_out = out;
+      strm.avail_out = OUT_SIZE;
+      res = lzma_code(&strm, action);
+      if (!put_out(d, out, OUT_SIZE - strm.avail_out))
+        {
+          lzma_end(&strm);
+          return -1;
+        }
+    }
+  while (res == LZMA_OK);
+  lzma_end(&strm);
+  return (res == LZMA_STREAM_END) ? 0 : 1;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int unpack_zstd(unpack_src *s, unpack_dst *d, unsigned char *in,
+                       unsigned char *out)
+{
+  ZSTD_DStream *ds = ZSTD_createDStream();
+  ZSTD_inBuffer ib = {in, 0, 0};
+  bool eof = false;
+  size_t res = 1;
+
+  if (!ds)
+    return 1;
+  ZSTD_initDStream(ds);
+  for (;;)
+    {
+      ZSTD_outBuffer ob = {out, OUT_SIZE, 0};
+
+      if (ib.pos == ib.size && !eof)
+        {
+          ib.size = get_in(s, in, IN_SIZE);
+          ib.pos = 0;
+          eof = (ib.size == 0);
+        }
+      /* Frames follow each other without a reset */
+      res = ZSTD_decompressStream(ds, &ob, &ib);
+      if (ZSTD_isError(res))
+        break;
+      if (!put_out(d, out, ob.pos))
+        {
+          ZSTD_freeDStream(ds);
+          return -1;
+        }
+      if (eof && ob.pos < ob.size)
+        break;
+    }
+  ZSTD_freeDStream(ds);
+  /* 0: the last frame is complete */
+  return (res == 0) ? 0 : 1;
+}
+#endif
+
+static const pack_format formats[] =
+  {
+#ifdef HAVE_ZLIB
+    {"gzip", {0x1f, 0x8b}, 2, unpack_gzip},
+#else
+    {"gzip", {0x1f, 0x8b}, 2, 0},
+#endif
+#ifdef HAVE_LZMA
+    {"xz", {0xfd, '7', 'z', 'X', 'Z', 0x00}, 6, unpack_xz},
+#else
+    {"xz", {0xfd, '7', 'z', 'X', 'Z', 0x00}, 6, 0},
+#endif
+#ifdef HAVE_ZSTD
+    {"zstd", {0x28, 0xb5, 0x2f, 0xfd}, 4, unpack_zstd},
+#else
+    {"zstd", {0x28, 0xb5, 0x2f, 0xfd}, 4, 0},
+#endif
+  };
+
+/* Read the head of s and return its format, 0 if not compressed */
+static const pack_format *find_format(unpack_src *s)
+{
+  unsigned int i;
+
+  if (s->fp)
+    s->nhead = fread(s->head, 1, sizeof(s->head), s->fp);
+  else
+    {
+      s->nhead = (s->len < sizeof(s->head)) ? s->len : sizeof(s->head);
+      memcpy(s->head, s->data, s->nhead);
+      s->data += s->nhead;
+      s->len -= s->nhead;
+    }
+  for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    if (s->nhead >= formats[i].len &&
+        memcmp(s->head, formats[i].magic, formats[i].len) == 0)
+      return &formats[i];
+  return 0;
+}
+
+static bool built_in(const pack_format *fmt)
+{
+  if (!fmt->unpack)
+    fprintf(stderr, "Built without %s support\n", fmt->name);
+  return fmt->unpack != 0;
+}
+
+int unpackMem(const unsigned char *data, size_t len,
+              std::vector<unsigned char> &out)
+{
+  std::vector<unsigned char> in(IN_SIZE), buf(OUT_SIZE);
+  unpack_src s;
+  unpack_dst d;
+  const pack_format *fmt;
+
+  s.fp = 0;
+  s.data = data;
+  s.len = len;
+  fmt = find_format(&s);
+  out.clear();
+  if (!fmt)
+    {
+      out.assign(data, data + len);
+      return 0;
+    }
+  if (!built_in(fmt))
+    return 1;
+  d.vec = &out;
+  d.fd = -1;
+  if (fmt->unpack(&s, &d, &in[0], &buf[0]))
+    {
+      fprintf(stderr, "Corrupt or truncated %s data\n", fmt->name);
+      return 1;
+    }
+  return 0;
+}
+
+/* A stream fed by a thread, until unpackCheck() collects the result */
+struct feed_job
+{
+  unpack_src src;
+  unpack_dst dst;
+  const pack_format *fmt;     /* 0 to copy the data as it is */
+  FILE *reader;
+  pthread_t tid;
+  int res;
+};
+
+static std::vector<feed_job *> jobs;
+
+static void *feed_thread(void *arg)
+{
+  feed_job *j = (feed_job *)arg;
+  std::vector<unsigned char> in(IN_SIZE), out;
+  size_t n;
+
+  if (j->fmt)
+    {
+      out.resize(OUT_SIZE);
+      j->res = j->fmt->unpack(&j->src, &j->dst, &in[0], &out[0]);
+    }
+  else
+    {
+      j->res = 0;
+      while ((n = get_in(&j->src, &in[0], IN_SIZE)) > 0)
+        if (!put_out(&j->dst, &in[0], n))
+          {
+            j->res = -1;
+            break;
+          }
+    }
+  fclose(j->src.fp);
+  /* The reader sees the end of file here */
+  close(j->dst.fd);
+  return 0;
+}
+
+/* Wait for the thread of j and drop it */
+static int end_job(unsigned int k)
+{
+  feed_job *j = jobs[k];
+  int res;
+
+  pthread_join(j->tid, 0);
+  res = j->res;
+  jobs.erase(jobs.begin() + k);
+  delete j;
+  return res;
+}
+
+FILE *unpackFile(FILE *fp)
+{
+  feed_job *j;
+  FILE *ret;
+  unsigned int k;
+  long pos;
+  int fds[2], res;
+
+  if (!fp)
+    return 0;
+  j = new feed_job;
+  j->src.fp = fp;
+  pos = ftell(fp);
+  j->fmt = find_format(&j->src);
+  /* Plain files are read directly, a pipe gets the head bytes back
+   * through the thread
+   */
+  if (!j->fmt && pos >= 0 && fseek(fp, pos, SEEK_SET) == 0)
+    {
+      delete j;
+      return fp;
+    }
+  if (j->fmt && !built_in(j->fmt))
+    {
+      fclose(fp);
+      delete j;
+      return 0;
+    }
+
+#if defined(__WIN32__)
+  res = _pipe(fds, PIPE_SIZE, _O_BINARY);
+#else
+  res = pipe(fds);
+#endif
+  if (res)
+    {
+      fprintf(stderr, "Can't create pipe: %s\n", strerror(errno));
+      fclose(fp);
+      delete j;
+      return 0;
+    }
+#ifdef F_SETPIPE_SZ
+  /* The default pipe buffer of 64 KiB stalls the thread too often */
+  fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+  ret = fdopen(fds[0], "rb");
+  if (!ret)
+    {
+      close(fds[0]);
+      close(fds[1]);
+      fclose(fp);
+      delete j;
+      return 0;
+    }
+  /* A stream that was closed without unpackCheck() left its job behind */
+  for (k = 0; k < jobs.size();)
+    if (jobs[k]->reader == ret)
+      end_job(k);
+    else
+      k++;
+  j->reader = ret;
+  j->dst.vec = 0;
+  j->dst.fd = fds[1];
+
+#if defined(__WIN32__)
+  res = pthread_create(&j->tid, 0, feed_thread, j);
+#else
+  {
+    sigset_t set, old;
+
+    /* A closed reader makes write() fail with EPIPE instead */
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    res = pthread_create(&j->tid, 0, feed_thread, j);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+  }
+#endif
+  if (res)
+    {
+      fprintf(stderr, "Can't start unpacking thread\n");
+      fclose(ret);
+      close(fds[1]);
+      fclose(fp);
+      delete j;
+      return 0;
+    }
+  jobs.push_back(j);
+  return ret;
+}
+
+int unpackCheck(FILE *fp)
+{
+  unsigned char buf[4096];
+  const char *name;
+  unsigned int k;
+
+  for (k = 0; k < jobs.size(); k++)
+    if (jobs[k]->reader == fp)
+      break;
+  if (k == jobs.size())
+    return 0;
+  /* The decoder only knows at the end whether all data was good */
+  while (fread(buf, 1, sizeof(buf), fp) > 0)
+    ;
+  name = (jobs[k]->fmt) ? jobs[k]->fmt->name : "input";
+  if (end_job(k))
+    {
+      fprintf(stderr, "Corrupt or truncated %s data\n", name);
+      return 1;
+    }
+  return 0;
+}
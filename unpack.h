@@ -0,0 +1,51 @@
+/* Read gzip, xz and zstd compressed input files transparently
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+The format is told by the magic bytes at the start of the file. A thread
+unpacks the file into a pipe while the caller reads the other end, so
+no more than the pipe buffer is held ahead of the reader and nothing is
+stored on disk. Whether the data was complete and intact is only known
+at its end: unpackCheck() reports it once the reader is done.
+*/
+
+#ifndef UNPACK_H
+#define UNPACK_H
+
+#include <stdio.h>
+#include <vector>
+
+/* Returns fp itself if it holds uncompressed data and is seekable,
+ * otherwise a stream with the unpacked data that takes over fp. Close
+ * the result with fclose() as usual, fp is closed with it. Returns 0
+ * and closes fp if the data can't be unpacked. fp may be 0.
+ */
+FILE *unpackFile(FILE *fp);
+
+/* Call when done reading fp, before fclose(). Reads the rest of a
+ * stream from unpackFile() and returns 0 if all of it was unpacked
+ * correctly, otherwise a message is printed and the return value is
+ * > 0. Always 0 for other files.
+ */
+int unpackCheck(FILE *fp);
+
+/* Unpack len bytes at data into out, data that is not compressed is
+ * copied. Returns 0 on success, otherwise a message is printed and the
+ * return value is > 0.
+ */
+int unpackMem(const unsigned char *data, size_t len,
+              std::vector<unsigned char> &out);
+
+#endif /* UNPACK_H */
@@ -51,14 +51,18 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 #include "progalgxcfp.h"
 #include "javr.h"
 #include "progalgxc3s.h"
+#include "configstream.h"
 #include "jedecfile.h"
 #include "mapfile_xc2c.h"
 #include "progalgxc95x.h"
 #include "progalgxc2c.h"
 #include "progalgavr.h"
 #include "progalgspiflash.h"
+#include "bscandb.h"
+#include "progalgbpiflash.h"
 #include "progalgnvm.h"
 #include "utilities.h"
+#include "unpack.h"
 
 using namespace std;
 
@@ -77,7 +81,9 @@ void ctrl_c(int sig)
 }
 
 int programXC3S(Jtag &g, int argc, char **args, bool verbose,
-                bool reconfig, int family);
+                bool reconfig, int family,
+                const int *chainpositions = NULL, int nchainpos = 1,
+                const char *partial_base = NULL);
 int programXCF(Jtag &jtag, DeviceDB &db, int argc, char **args,
                bool verbose, bool erase, bool reconfigure,
                const char *device, int *chainpositions, int nchainpos,
@@ -89,12 +95,51 @@ int programXC2C(Jtag &jtag, unsigned int id, int argc, char ** args,
                 const char *device);
 int programSPI(Jtag &jtag, int argc, char ** args, bool verbose, bool erase,
                bool reconfig,  int test_count,
-               char *bscanfile,int family, const char *device);
+               char *bscanfile, const char *journalfile,
+               const vector<string>& spiopts,
+               unsigned long id, int family, const char *device);
+
+int programBPI(Jtag &jtag, int argc, char ** args, bool verbose, bool erase,
+               bool reconfig, char *bscanfile, int family,
+               const char *device);
 
 int programXMega(Jtag *jtag, unsigned long id, int argc, char **args, 
 		 bool verbose, bool erase, bool reconfigure,
 		 const char *device);
 
+/* Program even if the device already holds the design (-f) */
+static bool force_program = false;
+
+/* Skip FPGAs that report the USR_ACCESS value of the bitstream (-A) */
+static bool use_usr_access = false;
+
+/* Skip CPLDs that report this USERCODE (-U) */
+static bool use_usercode = false;
+static uint32_t skip_usercode;
+
+/* Probably XC4V and XC5V should work too. No devices to test at IKDA */
+static bool is_xc3s_family(unsigned int family)
+{
+  return ( (family == FAMILY_XC2S) ||
+	  (family == FAMILY_XC2SE) ||
+	  (family == FAMILY_XC4VLX) ||
+	  (family == FAMILY_XC4VFX) ||
+	  (family == FAMILY_XC4VSX) ||
+	  (family == FAMILY_XC3S) ||
+	  (family == FAMILY_XC3SE) ||
+	  (family == FAMILY_XC3SA) ||
+	  (family == FAMILY_XC3SAN) ||
+	  (family == FAMILY_XC3SD) ||
+	  (family == FAMILY_XC6S) ||
+	  (family == FAMILY_XC2V) ||
+          (family == FAMILY_XC5VLX) ||
+          (family == FAMILY_XC5VLXT) ||
+          (family == FAMILY_XC5VSXT) ||
+          (family == FAMILY_XC5VFXT) ||
+          (family == FAMILY_XC5VTXT) ||
+          (family == FAMILY_XC7));
+}
+
 /* Excercise the IR Chain for at least 10000 Times
    If we read a different pattern, print the pattern for for optical 
    comparision and read for at least 100000 times more
@@ -339,12 +384,13 @@ void usage(bool all_options)
   fprintf(stderr, "usage:\txc3sprog -c cable [options] <file0spec> <file1spec> ...\n");
   fprintf(stderr, "\tList of known cables is given with -c follow by no or invalid cablename\n");
   fprintf(stderr, "\tfilespec is filename:action:offset:style:length\n");
-  fprintf(stderr, "\taction on of 'w|W|v|r|R'\n");
+  fprintf(stderr, "\taction on of 'w|W|v|r|R|m'\n");
   fprintf(stderr, "\tw: erase whole area, write and verify\n");
   fprintf(stderr, "\tW: Write with auto-sector erase and verify\n");
   fprintf(stderr, "\tv: Verify device against filename\n");
   fprintf(stderr, "\tr: Read from device,write to file, don't overwrite existing file\n");
   fprintf(stderr, "\tR: Read from device and write to file, overwrite existing file\n");
+  fprintf(stderr, "\tm: Verify device against the block CRCs in manifest filename\n");
   fprintf(stderr, "\tDefault action is 'w'\n\n");
   fprintf(stderr, "\tDefault offset is 0\n\n");
   fprintf(stderr, "\tstyle: One of BIT|BIN|BPI|MCS|IHEX|HEX\n");
@@ -367,20 +413,29 @@ void usage(bool all_options)
   OPT("-p val[,val...]", "Use device at JTAG Chain position <val>.");
   OPT("",   "Default (0) is device connected to JTAG Adapter TDO.");
   OPT("-e", "Erase whole device.");
+  OPT("-f", "Program even if the device already holds the design.");
   OPT("-h", "Print this help.");
   OPT("-I[file]", "Work on connected SPI Flash (ISF Mode),");
   OPT(""  , "after loading 'bscan_spi' bitfile if given.");
+  OPT("-b[file]", "Work on connected BPI Flash, after loading");
+  OPT(""  , "'bscan_bpi' bitfile if given.");
   OPT("-j", "Detect JTAG chain, nothing else (default action).");
+  OPT("-k file", "In ISF Mode, record progress in 'file' and resume an");
+  OPT(""       , "interrupted programming run from it.");
   OPT("-l", "Program lockbits if defined in fusefile.");
   OPT("-m <dir>", "Directory with XC2C mapfiles.");
+  OPT("-P file", "(FPGA only) Device runs 'file', load only the frames");
+  OPT(""       , "that differ in the new bitfile.");
   OPT("-R", "Try to reconfigure device(No other action!).");
+  OPT("-B addr", "(FPGA only) Reboot from flash address 'addr' (IPROG)");
+  OPT(""       , "and report the BOOTSTS register.");
   OPT("-T val", "Test chain 'val' times (0 = forever) or 10000 times"
       " default.");
   OPT("-J val", "Run at max with given JTAG Frequency, 0(default) means max. Rate of device");
   OPT("", "Only used for FTDI cables for now");
   OPT("-D", "Dump internal devlist and cablelist to files");
   OPT(""      , "In ISF Mode, test the SPI connection.");
-  OPT("-X opts", "Set options for XCFxxP programming");
+  OPT("-X opts", "Set options for XCFxxP programming or ISF Mode");
   OPT("-v", "Verbose output.");
 
   fprintf(stderr, "\nProgrammer specific options:\n");
@@ -392,6 +447,10 @@ void usage(bool all_options)
 
   fprintf(stderr, "\nDevice specific options:\n");
   OPT("-E file", "(AVR only) EEPROM file.");
+  OPT("-A"     , "(FPGA only) Skip writing if the device reports the");
+  OPT(""       , "USR_ACCESS value of the bitstream.");
+  OPT("-U code", "(CPLD only) Skip writing if the device reports");
+  OPT(""       , "USERCODE 'code'.");
   OPT("-F file", "(AVR only) File with fuse bits.");
 #undef OPT
 
@@ -410,6 +469,7 @@ void usage(bool all_options)
  * v: Verify device against filename
  * r: Read from device and write to file, don't overwrite exixting file
  * R: Read from device and write to file, overwrite exixting file
+ * m: Verify device against the block CRCs of a manifest (see progalg.cpp)
  *
  * possible sections:
  * f: Flash
@@ -571,6 +631,8 @@ FILE *getFile_and_Attribute_from_name(
             if(!ret)
                 fprintf(stderr, "Can't open datafile %s: %s\n", filename, 
                         strerror(errno));
+            else
+                ret = unpackFile(ret);
         }
     }
     return ret;
@@ -638,7 +700,10 @@ int main(int argc, char **args)
   bool     detectchain  = false;
   bool     chaintest    = false;
   bool     spiflash     = false;
+  bool     bpiflash     = false;
   bool     reconfigure  = false;
+  bool     warmboot     = false;
+  unsigned long bootaddr = 0;
   bool     erase        = false;
   bool     use_ftd2xx   = false;
   unsigned int jtag_freq= 0;
@@ -657,6 +722,8 @@ int main(int argc, char **args)
   int test_count = 0;
   char const *serial  = 0;
   char *bscanfile = 0;
+  char const *journalfile = 0;
+  char const *partial_base = 0;
   char *cablename = 0;
   char osname[OSNAME_LEN];
   DeviceDB db(NULL);
@@ -676,7 +743,7 @@ int main(int argc, char **args)
 
   // Start from parsing command line arguments
   while(true) {
-      int c = getopt(argc, args, "?hCLc:d:DeE:F:i:I::jJ:Lm:o:p:Rs:S:T::vX:");
+      int c = getopt(argc, args, "?Ab::B:hCLc:d:DeE:fF:i:I::jJ:k:Lm:o:p:P:Rs:S:T::U:vX:");
     switch(c) 
     {
     case -1:
@@ -695,10 +762,19 @@ int main(int argc, char **args)
       bscanfile = optarg;
       break;
 
+    case 'b':
+      bpiflash = true;
+      bscanfile = optarg;
+      break;
+
     case 'j':
       detectchain = true;
       break;
 
+    case 'k':
+      journalfile = optarg;
+      break;
+
     case 'L':
       use_ftd2xx = true;
       break;
@@ -707,6 +783,24 @@ int main(int argc, char **args)
       reconfigure = true;
       break;
 
+    case 'f':
+      force_program = true;
+      break;
+
+    case 'A':
+      use_usr_access = true;
+      break;
+
+    case 'U':
+      use_usercode = true;
+      skip_usercode = strtoul(optarg, NULL, 0);
+      break;
+
+    case 'B':
+      warmboot = true;
+      bootaddr = strtoul(optarg, NULL, 0);
+      break;
+
     case 'T':
       chaintest = true;
       if(optarg == 0)
@@ -797,6 +891,10 @@ int main(int argc, char **args)
       serial = optarg;
       break;
 
+    case 'P':
+      partial_base = optarg;
+      break;
+
     case 'X':
       {
         vector<string> new_opts = splitString(string(optarg), ',');
@@ -824,7 +922,7 @@ int main(int argc, char **args)
       dump_lists(&cabledb, &db);
 
   if((argc < 0) || (cablename == 0))  usage(true);
-  if(argc < 1 && !reconfigure && !erase) detectchain = true;
+  if(argc < 1 && !reconfigure && !warmboot && !erase) detectchain = true;
   if (verbose)
   {
     fprintf(stderr, "Using %s\n", db.getFile().c_str());
@@ -872,38 +970,40 @@ int main(int argc, char **args)
   if (nchainpos != 1 &&
       (manufacturer != MANUFACTURER_XILINX || family != FAMILY_XCF)) 
     {
-      fprintf(stderr, "Multiple positions only supported in case of XCF\n");
-      usage(false);
+      /* identical FPGAs are configured together */
+      bool same = (manufacturer == MANUFACTURER_XILINX &&
+                   is_xc3s_family(family) && !spiflash && !bpiflash);
+      for (int k = 1; same && k < nchainpos; k++)
+        same = ((get_id(jtag, db, chainpositions[k]) & 0x0fffffff) ==
+                (id & 0x0fffffff));
+      if (!same)
+        {
+          fprintf(stderr, "Multiple positions only supported in case of XCF "
+                  "or identical FPGAs\n");
+          usage(false);
+        }
+      id = get_id(jtag, db, chainpos);
     }
 
   if(spiflash)
       return programSPI(jtag, argc, args, verbose, erase,
                         reconfigure, test_count, 
+                        bscanfile, journalfile, xcfopts, id, family,
+                        db.idToDescription(id));
+  else if(bpiflash)
+      return programBPI(jtag, argc, args, verbose, erase, reconfigure,
                         bscanfile, family, db.idToDescription(id));
   else if (manufacturer == MANUFACTURER_XILINX)
     {
-      /* Probably XC4V and XC5V should work too. No devices to test at IKDA */
-      if( (family == FAMILY_XC2S) ||
-	  (family == FAMILY_XC2SE) ||
-	  (family == FAMILY_XC4VLX) ||
-	  (family == FAMILY_XC4VFX) ||
-	  (family == FAMILY_XC4VSX) ||
-	  (family == FAMILY_XC3S) ||
-	  (family == FAMILY_XC3SE) ||
-	  (family == FAMILY_XC3SA) ||
-	  (family == FAMILY_XC3SAN) ||
-	  (family == FAMILY_XC3SD) ||
-	  (family == FAMILY_XC6S) ||
-	  (family == FAMILY_XC2V) ||
-          (family == FAMILY_XC5VLX) ||
-          (family == FAMILY_XC5VLXT) ||
-          (family == FAMILY_XC5VSXT) ||
-          (family == FAMILY_XC5VFXT) ||
-          (family == FAMILY_XC5VTXT) ||
-          (family == FAMILY_XC7)
-	  )
+      if (is_xc3s_family(family) && warmboot)
+      {
+          ProgAlgXC3S alg(jtag, family);
+          return (alg.warm_boot(bootaddr)) ? 1 : 0;
+      }
+      if (is_xc3s_family(family))
           return  programXC3S(jtag, argc, args, verbose,
-                              reconfigure, family);
+                              reconfigure, family,
+                              chainpositions, nchainpos, partial_base);
   
       else if (family == FAMILY_XCF)
       {
@@ -993,8 +1093,92 @@ ProgAlg * makeProgAlg(Jtag &jtag, unsigned long id,
     }
 }
 
+/* Build the partial stream that turns the design in basename into the
+ * one in bitfile. Returns the number of changed frames, -1 on error.
+ */
+static int make_partial(BitFile &bitfile, const char *basename,
+                        BitFile &partial)
+{
+    BitFile base;
+    std::vector<uint32_t> words;
+    FILE *fp;
+    int fw = ConfigStream::frameWordsForPart(bitfile.getPartName());
+    int res;
+
+    if (ConfigStream::wordBitsForPart(bitfile.getPartName()) != 32 || !fw)
+    {
+        fprintf(stderr, "Partial configuration not supported for %s\n",
+                bitfile.getPartName());
+        return -1;
+    }
+    fp = fopen(basename, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "Can't open datafile %s: %s\n", basename,
+                strerror(errno));
+        return -1;
+    }
+    if (!(fp = unpackFile(fp)))
+        return -1;
+    res = base.readFile(fp, STYLE_BIT);
+    fclose(fp);
+    if (res)
+        return -1;
+
+    ConfigStream cs(bitfile.getData(), bitfile.getLengthBytes(), 32);
+    ConfigStream bs(base.getData(), base.getLengthBytes(), 32);
+    if (cs.parse() < 0 || bs.parse() < 0)
+        return -1;
+    res = cs.makePartial(bs, fw, words);
+    if (res > 0)
+        ConfigStream::wordsToBitFile(words, partial);
+    return res;
+}
+
+/* Load the bitgen mask (-m) that belongs to the filespec bit file,
+ * design.msk next to design.bit. Returns 1 if loaded, 0 if there is
+ * none and -1 on error.
+ */
+static int load_mask(const char *spec, BitFile &mask)
+{
+    char name[256];
+    char *p;
+    FILE *fp;
+    int res;
+
+    strncpy(name, spec, sizeof(name) - 5);
+    name[sizeof(name) - 5] = 0;
+#if defined(__WIN32__)
+    p = strchr((name[1] == ':') ? name + 2 : name, ':');
+#else
+    p = strchr(name, ':');
+#endif
+    if (p)
+        *p = 0;
+    p = strrchr(name, '.');
+    if (p && !strchr(p, '/'))
+        *p = 0;
+    strcat(name, ".msk");
+    fp = fopen(name, "rb");
+    if (!fp)
+        return 0;
+    if (!(fp = unpackFile(fp)))
+        return -1;
+    res = mask.readFile(fp, STYLE_BIT);
+    fclose(fp);
+    if (res)
+    {
+        fprintf(stderr, "Reading mask file %s failed\n", name);
+        return -1;
+    }
+    fprintf(stderr, "Using mask file %s\n", name);
+    return 1;
+}
+
 int programXC3S(Jtag &jtag, int argc, char** args,
-                bool verbose, bool reconfig, int family)
+                bool verbose, bool reconfig, int family,
+                const int *chainpositions, int nchainpos,
+                const char *partial_base)
 {
 
   ProgAlgXC3S alg(jtag, family);
@@ -1017,7 +1201,7 @@ int programXC3S(Jtag &jtag, int argc, char** args,
           fp = getFile_and_Attribute_from_name
               (args[i], &action, NULL, &bitfile_offset,
                &bitfile_style, &bitfile_length);
-          if (tolower(action) != 'w')
+          if (tolower(action) != 'w' && action != 'v')
           {
               if (verbose)
               {
@@ -1065,7 +1249,54 @@ int programXC3S(Jtag &jtag, int argc, char** args,
               fprintf(stderr, "Bitstream length: %u bits\n",
                       bitfile.getLength());
           }
-          alg.array_program(bitfile);
+          if (action != 'v' && !partial_base && nchainpos == 1 &&
+              use_usr_access && !force_program &&
+              alg.is_loaded(bitfile) == 1)
+          {
+              fprintf(stderr, "Device already holds %s, skipping "
+                      "(-f to force)\n", args[i]);
+              continue;
+          }
+          if (action == 'v')
+          {
+              BitFile mask;
+              int m = load_mask(args[i], mask);
+
+              if (m < 0)
+                  return 1;
+              res = alg.readback_verify(bitfile, (m) ? &mask : NULL);
+              if (res < 0)
+                  return 1;
+              if (res)
+              {
+                  fprintf(stderr, "Verify: Failure! %d frames differ\n", res);
+                  return 1;
+              }
+              fprintf(stderr, "Verify: Success!\n");
+              continue;
+          }
+          if (partial_base)
+          {
+              BitFile partial;
+              res = make_partial(bitfile, partial_base, partial);
+              if (res < 0)
+                  return 1;
+              if (res == 0)
+              {
+                  fprintf(stderr, "No frames differ from %s\n", partial_base);
+                  continue;
+              }
+              fprintf(stderr, "%d frames changed, loading %u of %u bytes\n",
+                      res, partial.getLengthBytes(), bitfile.getLengthBytes());
+              alg.partial_program(partial);
+          }
+          else if (nchainpos > 1)
+          {
+              if (alg.broadcast_program(bitfile, chainpositions, nchainpos))
+                  return 1;
+          }
+          else if (alg.array_program(bitfile))
+              return 1;
       }
   }
   return 0;
@@ -1121,9 +1352,32 @@ int programXCF(Jtag &jtag, DeviceDB &db, int argc, char **args,
       promfile.setOffset(promfile_offset);
       promfile.setRLength(promfile_rlength);
 
+      if (action == 'm')
+      {
+          int res;
+          if (nchainpos != 1)
+          {
+              fprintf(stderr, "Manifest verify only for a single PROM\n");
+              fclose(promfile_fp);
+              continue;
+          }
+          unsigned long id = get_id(jtag, db, chainpositions[0]);
+          std::auto_ptr<ProgAlg> alg(makeProgAlg(jtag, id, xcfopts, false));
+          res = alg->verifyManifest(promfile_fp, promfile_offset);
+          alg->disable();
+          fclose(promfile_fp);
+          if (res)
+              return 1;
+          continue;
+      }
+
       if (action == 'v' || tolower(action) == 'w')
       {
-          promfile.readFile(promfile_fp, promfile_style);
+          if (promfile.readFile(promfile_fp, promfile_style))
+          {
+              fclose(promfile_fp);
+              return 1;
+          }
 
           // If no explicit length requested, default to complete file.
           if (promfile_rlength == 0)
@@ -1249,22 +1503,130 @@ int programXCF(Jtag &jtag, DeviceDB &db, int argc, char **args,
 }
 
 
+/* Load the bscan_spi core built in for the device with this IDCODE.
+ * A core that uses no package pins is taken first, else the only one.
+ */
+static int load_builtin_bscan(Jtag &jtag, unsigned long id, int family,
+                              bool verbose)
+{
+    const struct bscan_t *list[8];
+    int i, n = bscan_find(id, list, 8);
+    BitFile bitfile;
+
+    if (n == 0)
+    {
+        fprintf(stderr, "No built in bscan_spi core for IDCODE 0x%08lx\n",
+                id);
+        return 1;
+    }
+    for (i = 0; i < n && strcmp(list[i]->package, "any"); i++)
+        ;
+    if (i == n)
+    {
+        if (n > 1)
+        {
+            fprintf(stderr, "Built in bscan_spi cores for packages");
+            for (i = 0; i < n; i++)
+                fprintf(stderr, " %s", list[i]->package);
+            fprintf(stderr, ", select one with -I<file>\n");
+            return 1;
+        }
+        i = 0;
+        fprintf(stderr, "Assuming package %s for the bscan_spi core\n",
+                list[i]->package);
+    }
+    if (bscan_load(list[i], bitfile))
+        return 1;
+    if (verbose)
+        fprintf(stderr, "Loading built in %s\n", list[i]->bitfile);
+    ProgAlgXC3S alg(jtag, family);
+    return alg.array_program(bitfile);
+}
+
+/* image holds data at flash addresses. It is programmed from the
+ * first page with data on, like a single file at its offset, so the
+ * flash below it is left alone by every algorithm.
+ */
+static int program_spi_image(ProgAlgSPIFlash &alg, BitFile &image)
+{
+    std::vector<bit_range> parts;
+    BitFile part;
+    unsigned int base, pgsize = alg.getPageSize();
+    int ret;
+
+    image.getRanges(0, image.getLengthBytes(), 1, parts);
+    if (parts.size() == 0)
+        return 0;
+    base = (parts[0].start / pgsize) * pgsize;
+    part.setOffset(base);
+    for (size_t k = 0; k < parts.size(); k++)
+        part.place(image.getData() + parts[k].start, parts[k].start - base,
+                   parts[k].len);
+    image.setLength(0);
+    ret = alg.program(part);
+    if (ret == 0 )
+        ret = alg.verify(part);
+    return ret;
+}
+
 int programSPI(Jtag &jtag, int argc, char ** args, bool verbose, bool erase,
                bool reconfig,  int test_count,
-               char *bscanfile, int family, const char *device)
+               char *bscanfile, const char *journalfile,
+               const vector<string>& spiopts,
+               unsigned long id, int family, const char *device)
 {
-    int i;
+    int i, ret;
+    bool dual = false, crc = false, reload = false;
     ProgAlgSPIFlash alg(jtag);
+    /* Consecutive write filespecs are programmed as one sparse image, so
+     * a sector shared by two files is erased once and only sectors
+     * holding data are erased at all
+     */
+    BitFile image;
     
+    if (journalfile)
+        alg.setJournal(journalfile);
+    for (size_t k = 0; k < spiopts.size(); k++)
+    {
+        const char *opt = spiopts[k].c_str();
+        if (strcasecmp(opt, "dual") == 0)
+            dual = true;
+        else if (strcasecmp(opt, "crc") == 0)
+            crc = true;
+        else if (strcasecmp(opt, "reload") == 0)
+            reload = true;
+        else
+            fprintf(stderr, "Ignoring unknown option '%s' for ISF mode\n",
+                    opt);
+    }
+    alg.setDual(dual);
+    alg.setCrcVerify(crc);
+
     if (bscanfile)
     {
-        programXC3S(jtag, 1, &bscanfile, verbose, 0, family);
+        /* Keep a resident core if it fits the requested mode */
+        uint32_t sig = (reload)? 0 : alg.readCoreSignature();
+        int version = (sig >> 8) & 0xff, variant = sig & 0xff;
+
+        if (sig && variant == ((dual)? 1 : 0) && (!crc || version >= 2))
+        {
+            if (verbose)
+                fprintf(stderr, "bscan_spi core version %d already loaded, "
+                        "not loading %s\n", version, bscanfile);
+        }
+        else
+            programXC3S(jtag, 1, &bscanfile, verbose, 0, family);
     }
 
     if (alg.spi_flashinfo() != 1 && !reconfig)
     {
-        fprintf(stderr,"ISF Bitfile probably not loaded\n");
-        return 2;
+        /* "-I" without file: try the core built in for this device */
+        if (bscanfile || load_builtin_bscan(jtag, id, family, verbose) ||
+            alg.spi_flashinfo() != 1)
+        {
+            fprintf(stderr,"ISF Bitfile probably not loaded\n");
+            return 2;
+        }
     }
 
     if (test_count)
@@ -1295,21 +1657,38 @@ int programSPI(Jtag &jtag, int argc, char ** args, bool verbose, bool erase,
             continue;
         spifile.setOffset(spifile_offset);
         spifile.setRLength(spifile_rlength);
+        if (action == 'r' || action == 'v' || action == 'm')
+        {
+            ret = program_spi_image(alg, image);
+            if (ret != 0)
+            {
+                fclose(spifile_fp);
+                return ret;
+            }
+        }
         if (action == 'r')
         {
-            alg.read(spifile);
-            spifile.saveAs(spifile_style, device, spifile_fp);
+            BitFileWriter out(spifile_fp, spifile_style, device,
+                              spifile_rlength == 0);
+            ret = alg.read(spifile, out);
         }
         else if (action == 'v')
         {
-            spifile.readFile(spifile_fp, spifile_style);
-            ret = alg.verify(spifile);
+            ret = spifile.readFile(spifile_fp, spifile_style);
+            if (ret == 0)
+                ret = alg.verify(spifile);
+        }
+        else if (action == 'm')
+        {
+            ret = (alg.verifyManifest(spifile_fp, spifile_offset))? 1 : 0;
         }
         else
         {
-            spifile.readFile(spifile_fp, spifile_style);
+            ret = spifile.readFile(spifile_fp, spifile_style);
             fclose(spifile_fp);
             spifile_fp = NULL;
+            if (ret != 0)
+                return ret;
             if(verbose)
             {
                 fprintf(stderr, "Created from NCD file: %s\n",
@@ -1321,15 +1700,24 @@ int programSPI(Jtag &jtag, int argc, char ** args, bool verbose, bool erase,
                 fprintf(stderr, "Bitstream length: %u bits\n",
                         spifile.getLength());
             }
-            ret = alg.program(spifile);
-            if (ret == 0 )
-                ret = alg.verify(spifile);
+            unsigned int len = spifile.getLengthBytes();
+            std::vector<bit_range> parts;
+
+            if (spifile_rlength != 0 && spifile_rlength < len)
+                len = spifile_rlength;
+            spifile.getRanges(0, len, 1, parts);
+            for (size_t k = 0; k < parts.size(); k++)
+                image.place(spifile.getData() + parts[k].start,
+                            spifile_offset + parts[k].start, parts[k].len);
         }
         if (spifile_fp)
             fclose(spifile_fp);
         if (ret != 0)
             return ret;
     }
+    ret = program_spi_image(alg, image);
+    if (ret != 0)
+        return ret;
 test_reconf:
     if(reconfig)
     {
@@ -1339,6 +1727,95 @@ test_reconf:
     return 0;
 }
 
+int programBPI(Jtag &jtag, int argc, char ** args, bool verbose, bool erase,
+               bool reconfig, char *bscanfile, int family,
+               const char *device)
+{
+    int i;
+    ProgAlgBPIFlash alg(jtag);
+
+    if (bscanfile)
+    {
+        programXC3S(jtag, 1, &bscanfile, verbose, 0, family);
+    }
+
+    if (alg.bpi_flashinfo() != 1 && !reconfig)
+        return 2;
+
+    if(erase)
+    {
+        if (alg.erase())
+            return 1;
+    }
+
+    for(i=0; i< argc; i++)
+    {
+        unsigned int bpifile_offset = 0;
+        unsigned int bpifile_rlength = 0;
+        int ret = 0;
+        char action = 'w';
+        BitFile bpifile;
+        FILE_STYLE  bpifile_style = STYLE_BIT;
+
+        FILE *bpifile_fp =
+            getFile_and_Attribute_from_name
+            (args[i], &action, NULL, &bpifile_offset,
+                 &bpifile_style, &bpifile_rlength);
+        if(!bpifile_fp)
+            continue;
+        bpifile.setOffset(bpifile_offset);
+        bpifile.setRLength(bpifile_rlength);
+        if (action == 'r')
+        {
+            ret = alg.read(bpifile);
+            if (ret == 0)
+                bpifile.saveAs(bpifile_style, device, bpifile_fp);
+        }
+        else if (action == 'v')
+        {
+            ret = bpifile.readFile(bpifile_fp, bpifile_style);
+            if (ret == 0)
+                ret = alg.verify(bpifile);
+        }
+        else
+        {
+            ret = bpifile.readFile(bpifile_fp, bpifile_style);
+            fclose(bpifile_fp);
+            bpifile_fp = NULL;
+            if (ret != 0)
+                return ret;
+            if(verbose)
+                fprintf(stderr, "Bitstream length: %u bits\n",
+                        bpifile.getLength());
+            ret = alg.program(bpifile);
+            if (ret == 0 )
+                ret = alg.verify(bpifile);
+        }
+        if (bpifile_fp)
+            fclose(bpifile_fp);
+        if (ret != 0)
+            return ret;
+    }
+    if(reconfig)
+    {
+        ProgAlgXC3S fpga(jtag, family);
+        fpga.reconfig();
+    }
+    return 0;
+}
+
+/* A CPLD tells which design it holds only by the USERCODE its
+ * designer chose, and the JEDEC file does not say which one that is.
+ * So the user names it with -U.
+ */
+static bool usercode_matches(uint32_t usercode, bool verbose)
+{
+    if (verbose)
+        fprintf(stderr, "USERCODE 0x%08x, -U 0x%08x\n",
+                usercode, skip_usercode);
+    return usercode == skip_usercode;
+}
+
 int programXC95X(Jtag &jtag, unsigned long id, int argc, char **args, 
                  bool verbose, bool erase, const char *device)
 {
@@ -1394,7 +1871,16 @@ int programXC95X(Jtag &jtag, unsigned long id, int argc, char **args,
         }
         else if (action == 'v' || tolower(action) == 'w') 
         {
-            jedecfile.readFile(jedecfile_fp);
+            if (jedecfile.readFile(jedecfile_fp) ||
+                unpackCheck(jedecfile_fp))
+                return 1;
+            if (tolower(action) == 'w' && use_usercode && !force_program &&
+                usercode_matches(alg.read_usercode(), verbose))
+            {
+                fprintf(stderr, "Device already holds %s, skipping "
+                        "(-f to force)\n", args[i]);
+                continue;
+            }
             if (action == 'w')
             {
                 if (!erase)
@@ -1495,6 +1981,8 @@ int programXC2C( Jtag &jtag, unsigned int id, int argc, char ** args,
             if (map_available && file_style == STYLE_JEDEC)
             {
                 ret = fuses.readFile(fp);
+                if (ret == 0 && unpackCheck(fp))
+                    return 1;
                 if (ret)
                     fprintf(stderr, "Probably no JEDEC File, aborting\n");
                 else
@@ -1505,7 +1993,8 @@ int programXC2C( Jtag &jtag, unsigned int id, int argc, char ** args,
             {
                 fprintf(stderr,"Reading style %s\n",
                         file.styleToString(file_style));
-                file.readFile(fp, file_style);
+                if (file.readFile(fp, file_style))
+                    return 1;
                 if (file.getLength() == 0)
                 {
                     fprintf(stderr, "Probably no Bitfile, aborting\n");
@@ -1528,6 +2017,15 @@ int programXC2C( Jtag &jtag, unsigned int id, int argc, char ** args,
             {
                 ProgAlgXC2C alg(jtag, size_ind);
 
+                if (tolower(action) == 'w' && use_usercode &&
+                    !force_program &&
+                    usercode_matches(alg.read_usercode(), verbose))
+                {
+                    fprintf(stderr, "Device already holds %s, skipping "
+                            "(-f to force)\n", args[i]);
+                    fclose(fp);
+                    continue;
+                }
                 if(tolower(action) == 'w')
                 {
                     if (!erase && (action == 'w'))
@@ -1719,7 +2217,8 @@ int programXMega(Jtag *jtag, unsigned long id, int argc, char **args,
         {
 	    uint32_t j, res;
             BitFile  vfile;
-            vfile.readFile(fp, file_style);
+            if (vfile.readFile(fp, file_style))
+                return 1;
             length = vfile.getLength()/8;
 	    file.setLength(length *8);
 	    res = alg.xnvm_read_memory(base, file.getData(), length);
@@ -1749,7 +2248,8 @@ int programXMega(Jtag *jtag, unsigned long id, int argc, char **args,
  	else if ((action == 'e') || (tolower(action) == 'w'))
 	{
             BitFile  rfile;
-            rfile.readFile(fp, file_style);
+            if (rfile.readFile(fp, file_style))
+                return 1;
             unsigned int i, length = rfile.getLength()/8;
 
             if (!erase && ((action == 'w') || (action == 'e')))
@@ -1794,8 +2294,14 @@ int programXMega(Jtag *jtag, unsigned long id, int argc, char **args,
             case 'u':
             {
                 uint32_t offset = (file_offset/flash_page)*flash_page;
+                std::vector<bit_range> ext;
+
+                /* Pages in the holes of a sparse hex file are left alone */
+                rfile.getRanges(0, length, flash_page, ext);
                 for (i= offset; i<length; i+=flash_page)
                 {
+                    if (!BitFile::inRanges(ext, i))
+                        continue;
                     if (action == 'w')
                     {
                         res = alg.xnvm_program_flash_page